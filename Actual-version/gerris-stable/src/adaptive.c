@@ -68,8 +68,28 @@ typedef struct {
   GtsEHeap * hcoarse, * hfine;
   gdouble clim;
   GfsVariable * hcoarsev, * hfinev, * costv, * c;
+  GHashTable * dirty;
+  GArray * rcost, * ccost;
 } AdaptParams;
 
+/* The dirty set contains the cells of the domain (but not of its
+   boundaries) which have been refined or coarsened */
+
+static void dirty_add (GHashTable * dirty, FttCell * cell)
+{
+  if (!GFS_CELL_IS_BOUNDARY (cell))
+    g_hash_table_insert (dirty, cell, cell);
+}
+
+static void dirty_cleanup (GHashTable * dirty, FttCell * cell)
+{
+  FttCell * parent = ftt_cell_parent (cell);
+
+  g_hash_table_remove (dirty, cell);
+  if (parent && !FTT_CELL_IS_DESTROYED (parent))
+    dirty_add (dirty, parent);
+}
+
 static void gfs_adapt_destroy (GtsObject * o)
 {
   gts_object_destroy (GTS_OBJECT (GFS_ADAPT (o)->minlevel));
@@ -151,6 +171,20 @@ static void gfs_adapt_read (GtsObject ** o, GtsFile * fp)
       a->maxcells = atoi (fp->token->str);
       gts_file_next_token (fp);
     }
+    else if (!strcmp (fp->token->str, "global")) {
+      gts_file_next_token (fp);
+      if (fp->type != '=') {
+	gts_file_error (fp, "expecting '='");
+	return;
+      }
+      gts_file_next_token (fp);
+      if (fp->type != GTS_INT) {
+	gts_file_error (fp, "expecting an integer (global)");
+	return;
+      }
+      a->global = atoi (fp->token->str);
+      gts_file_next_token (fp);
+    }
     else if (!strcmp (fp->token->str, "cmax")) {
       gts_file_next_token (fp);
       if (fp->type != '=') {
@@ -241,6 +275,8 @@ static void gfs_adapt_write (GtsObject * o, FILE * fp)
     fprintf (fp, "mincells = %u ", a->mincells);
   if (a->maxcells < G_MAXINT)
     fprintf (fp, "maxcells = %u ", a->maxcells);
+  if (a->global)
+    fputs ("global = 1 ", fp);
   if (a->cmax > 0.)
     fprintf (fp, "cmax = %g ", a->cmax);
   if (a->weight != 1.)
@@ -296,6 +332,7 @@ static void gfs_adapt_init (GfsAdapt * object)
   object->maxlevel = gfs_function_new (gfs_function_class (), 5);
   object->mincells = 0;
   object->maxcells = G_MAXINT;
+  object->global = FALSE;
   object->cmax = 0.;
   object->weight = 1.;
   object->cfactor = 4.;
@@ -873,6 +910,136 @@ void gfs_domain_reshape (GfsDomain * domain, guint depth)
   }
 }
 
+static void prepend_refined (FttCell * cell, FttCell * value, GSList ** queue)
+{
+  if (!FTT_CELL_IS_LEAF (cell))
+    *queue = g_slist_prepend (*queue, cell);
+}
+
+static void refine_dirty_corner (FttCell * cell, gpointer * data)
+{
+  GfsDomain * domain = data[0];
+  GHashTable * dirty = data[1];
+  GSList ** queue = data[2];
+
+  if (!GFS_CELL_IS_BOUNDARY (cell) && FTT_CELL_IS_LEAF (cell) && ftt_refine_corner (cell)) {
+    ftt_cell_refine_single (cell, domain->cell_init, domain->cell_init_data);
+    dirty_add (dirty, cell);
+    *queue = g_slist_prepend (*queue, cell);
+  }
+}
+
+static void add_cell_box (FttCell * cell, FttCell * value, GHashTable * boxes)
+{
+  while (!FTT_CELL_IS_ROOT (cell))
+    cell = ftt_cell_parent (cell);
+  GfsBox * box = FTT_ROOT_CELL (cell)->parent;
+  g_hash_table_insert (boxes, box, box);
+}
+
+static void set_merged_neighborhood (FttCell * cell)
+{
+  FttCellNeighbors n;
+  FttDirection d;
+
+  gfs_cell_traverse_mixed (cell, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS,
+			   (FttCellTraverseFunc) gfs_cell_set_merged, NULL);
+  ftt_cell_neighbors (cell, &n);
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (n.c[d] && !GFS_CELL_IS_BOUNDARY (n.c[d]))
+      gfs_cell_traverse_mixed (n.c[d], FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS,
+			       (FttCellTraverseFunc) gfs_cell_set_merged, NULL);
+}
+
+static void set_merged_dirty (FttCell * cell)
+{
+  FttCell * parent = ftt_cell_parent (cell);
+
+  set_merged_neighborhood (cell);
+  if (parent)
+    set_merged_neighborhood (parent);
+}
+
+static void box_set_merged (GfsBox * box)
+{
+  gfs_cell_traverse_mixed (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS,
+			   (FttCellTraverseFunc) gfs_cell_set_merged, NULL);
+}
+
+/**
+ * gfs_domain_reshape_dirty:
+ * @domain: a #GfsDomain.
+ * @depth: the depth of @domain.
+ * @dirty: the set of the cells of @domain refined or coarsened since
+ * @domain was last reshaped.
+ *
+ * Same as gfs_domain_reshape() but only the neighborhoods of the
+ * cells in @dirty are graded and have their merged cells recomputed
+ * and only the boundaries of the boxes containing these cells are
+ * matched and have their boundary conditions applied (see
+ * gfs_domain_match_dirty()).
+ *
+ * The cells refined to force the grading of the tree hierarchy are
+ * added to @dirty.
+ */
+void gfs_domain_reshape_dirty (GfsDomain * domain, guint depth, GHashTable * dirty)
+{
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (dirty != NULL);
+
+  /* Refining a cell can only require the refinement of the leaf
+     cells, one level coarser, in the (corner) neighborhood of its
+     parent. These are refined in turn. */
+  GSList * queue = NULL;
+  gpointer data[3] = { domain, dirty, &queue };
+  g_hash_table_foreach (dirty, (GHFunc) prepend_refined, &queue);
+  while (queue) {
+    FttCell * cell = queue->data, * parent = ftt_cell_parent (cell);
+    queue = g_slist_delete_link (queue, queue);
+    if (parent) {
+      FttCellNeighbors n;
+      FttDirection d;
+      ftt_cell_neighbors (parent, &n);
+      for (d = 0; d < FTT_NEIGHBORS; d++)
+	if (n.c[d]) {
+	  FttCellNeighbors n1;
+	  FttDirection d1;
+	  refine_dirty_corner (n.c[d], data);
+	  ftt_cell_neighbors (n.c[d], &n1);
+	  for (d1 = 0; d1 < FTT_NEIGHBORS; d1++)
+	    if (n1.c[d1])
+	      refine_dirty_corner (n1.c[d1], data);
+	}
+    }
+  }
+
+  GHashTable * boxes = g_hash_table_new (NULL, NULL);
+  g_hash_table_foreach (dirty, (GHFunc) add_cell_box, boxes);
+  gboolean refined = gfs_domain_match_dirty (domain, boxes);
+
+  g_hash_table_foreach (dirty, (GHFunc) set_merged_dirty, NULL);
+  if (refined)
+    /* the cells of some boxes, possibly already in @boxes, have been
+       refined by the boundaries but are not in @dirty */
+    g_hash_table_foreach (boxes, (GHFunc) box_set_merged, NULL);
+
+  GSList * i = domain->variables;
+  while (i) {
+    gfs_domain_bc_dirty (domain, i->data, boxes);
+    i = i->next;
+  }
+  g_hash_table_destroy (boxes);
+
+  i = domain->projections;
+  while (i) {
+    gfs_domain_projection_reshape (i->data);
+    i = i->next;
+  }
+
+  domain->reshapes++;
+  domain->reshaped += g_hash_table_size (dirty);
+}
+
 #define CELL_COST(cell) (GFS_VALUE (cell, p->costv))
 #define CELL_HCOARSE(c) (GFS_DOUBLE_TO_POINTER (GFS_VALUE (c, p->hcoarsev)))
 #define CELL_HFINE(c) (GFS_DOUBLE_TO_POINTER (GFS_VALUE (c, p->hfinev)))
@@ -994,13 +1161,19 @@ static void fill_heaps (FttCell * cell, AdaptParams * p)
   guint level = ftt_cell_level (cell);
   FttCell * parent = ftt_cell_parent (cell);
   
-  if (level < maxlevel (cell, p->sim))
+  if (level < maxlevel (cell, p->sim)) {
     GFS_DOUBLE_TO_POINTER (GFS_VALUE (cell, p->hcoarsev)) = 
       gts_eheap_insert_with_key (p->hcoarse, cell, - CELL_COST (cell));
+    if (p->rcost)
+      g_array_append_val (p->rcost, CELL_COST (cell));
+  }
   if (parent && !GFS_CELL_IS_PERMANENT (parent) && GFS_VALUE (parent, p->hfinev) == 0. &&
-      level > minlevel (parent, p->sim))
+      level > minlevel (parent, p->sim)) {
     GFS_DOUBLE_TO_POINTER (GFS_VALUE (parent, p->hfinev)) = 
       gts_eheap_insert_with_key (p->hfine, parent, CELL_COST (parent));
+    if (p->ccost)
+      g_array_append_val (p->ccost, CELL_COST (parent));
+  }
 }
 
 static gboolean fine_cell_coarsenable (FttCell * cell, AdaptParams * p)
@@ -1020,6 +1193,7 @@ static gboolean fine_cell_coarsenable (FttCell * cell, AdaptParams * p)
 
 static void fine_cell_cleanup (FttCell * cell, AdaptParams * p)
 {
+  dirty_cleanup (p->dirty, cell);
   if (!GFS_CELL_IS_BOUNDARY (cell)) {
     gpointer o;
 
@@ -1039,6 +1213,7 @@ static void cell_fine_init (FttCell * cell, AdaptParams * p)
   guint n;
 
   (* domain->cell_init) (cell, domain->cell_init_data);
+  dirty_add (p->dirty, cell);
   ftt_cell_children (cell, &child);
   for (n = 0; n < FTT_CELLS; n++)
     if (child.c[n])
@@ -1047,12 +1222,105 @@ static void cell_fine_init (FttCell * cell, AdaptParams * p)
     p->nc += FTT_CELLS;
 }
 
+#ifdef HAVE_MPI
+/* Maps doubles to unsigned integers with the same ordering */
+static guint64 double_to_ordered (gdouble a)
+{
+  union { gdouble d; guint64 u; } v;
+  v.d = a;
+  return (v.u >> 63) ? ~v.u : v.u | ((guint64) 1 << 63);
+}
+
+static gdouble ordered_to_double (guint64 u)
+{
+  union { gdouble d; guint64 u; } v;
+  v.u = (u >> 63) ? u & ~((guint64) 1 << 63) : ~u;
+  return v.d;
+}
+
+static int compare_cost (const void * a, const void * b)
+{
+  gdouble c1 = *((gdouble *) a), c2 = *((gdouble *) b);
+  return c1 < c2 ? -1 : c1 > c2 ? 1 : 0;
+}
+
+/* Returns the number of elements of the sorted array @a smaller than
+   @x (or smaller than or equal to @x if @equal is TRUE) */
+static guint count_below (GArray * a, gdouble x, gboolean equal)
+{
+  guint lo = 0, hi = a->len;
+  while (lo < hi) {
+    guint mid = (lo + hi)/2;
+    gdouble c = g_array_index (a, gdouble, mid);
+    if (c < x || (equal && c == x))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Returns the total number of cells if the cells with a cost larger
+   than @x are refined and the cells with a cost smaller than @x
+   coarsened (corner refinements are ignored) */
+static long long predicted_cells (GfsDomain * domain, AdaptParams * p, guint64 x)
+{
+  gdouble c = ordered_to_double (x);
+  long long n = p->nc + 
+    FTT_CELLS*((long long) (p->rcost->len - count_below (p->rcost, c, TRUE)) -
+	       (long long) count_below (p->ccost, c, FALSE));
+  gfs_all_reduce (domain, n, MPI_LONG_LONG, MPI_SUM);
+  return n;
+}
+
+/* Returns the cost threshold, identical on all the PEs, such that
+   the total number of cells stays between @mincells and @maxcells.
+   The threshold is found by bisection on the global number of cells
+   predicted from the candidates of the heaps of each PE. */
+static gdouble global_threshold (GfsDomain * domain, AdaptParams * p,
+				 guint mincells, guint maxcells, gdouble cmax)
+{
+  g_array_sort (p->rcost, compare_cost);
+  g_array_sort (p->ccost, compare_cost);
+
+  guint64 lo, hi, x = double_to_ordered (cmax);
+  long long n = predicted_cells (domain, p, x);
+  if (n > maxcells) {
+    /* smallest threshold larger than cmax which satisfies maxcells */
+    lo = x; hi = double_to_ordered (G_MAXDOUBLE);
+    while (lo < hi) {
+      guint64 mid = lo + (hi - lo)/2;
+      if (predicted_cells (domain, p, mid) <= maxcells)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+    return ordered_to_double (lo);
+  }
+  if (n < mincells) {
+    /* largest threshold smaller than cmax which satisfies mincells */
+    lo = double_to_ordered (- G_MAXDOUBLE); hi = x;
+    while (lo < hi) {
+      guint64 mid = hi - (hi - lo)/2;
+      if (predicted_cells (domain, p, mid) >= mincells)
+	lo = mid;
+      else
+	hi = mid - 1;
+    }
+    return ordered_to_double (lo);
+  }
+  return cmax;
+}
+#endif /* HAVE_MPI */
+
 static gboolean adapt_global (GfsSimulation * simulation,
 			      guint * depth,
 			      GfsAdaptStats * s,
 			      guint mincells, guint maxcells,
 			      GfsVariable * c,
-			      gdouble cmax)
+			      gdouble cmax,
+			      gboolean global,
+			      GHashTable * dirty)
 {
   GfsDomain * domain = GFS_DOMAIN (simulation);
   gint l;
@@ -1060,15 +1328,24 @@ static gboolean adapt_global (GfsSimulation * simulation,
   FttCell * coarse, * fine;
   gboolean changed = TRUE, global_changed = FALSE;
   AdaptParams apar;
+  guint mark = gfs_domain_temporary_mark (domain);
   
   apar.sim = simulation;
   apar.nc = 0;
-  apar.costv = gfs_temporary_variable (domain);
-  apar.hcoarsev = gfs_temporary_variable (domain);
-  apar.hfinev = gfs_temporary_variable (domain);
+  apar.costv = gfs_domain_temporary_get (domain);
+  apar.hcoarsev = gfs_domain_temporary_get (domain);
+  apar.hfinev = gfs_domain_temporary_get (domain);
   apar.hcoarse = gts_eheap_new (NULL, NULL);
   apar.hfine = gts_eheap_new (NULL, NULL);
   apar.c = c;
+  apar.dirty = dirty;
+  apar.rcost = apar.ccost = NULL;
+#ifdef HAVE_MPI
+  if (global && domain->pid >= 0) {
+    apar.rcost = g_array_new (FALSE, FALSE, sizeof (gdouble));
+    apar.ccost = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  }
+#endif /* HAVE_MPI */
   
   gfs_domain_cell_traverse (domain, 
 			    FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
@@ -1087,6 +1364,17 @@ static gboolean adapt_global (GfsSimulation * simulation,
 			    (FttCellTraverseFunc) fill_heaps, &apar);
   gts_eheap_thaw (apar.hcoarse);
   gts_eheap_thaw (apar.hfine);
+#ifdef HAVE_MPI
+  if (apar.rcost) {
+    /* the cells are refined and coarsened according to the global
+       threshold only, independently of the local number of cells */
+    cmax = global_threshold (domain, &apar, mincells, maxcells, cmax);
+    mincells = 0;
+    maxcells = G_MAXINT;
+    g_array_free (apar.rcost, TRUE);
+    g_array_free (apar.ccost, TRUE);
+  }
+#endif /* HAVE_MPI */
   coarse = remove_top_coarse (apar.hcoarse, &ccoarse, apar.hcoarsev);
   fine = remove_top_fine (apar.hfine, &cfine, apar.hfinev);
 #ifdef DEBUG
@@ -1133,9 +1421,7 @@ static gboolean adapt_global (GfsSimulation * simulation,
 
   gts_eheap_destroy (apar.hcoarse);
   gts_eheap_destroy (apar.hfine);
-  gts_object_destroy (GTS_OBJECT (apar.costv));
-  gts_object_destroy (GTS_OBJECT (apar.hcoarsev));
-  gts_object_destroy (GTS_OBJECT (apar.hfinev));  
+  gfs_domain_temporary_release (domain, mark);
 
   return global_changed;
 }
@@ -1146,6 +1432,7 @@ typedef struct {
   GfsVariable * r, * c;
   GfsAdaptStats * s;
   gboolean changed;
+  GHashTable * dirty;
 } AdaptLocalParams;
 
 #define REFINABLE(cell, p) (GFS_VALUE (cell, (p)->r))
@@ -1162,6 +1449,7 @@ static gboolean coarsen_cell (FttCell * cell, AdaptLocalParams * p)
 
 static void cell_cleanup (FttCell * cell, AdaptLocalParams * p)
 {
+  dirty_cleanup (p->dirty, cell);
   if (!GFS_CELL_IS_BOUNDARY (cell)) {
     p->s->removed++;
     p->nc--;
@@ -1181,6 +1469,7 @@ static void local_cell_fine_init (FttCell * parent,  AdaptLocalParams * p)
 {
   GfsDomain * domain = GFS_DOMAIN (p->sim);
   (* domain->cell_init) (parent, domain->cell_init_data);
+  dirty_add (p->dirty, parent);
   if (!GFS_CELL_IS_BOUNDARY (parent)) {
     p->s->created += FTT_CELLS;
     p->nc += FTT_CELLS;
@@ -1251,7 +1540,8 @@ static void enforce_periodic (GfsBox * box, AdaptLocalParams * p)
     }
 }
 
-static gboolean adapt_local (GfsSimulation * sim, guint * depth, GfsAdaptStats * s)
+static gboolean adapt_local (GfsSimulation * sim, guint * depth, GfsAdaptStats * s,
+			     GHashTable * dirty)
 {
   GfsDomain * domain = GFS_DOMAIN (sim);
   AdaptLocalParams p;
@@ -1262,6 +1552,7 @@ static gboolean adapt_local (GfsSimulation * sim, guint * depth, GfsAdaptStats *
   p.s = s;
   p.nc = 0;
   p.changed = FALSE;
+  p.dirty = dirty;
   gfs_domain_cell_traverse (domain,
 			    FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
 			    (FttCellTraverseFunc) refine_cell_mark, &p);
@@ -1292,12 +1583,18 @@ static gboolean adapt_local (GfsSimulation * sim, guint * depth, GfsAdaptStats *
  * the mesh will be refined only if all of this criteria AND any other
  * regular criterion is verified.  
  *
+ * In parallel, the @mincells and @maxcells limits apply to the
+ * subdomain of each PE unless one of the criteria sets @global, in
+ * which case all the PEs first agree on a common cost threshold such
+ * that the limits apply to the total number of cells.
+ *
  * Returns: %TRUE if the mesh changed, %FALSE otherwise.
  */
 gboolean gfs_simulation_adapt (GfsSimulation * simulation)
 {
   gboolean active = FALSE;
   guint mincells = 0, maxcells = G_MAXINT;
+  gboolean global = FALSE;
   GfsDomain * domain;
   gdouble cmax = 0.;
   GfsVariable * c = NULL;
@@ -1315,6 +1612,7 @@ gboolean gfs_simulation_adapt (GfsSimulation * simulation)
     if (a->active) {
       if (a->maxcells < maxcells) maxcells = a->maxcells;
       if (a->mincells > mincells) mincells = a->mincells;
+      if (a->global) global = TRUE;
       cmax += a->cmax;
       active = TRUE;
       if (a->c)
@@ -1326,18 +1624,26 @@ gboolean gfs_simulation_adapt (GfsSimulation * simulation)
   gboolean changed = FALSE;
   if (active) {
     guint depth = gfs_domain_depth (domain), depth_before = depth;
+    GHashTable * dirty = g_hash_table_new (NULL, NULL);
 
     if (maxcells < G_MAXINT)
       changed = adapt_global (simulation, &depth, &simulation->adapts_stats, 
-			      mincells, maxcells, c, cmax);
+			      mincells, maxcells, c, cmax, global, dirty);
     else
-      changed = adapt_local (simulation, &depth, &simulation->adapts_stats);
+      changed = adapt_local (simulation, &depth, &simulation->adapts_stats, dirty);
 
     gfs_all_reduce (domain, changed, MPI_INT, MPI_MAX);
     if (changed) {
-      gfs_domain_reshape (domain, depth);
+      gfs_domain_timer_start (domain, "adapt_reshape");
+      if (domain->reshape_dirty)
+	gfs_domain_reshape_dirty (domain, depth, dirty);
+      else
+	gfs_domain_reshape (domain, depth);
+      gfs_domain_timer_stop (domain, "adapt_reshape");
       gfs_all_reduce (domain, depth, MPI_UNSIGNED, MPI_MAX);
       simulation->adapts_stats.depth_increase = depth - depth_before;
+      /* keeps the ids of the leaves which have not changed */
+      gfs_domain_leaf_index (domain);
       /* hydrostatic pressure */
       GSList * i = domain->variables;
       while (i) {
@@ -1346,6 +1652,7 @@ gboolean gfs_simulation_adapt (GfsSimulation * simulation)
 	i = i->next;
       }
     }
+    g_hash_table_destroy (dirty);
   }
 
   gfs_domain_timer_stop (domain, "adapt");
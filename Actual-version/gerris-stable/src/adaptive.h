@@ -34,6 +34,9 @@ void          gfs_adapt_stats_update        (GfsAdaptStats * s);
 gboolean      gfs_simulation_adapt          (GfsSimulation * simulation);
 void          gfs_domain_reshape            (GfsDomain * domain,
 					     guint depth);
+void          gfs_domain_reshape_dirty      (GfsDomain * domain,
+					     guint depth,
+					     GHashTable * dirty);
 
 /* GfsAdapt: Header */
 
@@ -47,6 +50,7 @@ struct _GfsAdapt {
   /*< public >*/
   GfsFunction * minlevel, * maxlevel;
   guint mincells, maxcells;
+  gboolean global;
   gdouble cmax, weight, cfactor;
   GfsVariable * c;
   GtsKeyFunc cost;
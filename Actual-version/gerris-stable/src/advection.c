@@ -349,6 +349,8 @@ gdouble gfs_face_upwinded_value (const FttCellFace * face,
  *
  * This function assumes that the face variable has been previously
  * defined using gfs_cell_advected_face_values().
+ *
+ * This function can be used by threaded face traversals.
  */
 void gfs_face_advection_flux (const FttCellFace * face,
 			      const GfsAdvectionParams * par)
@@ -363,14 +365,14 @@ void gfs_face_advection_flux (const FttCellFace * face,
 
   if (!FTT_FACE_DIRECT (face))
     flux = - flux;
-  GFS_VALUE (face->cell, par->fv) -= flux;
+  GFS_ATOMIC_ADD (GFS_VALUE (face->cell, par->fv), - flux);
 
   switch (ftt_face_type (face)) {
   case FTT_FINE_FINE:
-    GFS_VALUE (face->neighbor, par->fv) += flux;
+    GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, par->fv), flux);
     break;
   case FTT_FINE_COARSE:
-    GFS_VALUE (face->neighbor, par->fv) += flux/FTT_CELLS;
+    GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, par->fv), flux/FTT_CELLS);
     break;
   default:
     g_assert_not_reached ();
@@ -391,6 +393,8 @@ void gfs_face_advection_flux (const FttCellFace * face,
  *
  * This function also assumes that the face value of @par->v has been
  * previously defined using gfs_cell_advected_face_values().  
+ *
+ * This function can be used by threaded face traversals.
  */
 void gfs_face_velocity_advection_flux (const FttCellFace * face,
 				       const GfsAdvectionParams * par)
@@ -417,14 +421,14 @@ void gfs_face_velocity_advection_flux (const FttCellFace * face,
 #endif
   if (!FTT_FACE_DIRECT (face))
     flux = - flux;
-  GFS_VALUE (face->cell, par->fv) -= flux;
+  GFS_ATOMIC_ADD (GFS_VALUE (face->cell, par->fv), - flux);
 
   switch (ftt_face_type (face)) {
   case FTT_FINE_FINE:
-    GFS_VALUE (face->neighbor, par->fv) += flux;
+    GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, par->fv), flux);
     break;
   case FTT_FINE_COARSE:
-    GFS_VALUE (face->neighbor, par->fv) += flux/FTT_CELLS;
+    GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, par->fv), flux/FTT_CELLS);
     break;
   default:
     g_assert_not_reached ();
@@ -445,6 +449,8 @@ void gfs_face_velocity_advection_flux (const FttCellFace * face,
  *
  * This function also assumes that the face value of @par->v has been
  * previously defined using gfs_cell_advected_face_values().  
+ *
+ * This function can be used by threaded face traversals.
  */
 void gfs_face_velocity_convective_flux (const FttCellFace * face,
 					const GfsAdvectionParams * par)
@@ -474,21 +480,21 @@ void gfs_face_velocity_convective_flux (const FttCellFace * face,
   u *= par->dt/(2.*ftt_cell_size (face->cell));
   if (!FTT_FACE_DIRECT (face))
     u = - u;
-  GFS_VALUE (face->cell, par->fv) -= 
-    u*(GFS_STATE (face->cell)->f[face->d].un + 
-       GFS_STATE (face->cell)->f[FTT_OPPOSITE_DIRECTION (face->d)].un);
+  GFS_ATOMIC_ADD (GFS_VALUE (face->cell, par->fv), 
+		  - u*(GFS_STATE (face->cell)->f[face->d].un + 
+		       GFS_STATE (face->cell)->f[FTT_OPPOSITE_DIRECTION (face->d)].un));
 
   switch (ftt_face_type (face)) {
   case FTT_FINE_FINE:
-    GFS_VALUE (face->neighbor, par->fv) += 
-      u*(GFS_STATE (face->neighbor)->f[face->d].un + 
-	 GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].un);
+    GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, par->fv),
+		    u*(GFS_STATE (face->neighbor)->f[face->d].un + 
+		       GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].un));
     break;
   case FTT_FINE_COARSE:
-    GFS_VALUE (face->neighbor, par->fv) += 
-      u*(GFS_STATE (face->neighbor)->f[face->d].un + 
-	 GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].un)
-      /FTT_CELLS;
+    GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, par->fv),
+		    u*(GFS_STATE (face->neighbor)->f[face->d].un + 
+		       GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].un)
+		    /FTT_CELLS);
     break;
   default:
     g_assert_not_reached ();
@@ -664,6 +670,20 @@ static void set_merged (FttCell * cell)
   }
 }
 
+/**
+ * gfs_cell_set_merged:
+ * @cell: a mixed #FttCell.
+ *
+ * Sets the @merged field of @cell.
+ */
+void gfs_cell_set_merged (FttCell * cell)
+{
+  g_return_if_fail (cell != NULL);
+  g_return_if_fail (GFS_IS_MIXED (cell));
+
+  set_merged (cell);
+}
+
 /**
  * gfs_set_merged:
  * @domain: the domain to traverse.
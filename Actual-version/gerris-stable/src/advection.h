@@ -92,6 +92,7 @@ void         gfs_face_interpolated_normal_velocity (const FttCellFace * face,
 						    GfsVariable ** v);
 void         gfs_face_reset_normal_velocity        (const FttCellFace * face);
 gboolean     gfs_cell_is_small                     (const FttCell * cell);
+void         gfs_cell_set_merged                   (FttCell * cell);
 void         gfs_set_merged                        (GfsDomain * domain);
 void         gfs_domain_traverse_merged            (GfsDomain * domain,
 						    GfsMergedTraverseFunc func,
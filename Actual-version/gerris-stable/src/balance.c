@@ -196,6 +196,413 @@ static void update_box_pid (GfsBox * box, GArray * pid)
     }
 }
 
+/*
+ * Balances the domain sizes by migrating boxes between neighbouring
+ * processes only, following the "balancing flow". Returns %TRUE if
+ * boxes have been moved by this process.
+ */
+static int balance_diffusion (GfsDomain * domain, gdouble average)
+{
+  BalancingFlow * balance = balancing_flow_new (domain, average);
+  GPtrArray * request = g_ptr_array_new ();
+  int modified = FALSE;
+  int i;
+  /* Send boxes */
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) reset_box_size, NULL);
+  guint nb = gts_container_size (GTS_CONTAINER (domain));
+  for (i = 0; i < balance->n; i++)
+    if (balance->flow[i] > 0.) { /* largest subdomain */
+      /* we need to find the list of boxes which minimizes 
+	 |\sum n_i - n| where n_i is the size of box i. This is known in
+	 combinatorial optimisation as a "knapsack problem". */
+      GSList * l = NULL;
+      BoxData b;
+      b.flow = balance->flow[i];
+      b.dest = balance->pid[i];
+      while (b.flow > 0 && nb > 1) {
+	b.box = NULL; b.neighboring = 0;
+	gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) select_neighbouring_box, &b);
+	if (b.box && b.box->size <= 2*b.flow) {
+	  l = g_slist_prepend (l, b.box);
+	  b.box->pid = b.dest;
+	  b.flow -= b.box->size;
+	  nb--;
+	  modified = TRUE;
+	}
+	else
+	  b.flow = 0;
+      }
+      g_ptr_array_add (request, gfs_send_boxes (domain, l, balance->pid[i]));
+      g_slist_free (l);
+    }
+  /* Receive boxes */
+  for (i = 0; i < balance->n; i++)
+    if (balance->flow[i] < 0.) { /* smallest subdomain */
+      GSList * l = gfs_receive_boxes (domain, balance->pid[i]);
+      g_slist_free (l);
+    }
+  /* Synchronize */
+  for (i = 0; i < request->len; i++)
+    gfs_wait (g_ptr_array_index (request, i));
+  g_ptr_array_free (request, TRUE);
+  balancing_flow_destroy (balance);
+  return modified;
+}
+
+/* Global repartitioning */
+
+typedef struct {
+  gdouble pid;                        /* process owning the box */
+  gdouble size;                       /* number of leaf cells */
+  gdouble pos[3];                     /* position of the centre */
+  gdouble h;                          /* size of the box */
+  gdouble neighbor[FTT_NEIGHBORS];    /* id of neighbouring boxes (or 0) */
+  gdouble faces[FTT_NEIGHBORS];       /* number of leaf faces on each side */
+} BoxInfo;
+
+typedef struct {
+  guint n;          /* number of boxes */
+  BoxInfo * box;    /* indexed by box id - 1 */
+  guint np;         /* number of processes */
+} BoxTable;
+
+static void box_info (GfsBox * box, BoxTable * t)
+{
+  g_assert (box->id > 0 && box->id <= t->n);
+  BoxInfo * b = &t->box[box->id - 1];
+  FttVector p;
+  FttDirection d;
+  int n = 0;
+
+  b->pid = gfs_box_domain (box)->pid;
+  ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+		     (FttCellTraverseFunc) count, &n);
+  b->size = n;
+  ftt_cell_pos (box->root, &p);
+  b->pos[0] = p.x; b->pos[1] = p.y; b->pos[2] = p.z;
+  b->h = ftt_cell_size (box->root);
+  for (d = 0; d < FTT_NEIGHBORS; d++) {
+    GtsObject * o = box->neighbor[d];
+    if (GFS_IS_BOX (o))
+      b->neighbor[d] = GFS_BOX (o)->id;
+    else if (GFS_IS_BOUNDARY_MPI (o))
+      b->neighbor[d] = GFS_BOUNDARY_MPI (o)->id;
+    else if (GFS_IS_BOUNDARY_PERIODIC (o))
+      b->neighbor[d] = GFS_BOUNDARY_PERIODIC (o)->matching->id;
+    if (b->neighbor[d] > 0.) {
+      n = 0;
+      ftt_cell_traverse_boundary (box->root, d, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+				  (FttCellTraverseFunc) count, &n);
+      b->faces[d] = n;
+    }
+  }
+}
+
+/*
+ * Gathers on all processes the sizes, positions and connectivity of
+ * all the boxes of @domain.
+ */
+static void box_table_init (BoxTable * t, GfsDomain * domain)
+{
+  int np;
+  MPI_Comm_size (MPI_COMM_WORLD, &np);
+  t->np = np;
+  t->n = gts_container_size (GTS_CONTAINER (domain));
+  gfs_all_reduce (domain, t->n, MPI_UNSIGNED, MPI_SUM);
+  BoxInfo * local = g_malloc0 (t->n*sizeof (BoxInfo));
+  t->box = local;
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_info, t);
+  t->box = g_malloc (t->n*sizeof (BoxInfo));
+  /* each box is only filled by the process owning it */
+  MPI_Allreduce (local, t->box, t->n*sizeof (BoxInfo)/sizeof (gdouble), MPI_DOUBLE, MPI_SUM,
+		 MPI_COMM_WORLD);
+  g_free (local);
+}
+
+/*
+ * Fills @cost with the cost of each part of partition @part (the
+ * number of leaf cells plus @surface times the number of leaf faces
+ * on the boundaries with the other parts). Returns the total number
+ * of such faces (the edge-cut of the partition).
+ */
+static gdouble partition_cost (BoxTable * t, const guint * part, gdouble surface, 
+			       gdouble * cost)
+{
+  gdouble cut = 0.;
+  guint i;
+  FttDirection d;
+
+  for (i = 0; i < t->np; i++)
+    cost[i] = 0.;
+  for (i = 0; i < t->n; i++) {
+    BoxInfo * b = &t->box[i];
+    cost[part[i]] += b->size;
+    for (d = 0; d < FTT_NEIGHBORS; d++)
+      if (b->neighbor[d] > 0. && part[(guint) b->neighbor[d] - 1] != part[i]) {
+	cost[part[i]] += surface*b->faces[d];
+	cut += b->faces[d];
+      }
+  }
+  return cut;
+}
+
+typedef struct {
+  gdouble imbalance, cut;
+} BalanceStats;
+
+static void partition_stats (BoxTable * t, const guint * part, gdouble surface,
+			     BalanceStats * stats)
+{
+  gdouble * cost = g_malloc (t->np*sizeof (gdouble)), max = 0., sum = 0.;
+  guint i;
+
+  stats->cut = partition_cost (t, part, surface, cost);
+  for (i = 0; i < t->np; i++) {
+    sum += cost[i];
+    max = MAX (max, cost[i]);
+  }
+  stats->imbalance = sum > 0. ? max*t->np/sum : 1.;
+  g_free (cost);
+}
+
+static void balance_stats (GfsDomain * domain, GfsEventBalance * s, BalanceStats * stats)
+{
+  BoxTable t;
+  box_table_init (&t, domain);
+  guint * part = g_malloc (t.n*sizeof (guint)), i;
+  for (i = 0; i < t.n; i++)
+    part[i] = t.box[i].pid;
+  partition_stats (&t, part, s->surface, stats);
+  g_free (part);
+  g_free (t.box);
+}
+
+/*
+ * Returns the index of point @x (@bits bits per coordinate) along the
+ * Hilbert curve, using the algorithm of Skilling, 2004, "Programming
+ * the Hilbert curve", AIP Conf. Proc. 707.
+ */
+static guint64 hilbert_index (guint * x, guint bits)
+{
+  guint m = 1 << (bits - 1), p, q, t;
+  gint i, b;
+
+  /* inverse undo */
+  for (q = m; q > 1; q >>= 1) {
+    p = q - 1;
+    for (i = 0; i < FTT_DIMENSION; i++)
+      if (x[i] & q)
+	x[0] ^= p;
+      else {
+	t = (x[0] ^ x[i]) & p;
+	x[0] ^= t;
+	x[i] ^= t;
+      }
+  }
+  /* Gray encode */
+  for (i = 1; i < FTT_DIMENSION; i++)
+    x[i] ^= x[i - 1];
+  t = 0;
+  for (q = m; q > 1; q >>= 1)
+    if (x[FTT_DIMENSION - 1] & q)
+      t ^= q - 1;
+  for (i = 0; i < FTT_DIMENSION; i++)
+    x[i] ^= t;
+  /* interleave the transposed bits */
+  guint64 h = 0;
+  for (b = bits - 1; b >= 0; b--)
+    for (i = 0; i < FTT_DIMENSION; i++)
+      h = (h << 1) | ((x[i] >> b) & 1);
+  return h;
+}
+
+typedef struct {
+  guint64 key;
+  guint i;
+} BoxKey;
+
+static gint compare_keys (const void * a, const void * b)
+{
+  const BoxKey * ka = a, * kb = b;
+  return ka->key < kb->key ? -1 : ka->key > kb->key ? 1 : 
+    (gint) ka->i - (gint) kb->i;
+}
+
+/*
+ * Returns the boxes of @t sorted along a Hilbert curve.
+ */
+static guint * hilbert_order (BoxTable * t)
+{
+  gdouble h = t->box[0].h;
+  gdouble min[3] = { G_MAXDOUBLE, G_MAXDOUBLE, G_MAXDOUBLE };
+  guint i, c, max = 0, bits = 1;
+
+  for (i = 0; i < t->n; i++)
+    for (c = 0; c < 3; c++)
+      min[c] = MIN (min[c], t->box[i].pos[c]);
+  guint * x = g_malloc (3*t->n*sizeof (guint));
+  for (i = 0; i < t->n; i++)
+    for (c = 0; c < 3; c++) {
+      x[3*i + c] = floor ((t->box[i].pos[c] - min[c])/h + 0.5);
+      max = MAX (max, x[3*i + c]);
+    }
+  while ((1 << bits) <= max)
+    bits++;
+  BoxKey * key = g_malloc (t->n*sizeof (BoxKey));
+  for (i = 0; i < t->n; i++) {
+    key[i].key = hilbert_index (&x[3*i], bits);
+    key[i].i = i;
+  }
+  qsort (key, t->n, sizeof (BoxKey), compare_keys);
+  guint * order = g_malloc (t->n*sizeof (guint));
+  for (i = 0; i < t->n; i++)
+    order[i] = key[i].i;
+  g_free (key);
+  g_free (x);
+  return order;
+}
+
+/*
+ * Cuts the Hilbert curve @order into @t->np contiguous parts of
+ * cost as close as possible to @target, where the cost includes
+ * @surface times the faces shared with boxes not yet in the part.
+ */
+static void hilbert_cut (BoxTable * t, const guint * order, gdouble surface, gdouble target,
+			 guint * part)
+{
+  guint i, j, k = 0, nk = 0;
+  gdouble cost = 0.;
+  FttDirection d;
+
+  for (i = 0; i < t->n; i++)
+    part[i] = G_MAXUINT;
+  for (j = 0; j < t->n; j++) {
+    BoxInfo * b = &t->box[order[j]];
+    gdouble dc = b->size;
+    for (d = 0; d < FTT_NEIGHBORS; d++)
+      if (b->neighbor[d] > 0.) {
+	guint n = b->neighbor[d] - 1;
+	if (part[n] == k)
+	  /* this face (and the matching face of the neighbor) become internal */
+	  dc -= surface*(b->faces[d] + t->box[n].faces[FTT_OPPOSITE_DIRECTION (d)]);
+	else
+	  dc += surface*b->faces[d];
+      }
+    if (k < t->np - 1 && nk > 0 &&
+	(t->n - j < t->np - k ||                        /* keep one box for each part */
+	 (cost + dc > target && cost + dc - target > target - cost))) {
+      k++;
+      nk = 0;
+      cost = 0.;
+      dc = b->size;
+      for (d = 0; d < FTT_NEIGHBORS; d++)
+	if (b->neighbor[d] > 0.)
+	  dc += surface*b->faces[d];
+    }
+    part[order[j]] = k;
+    cost += dc;
+    nk++;
+  }
+}
+
+/* total number of leaf cells and size of the smallest box */
+static void box_sizes (GfsBox * box, guint * size)
+{
+  int n = 0;
+  ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+		     (FttCellTraverseFunc) count, &n);
+  size[0] += n;
+  if (n < size[1])
+    size[1] = n;
+}
+
+static void box_destination (GfsBox * box, gpointer * data)
+{
+  guint * part = data[0], dest = part[box->id - 1];
+  GSList ** l = data[1];
+  if (dest != gfs_box_domain (box)->pid) {
+    l[dest] = g_slist_prepend (l[dest], box);
+    box->pid = dest;
+  }
+}
+
+/*
+ * Repartitions all the boxes by cutting a Hilbert curve through their
+ * centres. Returns %TRUE if boxes have been moved by this process.
+ */
+static int balance_global (GfsDomain * domain, GfsEventBalance * s)
+{
+  BoxTable t;
+  box_table_init (&t, domain);
+  if (t.n < t.np) {
+    g_free (t.box);
+    return FALSE;
+  }
+
+  guint * part = g_malloc (t.n*sizeof (guint)), * best = g_malloc (t.n*sizeof (guint)), i;
+  gdouble * cost = g_malloc (t.np*sizeof (gdouble));
+  BalanceStats old, next, leaves;
+  for (i = 0; i < t.n; i++)
+    part[i] = t.box[i].pid;
+  partition_stats (&t, part, s->surface, &old);
+
+  /* first cut using the number of leaf cells only, then use the
+     resulting cost (including communications) as target */
+  guint * order = hilbert_order (&t);
+  gdouble total = 0.;
+  for (i = 0; i < t.n; i++)
+    total += t.box[i].size;
+  hilbert_cut (&t, order, 0., total/t.np, best);
+  partition_stats (&t, best, s->surface, &leaves);
+  partition_cost (&t, best, s->surface, cost);
+  total = 0.;
+  for (i = 0; i < t.np; i++)
+    total += cost[i];
+  hilbert_cut (&t, order, s->surface, total/t.np, part);
+  partition_stats (&t, part, s->surface, &next);
+  if (leaves.imbalance < next.imbalance) {
+    guint * tmp = part; part = best; best = tmp;
+    next = leaves;
+  }
+  g_free (order);
+  g_free (cost);
+  g_free (best);
+
+  int modified = FALSE;
+  if (next.imbalance < old.imbalance) {
+    /* Send boxes */
+    GPtrArray * request = g_ptr_array_new ();
+    GSList ** l = g_malloc0 (t.np*sizeof (GSList *));
+    gpointer data[2] = { part, l };
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_destination, data);
+    for (i = 0; i < t.np; i++)
+      if (l[i])
+	modified = TRUE;
+    for (i = 0; i < t.np; i++)
+      if (l[i]) {
+	g_ptr_array_add (request, gfs_send_boxes (domain, l[i], i));
+	g_slist_free (l[i]);
+      }
+    g_free (l);
+    /* Receive boxes */
+    gboolean * src = g_malloc0 (t.np*sizeof (gboolean));
+    for (i = 0; i < t.n; i++)
+      if (part[i] == domain->pid && t.box[i].pid != domain->pid)
+	src[(guint) t.box[i].pid] = TRUE;
+    for (i = 0; i < t.np; i++)
+      if (src[i])
+	g_slist_free (gfs_receive_boxes (domain, i));
+    g_free (src);
+    /* Synchronize */
+    for (i = 0; i < request->len; i++)
+      gfs_wait (g_ptr_array_index (request, i));
+    g_ptr_array_free (request, TRUE);
+  }
+  g_free (part);
+  g_free (t.box);
+  return modified;
+}
+
 #endif /* HAVE_MPI */
 
 static void gfs_event_balance_write (GtsObject * o, FILE * fp)
@@ -207,6 +614,20 @@ static void gfs_event_balance_write (GtsObject * o, FILE * fp)
       (o, fp);
 
   fprintf (fp, " %g", s->max);
+  if (!s->raw || s->global || s->surface != 1. || s->split || s->verbose) {
+    fputs (" {", fp);
+    if (!s->raw)
+      fputs (" raw = 0", fp);
+    if (s->global)
+      fputs (" global = 1", fp);
+    if (s->surface != 1.)
+      fprintf (fp, " surface = %g", s->surface);
+    if (s->split)
+      fprintf (fp, " split = %u", s->split);
+    if (s->verbose)
+      fputs (" verbose = 1", fp);
+    fputs (" }", fp);
+  }
 }
 
 static void gfs_event_balance_read (GtsObject ** o, GtsFile * fp)
@@ -221,6 +642,26 @@ static void gfs_event_balance_read (GtsObject ** o, GtsFile * fp)
     return;
   
   s->max = gfs_read_constant (fp, domain);
+  if (fp->type == GTS_ERROR)
+    return;
+
+  if (fp->type == '{') {
+    GtsFileVariable var[] = {
+      {GTS_INT,    "raw",     TRUE, &s->raw},
+      {GTS_INT,    "global",  TRUE, &s->global},
+      {GTS_DOUBLE, "surface", TRUE, &s->surface},
+      {GTS_UINT,   "split",   TRUE, &s->split},
+      {GTS_INT,    "verbose", TRUE, &s->verbose},
+      {GTS_NONE}
+    };
+    gts_file_assign_variables (fp, var);
+    if (fp->type == GTS_ERROR)
+      return;
+    if (s->surface < 0.) {
+      gts_file_variable_error (fp, var, "surface", "surface must be positive");
+      return;
+    }
+  }
 }
 
 static gboolean gfs_event_balance_event (GfsEvent * event, GfsSimulation * sim)
@@ -234,49 +675,39 @@ static gboolean gfs_event_balance_event (GfsEvent * event, GfsSimulation * sim)
     gfs_domain_stats_balance (domain, &size, &boundary, &mpiwait);
     if (size.max/size.min > 1. + s->max) {
 #ifdef HAVE_MPI
-      BalancingFlow * balance = balancing_flow_new (domain, size.mean);
-      GPtrArray * request = g_ptr_array_new ();
-      int modified = FALSE;
-      int i;
-      /* Send boxes */
-      gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) reset_box_size, NULL);
-      guint nb = gts_container_size (GTS_CONTAINER (domain));
-      for (i = 0; i < balance->n; i++)
-	if (balance->flow[i] > 0.) { /* largest subdomain */
-	  /* we need to find the list of boxes which minimizes 
-	     |\sum n_i - n| where n_i is the size of box i. This is known in
-	     combinatorial optimisation as a "knapsack problem". */
-	  GSList * l = NULL;
-	  BoxData b;
-	  b.flow = balance->flow[i];
-	  b.dest = balance->pid[i];
-	  while (b.flow > 0 && nb > 1) {
-	    b.box = NULL; b.neighboring = 0;
-	    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) select_neighbouring_box, &b);
-	    if (b.box && b.box->size <= 2*b.flow) {
-	      l = g_slist_prepend (l, b.box);
-	      b.box->pid = b.dest;
-	      b.flow -= b.box->size;
-	      nb--;
-	      modified = TRUE;
-	    }
-	    else
-	      b.flow = 0;
-	  }
-	  g_ptr_array_add (request, gfs_send_boxes (domain, l, balance->pid[i]));
-	  g_slist_free (l);
-	}
-      /* Receive boxes */
-      for (i = 0; i < balance->n; i++)
-	if (balance->flow[i] < 0.) { /* smallest subdomain */
-	  GSList * l = gfs_receive_boxes (domain, balance->pid[i]);
-	  g_slist_free (l);
+      BalanceStats before, after;
+      if (s->verbose)
+	balance_stats (domain, s, &before);
+      /* Boxes may change PE: use MPI until the boundaries are matched again */
+      gfs_boundary_mpi_shared_invalidate (domain);
+      /* Split all the boxes (all the boxes must have the same size)
+	 only if none of the boxes of the most loaded PE can be moved
+	 to reduce the imbalance */
+      gboolean split = FALSE;
+      if (s->nsplit < s->split) {
+	guint sizes[2] = { 0, G_MAXUINT };
+	gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_sizes, sizes);
+	guint minsize = sizes[0] >= size.max ? sizes[1] : G_MAXUINT;
+	gfs_all_reduce (domain, minsize, MPI_UNSIGNED, MPI_MIN);
+	if (minsize >= size.max - size.min) {
+	  gfs_domain_split (domain, FALSE);
+	  s->nsplit++;
+	  split = TRUE;
+	  if (s->verbose && domain->pid == 0)
+	    fprintf (stderr, "EventBalance: t: %g smallest box of the most loaded PE: "
+		     "%u cells, splitting (rootlevel: %u)\n",
+		     sim->time.t, minsize, domain->rootlevel);
 	}
-      /* Synchronize */
-      for (i = 0; i < request->len; i++)
-	gfs_wait (g_ptr_array_index (request, i));
-      g_ptr_array_free (request, TRUE);
-      balancing_flow_destroy (balance);
+      }
+      /* raw state vectors can only be exchanged if all the PEs have the same layout */
+      guint vmax = gfs_domain_variables_size (domain), vmin = vmax;
+      gfs_all_reduce (domain, vmax, MPI_UNSIGNED, MPI_MAX);
+      gfs_all_reduce (domain, vmin, MPI_UNSIGNED, MPI_MIN);
+      domain->raw = s->raw && vmin == vmax;
+      int modified = s->global ? balance_global (domain, s) : balance_diffusion (domain, size.mean);
+      domain->raw = FALSE;
+      if (split)
+	modified = TRUE;
       /* Reshape */
       gfs_all_reduce (domain, modified, MPI_INT, MPI_MAX);
       if (modified) {
@@ -300,11 +731,13 @@ static gboolean gfs_event_balance_event (GfsEvent * event, GfsSimulation * sim)
 	g_array_free (pid, TRUE);
 	gfs_domain_reshape (domain, gfs_domain_depth (domain));
 	/* applies BCs again in case a BC on one variable depends on another variable */
-	GSList * i = domain->variables;
-	while (i) {
-	  gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, i->data);
-	  i = i->next;
-	}
+	gfs_domain_bc_multi (domain, FTT_TRAVERSE_LEAFS, -1, domain->variables);
+      }
+      if (s->verbose) {
+	balance_stats (domain, s, &after);
+	if (domain->pid == 0)
+	  fprintf (stderr, "EventBalance: t: %g imbalance: %g -> %g edge-cut: %g -> %g\n",
+		   sim->time.t, before.imbalance, after.imbalance, before.cut, after.cut);
       }
 #else /* not HAVE_MPI */
       g_assert_not_reached ();
@@ -322,6 +755,12 @@ static void gfs_event_balance_class_init (GfsEventClass * klass)
   GFS_EVENT_CLASS (klass)->event = gfs_event_balance_event;
 }
 
+static void gfs_event_balance_init (GfsEventBalance * s)
+{
+  s->raw = TRUE;
+  s->surface = 1.;
+}
+
 GfsEventClass * gfs_event_balance_class (void)
 {
   static GfsEventClass * klass = NULL;
@@ -332,7 +771,7 @@ GfsEventClass * gfs_event_balance_class (void)
       sizeof (GfsEventBalance),
       sizeof (GfsEventClass),
       (GtsObjectClassInitFunc) gfs_event_balance_class_init,
-      (GtsObjectInitFunc) NULL,
+      (GtsObjectInitFunc) gfs_event_balance_init,
       (GtsArgSetFunc) NULL,
       (GtsArgGetFunc) NULL
     };
@@ -34,6 +34,9 @@ struct _GfsEventBalance {
   GfsEvent parent;
 
   gdouble max;
+  gboolean raw, global, verbose;
+  gdouble surface;
+  guint split, nsplit;
 };
 
 #define GFS_EVENT_BALANCE(obj)            GTS_OBJECT_CAST (obj,\
@@ -1323,10 +1323,9 @@ static void send (GfsBoundary * bb)
   g_assert (GFS_IS_BOUNDARY_PERIODIC (matching));
   g_assert (boundary->sndcount <= boundary->sndbuf->len);
   
-  if (GFS_BOUNDARY (boundary)->type == GFS_BOUNDARY_MATCH_VARIABLE) {
-    if (boundary->sndcount > matching->rcvbuf->len)
-      g_array_set_size (matching->rcvbuf, boundary->sndcount);
-  }
+  /* several variables may have been packed (see gfs_domain_bc_multi()) */
+  if (boundary->sndcount > matching->rcvbuf->len)
+    g_array_set_size (matching->rcvbuf, boundary->sndcount);
   memcpy (matching->rcvbuf->data, boundary->sndbuf->data, boundary->sndcount*sizeof (gdouble));
 }
 
@@ -1435,9 +1434,7 @@ static void receive (GfsBoundary * bb,
     break;
 
   default:
-    ftt_cell_traverse (GFS_BOUNDARY (boundary)->root,
-		       FTT_PRE_ORDER, flags, max_depth,
-		       (FttCellTraverseFunc) center_update, boundary);
+    gfs_boundary_periodic_unpack (boundary, flags, max_depth);
   }
 }
 
@@ -1507,6 +1504,28 @@ GfsBoundaryClass * gfs_boundary_periodic_class (void)
   return klass;
 }
 
+/**
+ * gfs_boundary_periodic_unpack:
+ * @boundary: a #GfsBoundaryPeriodic.
+ * @flags: the traversal flags.
+ * @max_depth: the maximum depth of the traversal.
+ *
+ * Sets the values of the ghost cells of @boundary for variable
+ * @boundary->v, using the values of the receive buffer following
+ * those already unpacked. This is used to unpack several variables
+ * received in the same message.
+ */
+void gfs_boundary_periodic_unpack (GfsBoundaryPeriodic * boundary,
+				   FttTraverseFlags flags,
+				   gint max_depth)
+{
+  g_return_if_fail (boundary != NULL);
+
+  ftt_cell_traverse (GFS_BOUNDARY (boundary)->root,
+		     FTT_PRE_ORDER, flags, max_depth,
+		     (FttCellTraverseFunc) center_update, boundary);
+}
+
 /**
  * gfs_boundary_periodic_new:
  * @klass: a #GfsBoundaryClass.
@@ -1824,11 +1843,20 @@ static void gfs_box_write (GtsObject * object, FILE * fp)
   guint size = 0;
   GfsDomain * domain = gfs_box_domain (box);
 
-  ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-		     (FttCellTraverseFunc) box_size, &size);
+  if (box->offset >= 0 && box->size >= 0)
+    size = box->size;
+  else
+    ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+		       (FttCellTraverseFunc) box_size, &size);
   ftt_cell_pos (box->root, &pos);
   fprintf (fp, "%s { id = %u pid = %d size = %u x = %g y = %g z = %g",
 	   object->klass->info.name, box->id, box->pid, size, pos.x, pos.y, pos.z);
+  if (box->offset >= 0)
+    /* the cell data is in the indexed data file */
+    fprintf (fp, " offset = %" G_GINT64_FORMAT " length = %u", box->offset, box->length);
+  if (domain != NULL && domain->max_depth_write > -2 && box->offset < 0 && domain->raw)
+    /* the size of the raw state vectors, checked when reading */
+    fprintf (fp, " raw = %u", (guint) gfs_domain_variables_size (domain));
   for (d = 0; d < FTT_NEIGHBORS; d++)
     if (GFS_IS_BOUNDARY (box->neighbor[d])) {
       fprintf (fp, " %s = %s",
@@ -1838,9 +1866,12 @@ static void gfs_box_write (GtsObject * object, FILE * fp)
 	(* box->neighbor[d]->klass->write) (box->neighbor[d], fp);
     }
   fputs (" }", fp);
-  if (domain != NULL && domain->max_depth_write > -2) {
+  if (domain != NULL && domain->max_depth_write > -2 && box->offset < 0) {
     fputs (" {\n", fp);
-    if (domain->binary)
+    if (domain->raw)
+      ftt_cell_write_binary (box->root, domain->max_depth_write, fp, 
+			     (FttCellWriteFunc) gfs_cell_write_raw, domain);
+    else if (domain->binary)
       ftt_cell_write_binary (box->root, domain->max_depth_write, fp, 
 			     (FttCellWriteFunc) gfs_cell_write_binary, domain->variables_io);
     else
@@ -1856,6 +1887,8 @@ static void gfs_box_read (GtsObject ** o, GtsFile * fp)
   GtsObjectClass * klass;
   gboolean class_changed = FALSE;
   FttVector pos = {0., 0., 0.};
+  gdouble offset = -1.;
+  guint raw = 0;
   GtsFileVariable var[] = {
     {GTS_UINT,   "id",     TRUE, &b->id},
     {GTS_INT,    "pid",    TRUE, &b->pid},
@@ -1863,6 +1896,9 @@ static void gfs_box_read (GtsObject ** o, GtsFile * fp)
     {GTS_DOUBLE, "x",      TRUE, &pos.x},
     {GTS_DOUBLE, "y",      TRUE, &pos.y},
     {GTS_DOUBLE, "z",      TRUE, &pos.z},
+    {GTS_DOUBLE, "offset", TRUE, &offset},
+    {GTS_UINT,   "length", TRUE, &b->length},
+    {GTS_UINT,   "raw",    TRUE, &raw},
     {GTS_FILE,   "right",  TRUE},
     {GTS_FILE,   "left",   TRUE},
     {GTS_FILE,   "top",    TRUE},
@@ -1934,17 +1970,31 @@ static void gfs_box_read (GtsObject ** o, GtsFile * fp)
       if (boundary_class->read)
 	(* boundary_class->read) (&boundary, fp);
     }
+  if (var[6].set)
+    /* the cell data will be read from the indexed data file (see domain_post_read()) */
+    b->offset = offset;
   
   if (fp->type == '{') {
     FttCell * root;
 
+    if (var[8].set && !domain->raw) {
+      gts_file_error (fp, "unexpected raw state vectors");
+      return;
+    }
+    if (domain->raw && (!var[8].set || raw != gfs_domain_variables_size (domain))) {
+      gts_file_error (fp, "raw state vectors of %u bytes but %u bytes expected",
+		      raw, (guint) gfs_domain_variables_size (domain));
+      return;
+    }
     fp->scope_max++;
-    if (domain->binary) {
+    if (domain->binary || domain->raw) {
       if (gts_file_getc (fp) != '\n') {
       	gts_file_error (fp, "expecting a newline");
       	return;
       }
-      root = ftt_cell_read_binary (fp, (FttCellReadFunc) gfs_cell_read_binary, domain);
+      root = ftt_cell_read_binary (fp, domain->raw ? 
+				   (FttCellReadFunc) gfs_cell_read_raw :
+				   (FttCellReadFunc) gfs_cell_read_binary, domain);
       if (fp->type == GTS_ERROR)
 	return;
       gts_file_next_token (fp);
@@ -2045,6 +2095,8 @@ static void gfs_box_init (GfsBox * box)
   box->id = id++;
   box->pid = -1;
   box->size = -1;
+  box->offset = -1;
+  box->length = 0;
 }
 
 GfsBoxClass * gfs_box_class (void)
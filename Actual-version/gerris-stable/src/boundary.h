@@ -285,6 +285,9 @@ GfsBoundaryPeriodic * gfs_boundary_periodic_rotate_new (GfsBoundaryClass * klass
 							GfsBox * matching,
 							FttDirection rotate,
 							gdouble orientation);
+void                  gfs_boundary_periodic_unpack   (GfsBoundaryPeriodic * boundary,
+						      FttTraverseFlags flags,
+						      gint max_depth);
 
 /* GfsGEdge: Header */
   
@@ -324,6 +327,8 @@ struct _GfsBox {
   guint id;
   int pid;
   gint size;
+  gint64 offset; /* of the cell data in the indexed data file or -1 */
+  guint length;  /* of the cell data in the indexed data file */
 };
 
 struct _GfsBoxClass {
@@ -35,9 +35,18 @@
 #include "metric.h"
 #include "version.h"
 #include "init.h"
+#include "indexed.h"
 
 #include "config.h"
 
+#ifdef _OPENMP
+# include <omp.h>
+/* statistics are not updated by concurrent threads */
+# define COUNT(n) do { if (!omp_in_parallel ()) (n)++; } while (0)
+#else
+# define COUNT(n) ((n)++)
+#endif
+
 /* GfsLocateArray: Object */
 
 static void locate_index (FttVector * p, GfsLocateArray * a, gint i[FTT_DIMENSION])
@@ -160,6 +169,815 @@ void gfs_locate_array_destroy (GfsLocateArray * a)
   }
 }
 
+/* GfsStatePool: Object */
+
+#define POOL_MIN_SLAB 256
+#define POOL_MAX_SLAB 65536
+
+typedef struct {
+  gchar * start, * end;
+} PoolSlab;
+
+static void pool_add_slab (GfsStatePool * pool, guint n)
+{
+  PoolSlab * slab = g_malloc (sizeof (PoolSlab));
+  slab->start = g_malloc (n*pool->size);
+  slab->end = slab->start + n*pool->size;
+  pool->slabs = g_slist_prepend (pool->slabs, slab);
+  pool->top = slab->start;
+  pool->end = slab->end;
+  pool->nblocks += n;
+  pool->nslabs++;
+}
+
+static void pool_free_slabs (GSList * slabs)
+{
+  GSList * i = slabs;
+  while (i) {
+    PoolSlab * slab = i->data;
+    g_free (slab->start);
+    g_free (slab);
+    i = i->next;
+  }
+  g_slist_free (slabs);
+}
+
+static gpointer pool_block (GfsStatePool * pool)
+{
+  gpointer block;
+  if (pool->free) {
+    block = pool->free;
+    pool->free = *((gpointer *) block);
+  }
+  else {
+    if (pool->top == pool->end) {
+      pool_add_slab (pool, pool->next);
+      pool->next = MIN (2*pool->next, POOL_MAX_SLAB);
+    }
+    block = pool->top;
+    pool->top += pool->size;
+  }
+  pool->used++;
+  return block;
+}
+
+/**
+ * gfs_state_pool_new:
+ * @size: the size in bytes of each block.
+ *
+ * Creates a slab allocator for blocks of @size bytes. Blocks are
+ * carved from large slabs and recycled through a free list, which
+ * keeps the state vectors of neighbouring cells close in memory and
+ * avoids calling malloc() for each new cell.
+ *
+ * Returns: a new #GfsStatePool.
+ */
+GfsStatePool * gfs_state_pool_new (gsize size)
+{
+  g_return_val_if_fail (size >= sizeof (gpointer), NULL);
+
+  GfsStatePool * pool = g_malloc0 (sizeof (GfsStatePool));
+  pool->size = size;
+  pool->next = POOL_MIN_SLAB;
+  return pool;
+}
+
+/**
+ * gfs_state_pool_alloc:
+ * @pool: a #GfsStatePool.
+ *
+ * Returns: a new zero-initialised block of @pool.
+ */
+gpointer gfs_state_pool_alloc (GfsStatePool * pool)
+{
+  g_return_val_if_fail (pool != NULL, NULL);
+
+  gpointer block = pool_block (pool);
+  memset (block, 0, pool->size);
+  pool->allocs++;
+  return block;
+}
+
+static gboolean pool_is_retired (GfsStatePool * pool, gpointer block)
+{
+  GSList * i = pool->retired;
+  while (i) {
+    PoolSlab * slab = i->data;
+    if ((gchar *) block >= slab->start && (gchar *) block < slab->end)
+      return TRUE;
+    i = i->next;
+  }
+  return FALSE;
+}
+
+/**
+ * gfs_state_pool_free:
+ * @pool: a #GfsStatePool.
+ * @block: a block allocated using gfs_state_pool_alloc() or %NULL.
+ *
+ * Returns @block to the free list of @pool.
+ */
+void gfs_state_pool_free (GfsStatePool * pool, gpointer block)
+{
+  g_return_if_fail (pool != NULL);
+
+  if (block == NULL)
+    return;
+  if (pool->retired && pool_is_retired (pool, block)) {
+    g_assert (pool->retired_used > 0);
+    if (--pool->retired_used == 0)
+      gfs_state_pool_release (pool);
+  }
+  else {
+    g_assert (pool->used > 0);
+    *((gpointer *) block) = pool->free;
+    pool->free = block;
+    pool->used--;
+  }
+  pool->frees++;
+}
+
+/**
+ * gfs_state_pool_resize:
+ * @pool: a #GfsStatePool.
+ * @size: the new size of the blocks (larger than the current size).
+ *
+ * Starts changing the size of the blocks of @pool. A single slab is
+ * allocated for all the blocks currently in use. Each of these blocks
+ * must then be moved to this new slab using
+ * gfs_state_pool_realloc(), after which gfs_state_pool_release()
+ * frees the old slabs in one go.
+ */
+void gfs_state_pool_resize (GfsStatePool * pool, gsize size)
+{
+  g_return_if_fail (pool != NULL);
+  g_return_if_fail (size >= pool->size);
+  g_return_if_fail (pool->retired == NULL);
+
+  pool->retired = pool->slabs;
+  pool->retired_size = pool->size;
+  pool->retired_used = pool->used;
+  pool->slabs = NULL;
+  pool->top = pool->end = NULL;
+  pool->free = NULL;
+  pool->size = size;
+  pool->nblocks = pool->used = pool->nslabs = 0;
+  if (pool->retired_used > 0)
+    pool_add_slab (pool, pool->retired_used);
+  pool->resizes++;
+}
+
+/**
+ * gfs_state_pool_realloc:
+ * @pool: a #GfsStatePool being resized.
+ * @block: a block of @pool allocated before gfs_state_pool_resize().
+ *
+ * Moves the content of @block into a block of the new size. The
+ * remaining bytes are set to zero.
+ *
+ * Returns: the new block.
+ */
+gpointer gfs_state_pool_realloc (GfsStatePool * pool, gpointer block)
+{
+  g_return_val_if_fail (pool != NULL, NULL);
+  g_return_val_if_fail (block != NULL, NULL);
+  g_return_val_if_fail (pool->retired_used > 0, NULL);
+
+  gpointer new = pool_block (pool);
+  memcpy (new, block, pool->retired_size);
+  memset ((gchar *) new + pool->retired_size, 0, pool->size - pool->retired_size);
+  pool->retired_used--;
+  return new;
+}
+
+/**
+ * gfs_state_pool_release:
+ * @pool: a #GfsStatePool.
+ *
+ * Frees the slabs left over by gfs_state_pool_resize(), provided all
+ * their blocks have been moved using gfs_state_pool_realloc() or
+ * freed. Otherwise the slabs are kept until their last block is freed.
+ */
+void gfs_state_pool_release (GfsStatePool * pool)
+{
+  g_return_if_fail (pool != NULL);
+
+  if (pool->retired_used == 0) {
+    pool_free_slabs (pool->retired);
+    pool->retired = NULL;
+  }
+}
+
+/**
+ * gfs_state_pool_fragmentation:
+ * @pool: a #GfsStatePool.
+ *
+ * Returns: the fraction of the blocks allocated by @pool which are
+ * on the free list i.e. neither in use nor part of the unused tail of
+ * the current slab.
+ */
+gdouble gfs_state_pool_fragmentation (GfsStatePool * pool)
+{
+  g_return_val_if_fail (pool != NULL, 0.);
+
+  guint unused = (pool->end - pool->top)/pool->size;
+  return pool->nblocks > 0 ? (pool->nblocks - pool->used - unused)/(gdouble) pool->nblocks : 0.;
+}
+
+/**
+ * gfs_state_pool_destroy:
+ * @pool: a #GfsStatePool.
+ *
+ * Frees all the memory allocated for @pool, including all its blocks.
+ */
+void gfs_state_pool_destroy (GfsStatePool * pool)
+{
+  if (pool) {
+    pool_free_slabs (pool->slabs);
+    pool_free_slabs (pool->retired);
+    g_free (pool);
+  }
+}
+
+/* GfsLeafIndex: Object */
+
+/**
+ * gfs_leaf_index_new:
+ * @domain: a #GfsDomain.
+ *
+ * Creates a compact index of the leaf cells of @domain. Each leaf is
+ * given an id between zero and the number of leaves, which is stored
+ * in a temporary variable of @domain and is used to address
+ * contiguous (structure-of-arrays) copies of the variables.
+ *
+ * The state vectors of the cells remain the reference storage:
+ * arrays are filled using gfs_leaf_index_gather() and copied back
+ * using gfs_leaf_index_scatter(), so that GFS_VALUE() can be used as
+ * usual.
+ *
+ * Returns: a new #GfsLeafIndex.
+ */
+GfsLeafIndex * gfs_leaf_index_new (GfsDomain * domain)
+{
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  GfsLeafIndex * index = g_malloc0 (sizeof (GfsLeafIndex));
+  index->domain = domain;
+  index->id = gfs_temporary_variable (domain);
+  index->arrays = g_ptr_array_new ();
+  index->dirty = TRUE;
+  return index;
+}
+
+static gboolean leaf_index_lookup (GfsLeafIndex * index, const FttCell * cell, guint * id)
+{
+  gdouble v = GFS_VALUE (cell, index->id);
+  if (v >= 0. && v < index->n) {
+    *id = v;
+    return index->cells[*id] == cell;
+  }
+  return FALSE;
+}
+
+static void leaf_index_resize (GfsLeafIndex * index, guint n)
+{
+  if (n > index->size) {
+    guint i;
+
+    index->size = MAX (n, 2*index->size);
+    index->cells = g_renew (FttCell *, index->cells, index->size);
+    index->neighbor = g_renew (gint, index->neighbor, FTT_NEIGHBORS*index->size);
+    index->neighbors = g_renew (FttCell *, index->neighbors, FTT_NEIGHBORS*index->size);
+    index->type = g_renew (guchar, index->type, FTT_NEIGHBORS*index->size);
+    index->weight = g_renew (gdouble, index->weight, FTT_NEIGHBORS*index->size);
+    index->regular = g_renew (gboolean, index->regular, index->size);
+    index->colour = g_renew (guchar, index->colour, index->size);
+    for (i = 0; i < index->arrays->len; i++)
+      if (g_ptr_array_index (index->arrays, i))
+	g_ptr_array_index (index->arrays, i) = 
+	  g_renew (gdouble, g_ptr_array_index (index->arrays, i), index->size);
+  }
+}
+
+static void leaf_index_add (FttCell * cell, gpointer * data)
+{
+  GfsLeafIndex * index = data[0];
+  guint id;
+
+  if (leaf_index_lookup (index, cell, &id))
+    index->kept++;
+  else
+    g_array_append_val (data[1], cell);
+}
+
+static void leaf_index_set (GfsLeafIndex * index, guint i, FttCell * cell)
+{
+  index->cells[i] = cell;
+  GFS_VALUE (cell, index->id) = i;
+}
+
+static void leaf_index_neighbors (GfsLeafIndex * index)
+{
+  guint i;
+
+  index->nregular = 0;
+  for (i = 0; i < index->n; i++) {
+    FttCell * cell = index->cells[i];
+    gint * nb = &index->neighbor[FTT_NEIGHBORS*i];
+    FttCell ** neighbors = &index->neighbors[FTT_NEIGHBORS*i];
+    guchar * type = &index->type[FTT_NEIGHBORS*i];
+    guint level = ftt_cell_level (cell);
+    FttCellNeighbors n;
+    FttDirection d;
+
+    ftt_cell_neighbors (cell, &n);
+    index->regular[i] = TRUE;
+    for (d = 0; d < FTT_NEIGHBORS; d++) {
+      guint id;
+      nb[d] = -1;
+      neighbors[d] = n.c[d];
+      type[d] = !n.c[d] ? FTT_BOUNDARY :
+	ftt_cell_level (n.c[d]) < level ? FTT_FINE_COARSE : FTT_FINE_FINE;
+      if (n.c[d]) {
+	if (FTT_CELL_IS_LEAF (n.c[d]) && ftt_cell_level (n.c[d]) == level &&
+	    leaf_index_lookup (index, n.c[d], &id))
+	  nb[d] = id;
+	else
+	  index->regular[i] = FALSE;
+      }
+    }
+    if (index->regular[i])
+      index->nregular++;
+    index->colour[i] = gfs_cell_colour (cell);
+  }
+}
+
+/**
+ * gfs_leaf_index_update:
+ * @index: a #GfsLeafIndex.
+ *
+ * Updates @index after the leaf cells of its domain have changed
+ * (refinement, coarsening, box migration etc...). Leaves which
+ * already had an id keep it, new leaves fill the holes left by
+ * cells which have been refined or destroyed and the ids are then
+ * compacted.
+ *
+ * The table of neighbors is rebuilt. It stores the neighbors of
+ * each leaf (and the type of the corresponding faces) so that they
+ * do not need to be looked up in the cell tree until the next
+ * change of topology (see gfs_leaf_index_neighbors()). A leaf is
+ * "regular" if all its neighbors are leaves of the same level also
+ * in @index, in which case the neighbor values can be read from the
+ * arrays of @index. The red-black colour of each leaf is also
+ * stored (see gfs_cell_colour()).
+ */
+void gfs_leaf_index_update (GfsLeafIndex * index)
+{
+  g_return_if_fail (index != NULL);
+
+  GfsDomain * domain = index->domain;
+  guint i, j;
+
+  gfs_domain_timer_start (domain, "leaf_index_update");
+
+  /* forget cells which have been refined or whose id has been overwritten */
+  for (i = 0; i < index->n; i++) {
+    FttCell * cell = index->cells[i];
+    if (cell && (!FTT_CELL_IS_LEAF (cell) || GFS_VALUE (cell, index->id) != i))
+      index->cells[i] = NULL;
+  }
+
+  /* collect the new leaves */
+  GArray * added = g_array_new (FALSE, FALSE, sizeof (FttCell *));
+  gpointer data[2];
+  data[0] = index;
+  data[1] = added;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttCellTraverseFunc) leaf_index_add, data);
+  index->added += added->len;
+
+  /* new leaves fill the holes first */
+  FttCell ** new = (FttCell **) added->data;
+  for (i = j = 0; i < index->n && j < added->len; i++)
+    if (index->cells[i] == NULL)
+      leaf_index_set (index, i, new[j++]);
+  if (j < added->len) {
+    leaf_index_resize (index, index->n + added->len - j);
+    while (j < added->len)
+      leaf_index_set (index, index->n++, new[j++]);
+  }
+  else {
+    /* compact the remaining holes using the last leaves */
+    while (index->n > 0 && index->cells[index->n - 1] == NULL)
+      index->n--;
+    for (; i < index->n; i++)
+      if (index->cells[i] == NULL) {
+	leaf_index_set (index, i, index->cells[--index->n]);
+	while (index->n > 0 && index->cells[index->n - 1] == NULL)
+	  index->n--;
+      }
+  }
+  g_array_free (added, TRUE);
+
+  leaf_index_neighbors (index);
+  index->dirty = FALSE;
+  index->updates++;
+
+  gfs_domain_timer_stop (domain, "leaf_index_update");
+}
+
+/**
+ * gfs_leaf_index_remove:
+ * @index: a #GfsLeafIndex.
+ * @cell: a #FttCell about to be destroyed.
+ *
+ * Removes @cell from @index (if it is indexed) and marks @index as
+ * needing an update.
+ */
+void gfs_leaf_index_remove (GfsLeafIndex * index, FttCell * cell)
+{
+  guint id;
+
+  g_return_if_fail (index != NULL);
+  g_return_if_fail (cell != NULL);
+
+  if (cell->data && leaf_index_lookup (index, cell, &id))
+    index->cells[id] = NULL;
+  index->dirty = TRUE;
+}
+
+static gdouble * leaf_index_array (GfsLeafIndex * index, GfsVariable * v)
+{
+  if (v->i >= index->arrays->len)
+    g_ptr_array_set_size (index->arrays, v->i + 1);
+  if (g_ptr_array_index (index->arrays, v->i) == NULL)
+    g_ptr_array_index (index->arrays, v->i) = g_malloc (sizeof (gdouble)*MAX (index->size, 1));
+  return g_ptr_array_index (index->arrays, v->i);
+}
+
+/**
+ * gfs_leaf_index_gather:
+ * @index: an up-to-date #GfsLeafIndex.
+ * @v: a #GfsVariable.
+ *
+ * Copies the values of @v on the leaf cells into the array
+ * associated with @v, which can also be accessed using
+ * GFS_LEAF_ARRAY().
+ *
+ * Returns: the array of values of @v, indexed by leaf id.
+ */
+gdouble * gfs_leaf_index_gather (GfsLeafIndex * index, GfsVariable * v)
+{
+  g_return_val_if_fail (index != NULL, NULL);
+  g_return_val_if_fail (!index->dirty, NULL);
+  g_return_val_if_fail (v != NULL, NULL);
+
+  gdouble * a = leaf_index_array (index, v);
+  FttCell ** cell = index->cells;
+  guint i;
+  for (i = 0; i < index->n; i++)
+    a[i] = GFS_VALUE (cell[i], v);
+  return a;
+}
+
+/**
+ * gfs_leaf_index_scatter:
+ * @index: an up-to-date #GfsLeafIndex.
+ * @v: a #GfsVariable previously gathered using gfs_leaf_index_gather().
+ *
+ * Copies the array associated with @v back into the state vectors
+ * of the leaf cells.
+ */
+void gfs_leaf_index_scatter (GfsLeafIndex * index, GfsVariable * v)
+{
+  g_return_if_fail (index != NULL);
+  g_return_if_fail (!index->dirty);
+  g_return_if_fail (v != NULL);
+  g_return_if_fail (v->i < index->arrays->len && GFS_LEAF_ARRAY (index, v) != NULL);
+
+  gdouble * a = GFS_LEAF_ARRAY (index, v);
+  FttCell ** cell = index->cells;
+  guint i;
+  for (i = 0; i < index->n; i++)
+    GFS_VALUE (cell[i], v) = a[i];
+}
+
+/**
+ * gfs_leaf_index_gather_weights:
+ * @index: an up-to-date #GfsLeafIndex.
+ *
+ * Copies the face weights (the @v field of the face state vectors)
+ * of the leaf cells into the @weight array of @index.
+ *
+ * Returns: the @weight array of @index.
+ */
+gdouble * gfs_leaf_index_gather_weights (GfsLeafIndex * index)
+{
+  g_return_val_if_fail (index != NULL, NULL);
+  g_return_val_if_fail (!index->dirty, NULL);
+
+  guint i;
+  for (i = 0; i < index->n; i++) {
+    GfsFaceStateVector * f = GFS_STATE (index->cells[i])->f;
+    gdouble * w = &index->weight[FTT_NEIGHBORS*i];
+    FttDirection d;
+    for (d = 0; d < FTT_NEIGHBORS; d++)
+      w[d] = f[d].v;
+  }
+  return index->weight;
+}
+
+/**
+ * gfs_leaf_index_neighbors:
+ * @index: a #GfsLeafIndex or %NULL.
+ * @cell: a #FttCell.
+ * @neighbors: a #FttCellNeighbors.
+ *
+ * Fills @neighbors with the neighbors of @cell. If @index is
+ * up-to-date and @cell is one of its leaves, the table of neighbors
+ * of @index is used, otherwise this is identical to
+ * ftt_cell_neighbors().
+ */
+void gfs_leaf_index_neighbors (GfsLeafIndex * index,
+			       const FttCell * cell,
+			       FttCellNeighbors * neighbors)
+{
+  guint id;
+
+  g_return_if_fail (cell != NULL);
+  g_return_if_fail (neighbors != NULL);
+
+  if (index && !index->dirty && FTT_CELL_IS_LEAF (cell) && 
+      leaf_index_lookup (index, cell, &id)) {
+    memcpy (neighbors->c, &index->neighbors[FTT_NEIGHBORS*id], sizeof (FttCell *)*FTT_NEIGHBORS);
+    COUNT (index->lookups);
+    return;
+  }
+  if (index && FTT_CELL_IS_LEAF (cell))
+    COUNT (index->misses);
+  ftt_cell_neighbors (cell, neighbors);
+}
+
+/**
+ * gfs_leaf_index_neighbor:
+ * @index: a #GfsLeafIndex or %NULL.
+ * @cell: a #FttCell.
+ * @d: a direction.
+ *
+ * Same as ftt_cell_neighbor() but uses the table of neighbors of
+ * @index when possible (see gfs_leaf_index_neighbors()).
+ *
+ * Returns: the neighbor of @cell in direction @d or %NULL.
+ */
+FttCell * gfs_leaf_index_neighbor (GfsLeafIndex * index,
+				   const FttCell * cell,
+				   FttDirection d)
+{
+  guint id;
+
+  g_return_val_if_fail (cell != NULL, NULL);
+  g_return_val_if_fail (d < FTT_NEIGHBORS, NULL);
+
+  if (index && !index->dirty && FTT_CELL_IS_LEAF (cell) && 
+      leaf_index_lookup (index, cell, &id)) {
+    COUNT (index->lookups);
+    return index->neighbors[FTT_NEIGHBORS*id + d];
+  }
+  if (index && FTT_CELL_IS_LEAF (cell))
+    COUNT (index->misses);
+  return ftt_cell_neighbor (cell, d);
+}
+
+/**
+ * gfs_leaf_index_destroy:
+ * @index: a #GfsLeafIndex.
+ *
+ * Frees all the memory allocated for @index.
+ */
+void gfs_leaf_index_destroy (GfsLeafIndex * index)
+{
+  if (index) {
+    guint i;
+    for (i = 0; i < index->arrays->len; i++)
+      g_free (g_ptr_array_index (index->arrays, i));
+    g_ptr_array_free (index->arrays, TRUE);
+    g_free (index->cells);
+    g_free (index->neighbor);
+    g_free (index->neighbors);
+    g_free (index->type);
+    g_free (index->weight);
+    g_free (index->regular);
+    g_free (index->colour);
+    gts_object_destroy (GTS_OBJECT (index->id));
+    g_free (index);
+  }
+}
+
+/* GfsCellCache: Object */
+
+/**
+ * gfs_cell_cache_new:
+ * @domain: a #GfsDomain.
+ *
+ * Creates arrays of the leaf cells and of the cells of each level of
+ * @domain. The boxes of @domain being sorted along a Morton
+ * space-filling curve, the pre-order traversal used to fill the
+ * arrays also gives a Morton ordering of the cells.
+ *
+ * The arrays are used by gfs_domain_cell_traverse() for leaf and
+ * level traversals until the next change of the cell tree.
+ *
+ * Returns: a new #GfsCellCache.
+ */
+GfsCellCache * gfs_cell_cache_new (GfsDomain * domain)
+{
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  GfsCellCache * cache = g_malloc0 (sizeof (GfsCellCache));
+  cache->domain = domain;
+  cache->destroyed = g_hash_table_new (NULL, NULL);
+  cache->leaves = g_ptr_array_new ();
+  cache->levels = g_ptr_array_new ();
+  cache->dirty = TRUE;
+  return cache;
+}
+
+static void cache_add (FttCell * cell, GfsCellCache * cache)
+{
+  guint level = ftt_cell_level (cell);
+
+  while (level >= cache->levels->len)
+    g_ptr_array_add (cache->levels, g_ptr_array_new ());
+  g_ptr_array_add (g_ptr_array_index (cache->levels, level), cell);
+  if (FTT_CELL_IS_LEAF (cell))
+    g_ptr_array_add (cache->leaves, cell);
+}
+
+/**
+ * gfs_cell_cache_update:
+ * @cache: a #GfsCellCache.
+ *
+ * Rebuilds the arrays of @cache.
+ */
+void gfs_cell_cache_update (GfsCellCache * cache)
+{
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (cache->traversing == 0);
+
+  guint l;
+  g_ptr_array_set_size (cache->leaves, 0);
+  for (l = 0; l < cache->levels->len; l++)
+    g_ptr_array_set_size (g_ptr_array_index (cache->levels, l), 0);
+  cache->dirty = TRUE;
+  gfs_domain_cell_traverse (cache->domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+			    (FttCellTraverseFunc) cache_add, cache);
+  cache->dirty = FALSE;
+  cache->builds++;
+}
+
+/**
+ * gfs_cell_cache_remove:
+ * @cache: a #GfsCellCache.
+ * @cell: a #FttCell about to be destroyed.
+ *
+ * Marks @cache as needing an update. If @cell is destroyed during a
+ * traversal using @cache, it will not be visited.
+ */
+void gfs_cell_cache_remove (GfsCellCache * cache, FttCell * cell)
+{
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (cell != NULL);
+
+  cache->dirty = TRUE;
+  if (cache->traversing > 0)
+    g_hash_table_insert (cache->destroyed, cell, cell);
+}
+
+typedef enum { CACHE_ALL, CACHE_LEAFS, CACHE_NON_LEAFS } CacheFilter;
+
+static void cache_traverse (GfsCellCache * cache, GPtrArray * a,
+			    CacheFilter filter, gint max_depth,
+			    FttCellTraverseFunc func, gpointer data,
+			    guint nthreads)
+{
+  FttCell ** cells = (FttCell **) a->pdata;
+  gint i, n = a->len;
+
+#ifdef _OPENMP
+  if (nthreads > 1) {
+    /* @func cannot modify the tree */
+#pragma omp parallel for num_threads (nthreads) schedule (static)
+    for (i = 0; i < n; i++) {
+      FttCell * cell = cells[i];
+      if ((filter == CACHE_LEAFS && !FTT_CELL_IS_LEAF (cell)) ||
+	  (filter == CACHE_NON_LEAFS && FTT_CELL_IS_LEAF (cell)) ||
+	  (max_depth >= 0 && ftt_cell_level (cell) > max_depth))
+	continue;
+      (* func) (cell, data);
+    }
+    return;
+  }
+#endif
+  for (i = 0; i < n; i++) {
+    FttCell * cell = cells[i];
+    /* the tree may have been modified by @func */
+    if (cache->dirty && g_hash_table_lookup (cache->destroyed, cell))
+      continue;
+    if ((filter == CACHE_LEAFS && !FTT_CELL_IS_LEAF (cell)) ||
+	(filter == CACHE_NON_LEAFS && FTT_CELL_IS_LEAF (cell)) ||
+	(max_depth >= 0 && ftt_cell_level (cell) > max_depth))
+      continue;
+    (* func) (cell, data);
+  }
+}
+
+/**
+ * gfs_cell_cache_traverse:
+ * @cache: a #GfsCellCache.
+ * @flags: which types of children are to be visited.
+ * @max_depth: the maximum depth of the traversal.
+ * @func: the function to call for each visited #FttCell.
+ * @data: user data to pass to @func.
+ *
+ * Traverses the cells of @cache as a flat loop. Only leaf
+ * (%FTT_TRAVERSE_LEAFS) and level (%FTT_TRAVERSE_LEVEL) traversals
+ * are supported. Cells created by @func are not visited.
+ *
+ * If %FTT_TRAVERSE_THREAD_SAFE is set in @flags, the loop is split
+ * between the threads of the domain of @cache (see
+ * gfs_domain_cell_traverse()).
+ *
+ * Returns: %FALSE if @cache needs an update or if @flags is not
+ * supported (in which case no cell is visited), %TRUE otherwise.
+ */
+gboolean gfs_cell_cache_traverse (GfsCellCache * cache,
+				  FttTraverseFlags flags,
+				  gint max_depth,
+				  FttCellTraverseFunc func,
+				  gpointer data)
+{
+  g_return_val_if_fail (cache != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  guint nthreads = 1;
+  if ((flags & FTT_TRAVERSE_THREAD_SAFE) != 0) {
+    nthreads = cache->domain->nthreads;
+    flags &= ~FTT_TRAVERSE_THREAD_SAFE;
+  }
+  if (cache->dirty || (flags & ~(FTT_TRAVERSE_ALL | FTT_TRAVERSE_LEVEL)) != 0)
+    return FALSE;
+
+  GPtrArray * levels = cache->levels;
+  if ((flags & FTT_TRAVERSE_LEVEL) != 0) {
+    if (max_depth < 0)
+      return FALSE;
+    cache->traversing++;
+    if ((flags & FTT_TRAVERSE_LEAFS) != 0) {
+      guint l;
+      for (l = 0; l < MIN (max_depth, levels->len); l++)
+	cache_traverse (cache, g_ptr_array_index (levels, l), CACHE_LEAFS, -1, func, data,
+			nthreads);
+    }
+    if (max_depth < levels->len)
+      cache_traverse (cache, g_ptr_array_index (levels, max_depth),
+		      (flags & FTT_TRAVERSE_LEAFS) != 0 ? CACHE_ALL :
+		      (flags & FTT_TRAVERSE_NON_LEAFS) != 0 ? CACHE_NON_LEAFS : CACHE_ALL,
+		      -1, func, data, nthreads);
+  }
+  else if (flags == FTT_TRAVERSE_LEAFS) {
+    cache->traversing++;
+    cache_traverse (cache, cache->leaves, CACHE_LEAFS, max_depth, func, data, nthreads);
+  }
+  else
+    return FALSE;
+
+  if (--cache->traversing == 0 && g_hash_table_size (cache->destroyed) > 0) {
+    g_hash_table_destroy (cache->destroyed);
+    cache->destroyed = g_hash_table_new (NULL, NULL);
+  }
+  cache->flat++;
+  return TRUE;
+}
+
+/**
+ * gfs_cell_cache_destroy:
+ * @cache: a #GfsCellCache.
+ *
+ * Frees all the memory allocated for @cache.
+ */
+void gfs_cell_cache_destroy (GfsCellCache * cache)
+{
+  if (cache) {
+    guint l;
+    for (l = 0; l < cache->levels->len; l++)
+      g_ptr_array_free (g_ptr_array_index (cache->levels, l), TRUE);
+    g_ptr_array_free (cache->levels, TRUE);
+    g_ptr_array_free (cache->leaves, TRUE);
+    g_hash_table_destroy (cache->destroyed);
+    g_free (cache);
+  }
+}
+
 /**
  * Spatial domain.
  * \beginobject{GfsDomain}
@@ -190,6 +1008,22 @@ static void domain_write (GtsObject * o, FILE * fp)
   fprintf (fp, "version = %d ", atoi (GFS_BUILD_VERSION));
   if (!domain->overlap)
     fputs ("overlap = 0 ", fp);
+  if (!domain->shared)
+    fputs ("shared = 0 ", fp);
+  if (domain->soa)
+    fputs ("soa = 1 ", fp);
+  if (domain->sfc)
+    fputs ("sfc = 1 ", fp);
+  if (domain->nthreads > 1)
+    fprintf (fp, "nthreads = %u ", domain->nthreads);
+  if (domain->temporaries > 0)
+    fprintf (fp, "temporaries = %u ", domain->temporaries);
+  if (!domain->band)
+    fputs ("band = 0 ", fp);
+  if (!domain->reshape_dirty)
+    fputs ("dirty = 0 ", fp);
+  if (!domain->fused)
+    fputs ("fused = 0 ", fp);
   if (domain->max_depth_write > -2) {
     GSList * i = domain->variables_io;
 
@@ -205,6 +1039,8 @@ static void domain_write (GtsObject * o, FILE * fp)
   }
   if (domain->binary != FALSE)
     fprintf (fp, "binary = 1 ");
+  if (domain->data)
+    fprintf (fp, "data = %s ", domain->data);
   fputc ('}', fp);
 }
 
@@ -223,6 +1059,15 @@ static void domain_read (GtsObject ** o, GtsFile * fp)
     {GTS_INT,    "binary",    TRUE},
     {GTS_INT,    "version",   TRUE},
     {GTS_INT,    "overlap",   TRUE},
+    {GTS_INT,    "soa",       TRUE},
+    {GTS_INT,    "sfc",       TRUE},
+    {GTS_UINT,   "nthreads",  TRUE},
+    {GTS_INT,    "shared",    TRUE},
+    {GTS_STRING, "data",      TRUE},
+    {GTS_UINT,   "temporaries", TRUE},
+    {GTS_INT,    "band",      TRUE},
+    {GTS_INT,    "dirty",     TRUE},
+    {GTS_INT,    "fused",     TRUE},
     {GTS_NONE}
   };
   gchar * variables = NULL;
@@ -244,6 +1089,15 @@ static void domain_read (GtsObject ** o, GtsFile * fp)
   var[8].data = &domain->binary;
   var[9].data = &domain->version;
   var[10].data = &domain->overlap;
+  var[11].data = &domain->soa;
+  var[12].data = &domain->sfc;
+  var[13].data = &domain->nthreads;
+  var[14].data = &domain->shared;
+  var[15].data = &domain->data;
+  var[16].data = &domain->temporaries;
+  var[17].data = &domain->band;
+  var[18].data = &domain->reshape_dirty;
+  var[19].data = &domain->fused;
   gts_file_assign_variables (fp, var);
   if (fp->type == GTS_ERROR) {
     g_free (variables);
@@ -253,6 +1107,20 @@ static void domain_read (GtsObject ** o, GtsFile * fp)
   if (var[4].set || var[5].set || var[6].set)
     g_warning ("the (lx,ly,lz) parameters are obsolete, please use GfsMetricStretch instead");
 
+  if (var[13].set && domain->nthreads < 1) {
+    gts_file_variable_error (fp, var, "nthreads", "nthreads must be strictly positive");
+    g_free (variables);
+    return;
+  }
+  gfs_domain_temporary_reserve (domain, domain->temporaries);
+
+#ifndef _OPENMP
+  if (domain->nthreads > 1) {
+    g_warning ("OpenMP support was not compiled in, nthreads = %u is ignored", domain->nthreads);
+    domain->nthreads = 1;
+  }
+#endif
+
 #if FTT_2D
   if (var[3].set) {
     gts_file_variable_error (fp, var, "z", "unknown identifier `z'");
@@ -463,10 +1331,64 @@ static void convert_boundary_mpi_into_edges (GfsBox * box, GPtrArray * ids)
     box->pid = pid;
 }
 
-static void domain_post_read (GfsDomain * domain, GtsFile * fp)
+static void box_read_data (GfsBox * box, gpointer * data)
 {
-  gts_graph_foreach_edge (GTS_GRAPH (domain), (GtsFunc) gfs_gedge_link_boxes, NULL);
+  GtsFile * fp = data[0];
+  GfsIndexedFile * file = data[1];
+  GfsDomain * domain = gfs_box_domain (box);
+
+  if (fp->type == GTS_ERROR || box->offset < 0 || 
+      (domain->pid >= 0 && box->pid != domain->pid))
+    return;
+
+  if (!gfs_indexed_file_read_box (file, box))
+    gts_file_error (fp, "box %u: missing or invalid data in `%s'", box->id, domain->data);
+  else
+    box->offset = -1;
+}
+
+static void box_reset_pid (GfsBox * box)
+{
+  box->pid = -1;
+}
+
+/* Reads the cell data of the boxes of this PE from the indexed data
+   file. If the number of PEs does not match the number of PEs used
+   to write the file, the pids are reset and nothing is read: the
+   caller repartitions the domain and reads it again. */
+static void domain_read_data (GfsDomain * domain, GtsFile * fp)
+{
+#ifdef HAVE_MPI
+  if (domain->pid >= 0) {
+    int comm_size;
+    MPI_Comm_size (MPI_COMM_WORLD, &comm_size);
+    if (domain->np != comm_size) {
+      gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_reset_pid, NULL);
+      domain->np = 1;
+      return;
+    }
+  }
+#endif /* HAVE_MPI */
+
+  gchar * error = NULL;
+  GfsIndexedFile * file = gfs_indexed_file_open (domain->data, &error);
+  if (file == NULL) {
+    gts_file_error (fp, "cannot open indexed data file\n%s", error);
+    g_free (error);
+    return;
+  }
+  gfs_indexed_file_select_variables (file, domain->data_variables);
+  gpointer data[2] = { fp, file };
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_read_data, data);
+  gfs_indexed_file_close (file);
+  if (fp->type != GTS_ERROR) {
+    g_free (domain->data);
+    domain->data = NULL;
+  }
+}
 
+static void domain_post_read (GfsDomain * domain, GtsFile * fp)
+{
   domain->np = 0;
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) pid_max, &domain->np);
 #ifdef HAVE_MPI
@@ -480,6 +1402,14 @@ static void domain_post_read (GfsDomain * domain, GtsFile * fp)
 #endif /* HAVE_MPI */
   domain->np++; /* number of PEs according to pids */
 
+  if (domain->data) {
+    domain_read_data (domain, fp);
+    if (fp->type == GTS_ERROR)
+      return;
+  }
+
+  gts_graph_foreach_edge (GTS_GRAPH (domain), (GtsFunc) gfs_gedge_link_boxes, NULL);
+
   if (domain->np > 1 && domain->pid >= 0) { /* Multiple PEs */
     RemovedData p = { NULL, domain->pid };
     
@@ -509,6 +1439,8 @@ static void domain_post_read (GfsDomain * domain, GtsFile * fp)
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) set_ref_pos, &domain->refpos);
   }
 
+  if (domain->sfc) /* the boxes can now be sorted using their positions */
+    domain->dirty = TRUE;
   gfs_domain_match (domain);
 
   gfs_locate_array_destroy (domain->array);
@@ -543,9 +1475,15 @@ static void domain_destroy (GtsObject * o)
   GfsDomain * domain = GFS_DOMAIN (o);
   GSList * i;
 
+  gfs_boundary_mpi_shared_free (domain);
   gfs_clock_destroy (domain->timer);
   g_timer_destroy (domain->clock);
 
+  gfs_leaf_index_destroy (domain->leaves);
+  domain->leaves = NULL;
+  gfs_cell_cache_destroy (domain->cells);
+  domain->cells = NULL;
+
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) cleanup_each_box, domain);
 
   i = domain->variables;
@@ -560,10 +1498,21 @@ static void domain_destroy (GtsObject * o)
   g_slist_free (domain->derived_variables);
   domain->derived_variables = NULL;
 
+  g_ptr_array_foreach (domain->temporary, (GFunc) gts_object_destroy, NULL);
+  g_ptr_array_free (domain->temporary, TRUE);
+
   g_array_free (domain->allocated, TRUE);
+  gfs_state_pool_destroy (domain->pool);
+  domain->pool = NULL;
 
   g_hash_table_foreach (domain->timers, (GHFunc) free_pair, NULL);
   g_hash_table_destroy (domain->timers);
+  g_slist_free (domain->phases);
+  g_free (domain->data);
+  g_hash_table_foreach (domain->overlaps, (GHFunc) free_pair, NULL);
+  g_hash_table_destroy (domain->overlaps);
+  if (domain->mpi_profile)
+    g_hash_table_destroy (domain->mpi_profile);
 
   g_slist_free (domain->variables_io);
 
@@ -594,6 +1543,46 @@ static int compare_boxes (const void * p1, const void * p2)
     return 0;
 }
 
+#define SFC_BITS 21
+
+/* Morton key of the box position, consistent with the ordering of
+   the children of a cell (x increasing, y and z decreasing) */
+static guint64 box_morton_key (GfsBox * box)
+{
+  FttVector p;
+  gdouble size = ftt_cell_size (box->root);
+  guint64 key = 0, o = 1 << (SFC_BITS - 1);
+  gint b;
+
+  ftt_cell_pos (box->root, &p);
+  guint64 x = o + floor (p.x/size + 0.5);
+  guint64 y = o - floor (p.y/size + 0.5);
+#if !FTT_2D
+  guint64 z = o - floor (p.z/size + 0.5);
+#endif
+  for (b = SFC_BITS - 1; b >= 0; b--) {
+#if !FTT_2D
+    key = (key << 1) | ((z >> b) & 1);
+#endif
+    key = (key << 1) | ((y >> b) & 1);
+    key = (key << 1) | ((x >> b) & 1);
+  }
+  return key;
+}
+
+static int compare_boxes_sfc (const void * p1, const void * p2)
+{
+  GfsBox * b1 = *(GfsBox **)p1;
+  GfsBox * b2 = *(GfsBox **)p2;
+  /* the check below is necessary when using graph partitioning */  
+  if (GFS_IS_BOX (b1) && GFS_IS_BOX (b2)) {
+    guint64 k1 = box_morton_key (b1), k2 = box_morton_key (b2);
+    return k1 < k2 ? -1 : k1 > k2 ? 1 : b1->id < b2->id ? -1 : 1;
+  }
+  else
+    return 0;
+}
+
 static void domain_foreach (GtsContainer * c, 
 			    GtsFunc func, 
 			    gpointer data)
@@ -607,7 +1596,8 @@ static void domain_foreach (GtsContainer * c,
       g_ptr_array_set_size (a, 0);
       (* GTS_CONTAINER_CLASS (GTS_OBJECT_CLASS (gfs_domain_class ())->parent_class)->foreach)
 	(c, (GtsFunc) add_item, a);
-      qsort (a->pdata, a->len, sizeof (gpointer), compare_boxes);
+      qsort (a->pdata, a->len, sizeof (gpointer), 
+	     GFS_DOMAIN (c)->sfc ? compare_boxes_sfc : compare_boxes);
       GFS_DOMAIN (c)->dirty = FALSE;
     }
     guint i;
@@ -620,12 +1610,16 @@ static void domain_add (GtsContainer * c, GtsContainee * i)
 {
   (* GTS_CONTAINER_CLASS (GTS_OBJECT_CLASS (gfs_domain_class ())->parent_class)->add) (c, i);
   GFS_DOMAIN (c)->dirty = TRUE;
+  if (GFS_DOMAIN (c)->cells)
+    GFS_DOMAIN (c)->cells->dirty = TRUE;
 }
 
 static void domain_remove (GtsContainer * c, GtsContainee * i)
 {
   (* GTS_CONTAINER_CLASS (GTS_OBJECT_CLASS (gfs_domain_class ())->parent_class)->remove) (c, i);
   GFS_DOMAIN (c)->dirty = TRUE;
+  if (GFS_DOMAIN (c)->cells)
+    GFS_DOMAIN (c)->cells->dirty = TRUE;
 }
 
 static void domain_class_init (GfsDomainClass * klass)
@@ -656,6 +1650,7 @@ static void domain_init (GfsDomain * domain)
   domain->clock = g_timer_new ();
   domain->timer = gfs_clock_new ();
   domain->timers = g_hash_table_new (g_str_hash, g_str_equal);
+  domain->phases = NULL;
 
   gts_range_init (&domain->size);
 
@@ -663,16 +1658,31 @@ static void domain_init (GfsDomain * domain)
 
   gts_range_init (&domain->mpi_messages);
   gts_range_init (&domain->mpi_wait);
+  domain->mpi_requests = 0;
+  domain->mpi_profile = NULL;
+  domain->overlaps = g_hash_table_new (g_str_hash, g_str_equal);
+  domain->migrated = 0;
+  domain->migration = 0.;
+  domain->reshapes = 0;
+  domain->reshaped = 0.;
+  domain->topology = 0;
+  domain->band = TRUE;
+  domain->reshape_dirty = TRUE;
+  domain->fused = TRUE;
 
   domain->rootlevel = 0;
   domain->refpos.x = domain->refpos.y = domain->refpos.z = 0.;
   domain->lambda.x = domain->lambda.y = domain->lambda.z = 1.;
 
   domain->allocated = g_array_new (FALSE, TRUE, sizeof (gboolean));
+  domain->pool = gfs_state_pool_new (gfs_domain_variables_size (domain));
   domain->variables = NULL;
 
   domain->variables_io = NULL;
   domain->max_depth_write = -1;
+  domain->raw = FALSE;
+  domain->data = NULL;
+  domain->data_variables = NULL;
 
   domain->cell_init = (FttCellInitFunc) gfs_cell_fine_init;
   domain->cell_init_data = domain;
@@ -680,6 +1690,18 @@ static void domain_init (GfsDomain * domain)
   domain->version = atoi (GFS_BUILD_VERSION);
 
   domain->overlap = TRUE;
+  domain->shared = TRUE;
+  domain->mpi_shared = NULL;
+  domain->mpi_shared_messages = 0;
+  domain->soa = FALSE;
+  domain->leaves = NULL;
+  domain->sfc = FALSE;
+  domain->cells = NULL;
+  domain->nthreads = 1;
+  domain->threaded = 0;
+  domain->temporary = g_ptr_array_new ();
+  domain->ntemporary = domain->temporary_peak = 0;
+  domain->temporaries = 0;
 
   domain->objects = g_hash_table_new (g_str_hash, g_str_equal);
 
@@ -718,14 +1740,27 @@ typedef struct {
   GfsVariable * v, * v1;
   FttComponent c;
   GfsLinearProblem * lp;
+  GHashTable * dirty;
 } BcData;
 
+/* Returns TRUE if @b needs to be updated when only the boxes in
+   @dirty have changed (or if @dirty is NULL) */
+static gboolean boundary_is_dirty (GfsBoundary * b, GHashTable * dirty)
+{
+  if (dirty == NULL || GFS_IS_BOUNDARY_MPI (b) || g_hash_table_lookup (dirty, b->box))
+    return TRUE;
+  /* both sides of periodic boundaries are matched together */
+  return (GFS_IS_BOUNDARY_PERIODIC (b) && 
+	  g_hash_table_lookup (dirty, GFS_BOUNDARY_PERIODIC (b)->matching));
+}
+
 static void box_bc (GfsBox * box, BcData * p)
 {
   FttDirection d;
 
   for (d = 0; d < FTT_NEIGHBORS; d++)
-    if (GFS_IS_BOUNDARY (box->neighbor[d])) {
+    if (GFS_IS_BOUNDARY (box->neighbor[d]) && 
+	boundary_is_dirty (GFS_BOUNDARY (box->neighbor[d]), p->dirty)) {
       GfsBoundary * b = GFS_BOUNDARY (box->neighbor[d]);
       GfsBc * bc = gfs_boundary_lookup_bc (b, p->v);
 
@@ -784,24 +1819,28 @@ static void box_receive_bc (GfsBox * box, BcData * r)
     for (d = 0; d < FTT_NEIGHBORS; d++) {
       FttDirection od = FTT_OPPOSITE_DIRECTION (d);
 
-      if (GFS_IS_BOUNDARY (box->neighbor[od]))
+      if (GFS_IS_BOUNDARY (box->neighbor[od]) &&
+	  boundary_is_dirty (GFS_BOUNDARY (box->neighbor[od]), r->dirty))
 	gfs_boundary_receive (GFS_BOUNDARY (box->neighbor[od]), r->flags, r->max_depth);
     }
   }
   else {
-    if (GFS_IS_BOUNDARY (box->neighbor[2*r->c + 1]))
+    if (GFS_IS_BOUNDARY (box->neighbor[2*r->c + 1]) &&
+	boundary_is_dirty (GFS_BOUNDARY (box->neighbor[2*r->c + 1]), r->dirty))
       gfs_boundary_receive (GFS_BOUNDARY (box->neighbor[2*r->c + 1]), r->flags, r->max_depth);
-    if (GFS_IS_BOUNDARY (box->neighbor[2*r->c]))
+    if (GFS_IS_BOUNDARY (box->neighbor[2*r->c]) &&
+	boundary_is_dirty (GFS_BOUNDARY (box->neighbor[2*r->c]), r->dirty))
       gfs_boundary_receive (GFS_BOUNDARY (box->neighbor[2*r->c]), r->flags, r->max_depth);
   }
 }
 
-static void box_match (GfsBox * box)
+static void box_match (GfsBox * box, GHashTable * dirty)
 {
   FttDirection d;
 
   for (d = 0; d < FTT_NEIGHBORS; d++)
-    if (GFS_IS_BOUNDARY (box->neighbor[d])) {
+    if (GFS_IS_BOUNDARY (box->neighbor[d]) && 
+	boundary_is_dirty (GFS_BOUNDARY (box->neighbor[d]), dirty)) {
       GfsBoundary * boundary = GFS_BOUNDARY (box->neighbor[d]);
 
       g_assert (GFS_BOUNDARY_CLASS (box->neighbor[d]->klass)->match);
@@ -849,11 +1888,61 @@ void gfs_domain_copy_bc (GfsDomain * domain,
 			 GfsVariable * v,
 			 GfsVariable * v1)
 {
-  BcData b = { flags, max_depth, v, v1, FTT_XYZ};
+  BcData b = { flags, max_depth, v, v1, FTT_XYZ};
+
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (v != NULL);
+  g_return_if_fail (v1 != NULL);
+
+  if (domain->profile_bc)
+    gfs_domain_timer_start (domain, "bc");
+
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_bc, &b);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc, &b);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &b.c);
+
+  if (domain->profile_bc)
+    gfs_domain_timer_stop (domain, "bc");
+}
+
+/**
+ * gfs_domain_bc:
+ * @domain: a #GfsDomain.
+ * @flags: the traversal flags.
+ * @max_depth: the maximum depth of the traversal.
+ * @v: a #GfsVariable.
+ *
+ * Apply the boundary conditions in @domain for variable @v.
+ */
+void gfs_domain_bc (GfsDomain * domain,
+		    FttTraverseFlags flags,
+		    gint max_depth,
+		    GfsVariable * v)
+{
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (v != NULL);
+
+  gfs_domain_copy_bc (domain, flags, max_depth, v, v);
+}
+
+/**
+ * gfs_domain_bc_dirty:
+ * @domain: a #GfsDomain.
+ * @v: a #GfsVariable.
+ * @dirty: a set of #GfsBox.
+ *
+ * Apply the boundary conditions for variable @v on the leaf cells of
+ * the boundaries of @domain matched by gfs_domain_match_dirty().
+ */
+void gfs_domain_bc_dirty (GfsDomain * domain,
+			  GfsVariable * v,
+			  GHashTable * dirty)
+{
+  BcData b = { FTT_TRAVERSE_LEAFS, -1, v, v, FTT_XYZ, NULL, dirty };
 
   g_return_if_fail (domain != NULL);
   g_return_if_fail (v != NULL);
-  g_return_if_fail (v1 != NULL);
+  g_return_if_fail (dirty != NULL);
 
   if (domain->profile_bc)
     gfs_domain_timer_start (domain, "bc");
@@ -866,24 +1955,117 @@ void gfs_domain_copy_bc (GfsDomain * domain,
     gfs_domain_timer_stop (domain, "bc");
 }
 
+typedef struct {
+  FttTraverseFlags flags;
+  gint max_depth;
+  GSList * list;
+} BcMultiData;
+
+static void box_bc_multi (GfsBox * box, BcMultiData * p)
+{
+  FttDirection d;
+
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY (box->neighbor[d])) {
+      GfsBoundary * b = GFS_BOUNDARY (box->neighbor[d]);
+      GfsBoundaryPeriodic * pb = GFS_IS_BOUNDARY_PERIODIC (b) ? GFS_BOUNDARY_PERIODIC (b) : NULL;
+      GfsVariable * first = NULL;
+      guint count = 0;
+      GSList * i = p->list;
+
+      b->type = GFS_BOUNDARY_CENTER_VARIABLE;
+      while (i) {
+	GfsVariable * v = i->data;
+	GfsBc * bc = gfs_boundary_lookup_bc (b, v);
+
+	if (bc) {
+	  if (first == NULL)
+	    first = v;
+	  else if (pb && pb->sndbuf->len < pb->sndcount + count)
+	    /* each variable packs the same number of values */
+	    g_array_set_size (pb->sndbuf, pb->sndcount + count);
+	  b->v = v;
+	  gfs_boundary_update (b);
+	  bc->v = v;
+	  ftt_face_traverse_boundary (b->root, b->d,
+				      FTT_PRE_ORDER, p->flags, p->max_depth,
+				      bc->bc, bc);
+	  if (pb && v == first)
+	    count = pb->sndcount;
+	}
+	i = i->next;
+      }
+      if (first) {
+	/* a single message for all the variables */
+	b->v = first;
+	gfs_boundary_send (b);
+      }
+    }
+}
+
+static void box_receive_bc_multi (GfsBox * box, BcMultiData * p)
+{
+  FttDirection d;
+    
+  for (d = 0; d < FTT_NEIGHBORS; d++) {
+    GtsObject * neighbor = box->neighbor[FTT_OPPOSITE_DIRECTION (d)];
+
+    if (GFS_IS_BOUNDARY (neighbor)) {
+      GfsBoundary * b = GFS_BOUNDARY (neighbor);
+      gboolean first = TRUE;
+      GSList * i = p->list;
+
+      while (i) {
+	GfsVariable * v = i->data;
+
+	if (gfs_boundary_lookup_bc (b, v)) {
+	  b->v = v;
+	  if (first)
+	    gfs_boundary_receive (b, p->flags, p->max_depth);
+	  else if (GFS_IS_BOUNDARY_PERIODIC (b))
+	    gfs_boundary_periodic_unpack (GFS_BOUNDARY_PERIODIC (b), p->flags, p->max_depth);
+	  first = FALSE;
+	}
+	i = i->next;
+      }
+    }
+  }
+}
+
 /**
- * gfs_domain_bc:
+ * gfs_domain_bc_multi:
  * @domain: a #GfsDomain.
  * @flags: the traversal flags.
  * @max_depth: the maximum depth of the traversal.
- * @v: a #GfsVariable.
+ * @list: a list of #GfsVariable.
  *
- * Apply the boundary conditions in @domain for variable @v.
+ * Apply the boundary conditions in @domain for all the variables of
+ * @list. This is identical to calling gfs_domain_bc() for each
+ * variable but the values of all the variables are exchanged in a
+ * single message through each periodic or parallel boundary.
  */
-void gfs_domain_bc (GfsDomain * domain,
-		    FttTraverseFlags flags,
-		    gint max_depth,
-		    GfsVariable * v)
+void gfs_domain_bc_multi (GfsDomain * domain,
+			  FttTraverseFlags flags,
+			  gint max_depth,
+			  GSList * list)
 {
+  BcMultiData b = { flags, max_depth, list };
+  FttComponent c = FTT_XYZ;
+
   g_return_if_fail (domain != NULL);
-  g_return_if_fail (v != NULL);
 
-  gfs_domain_copy_bc (domain, flags, max_depth, v, v);
+  if (list == NULL)
+    return;
+
+  if (domain->profile_bc)
+    gfs_domain_timer_start (domain, "bc");
+
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_bc_multi, &b);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc_multi, &b);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &c);
+
+  if (domain->profile_bc)
+    gfs_domain_timer_stop (domain, "bc");
 }
 
 static void box_homogeneous_bc (GfsBox * box, BcData * p)
@@ -1045,6 +2227,32 @@ static void update_mpi_boundaries (GfsBox * box, TraverseBcData * p)
     }
 }
 
+/* wall-clock time: unlike gfs_clock_elapsed(), includes the time
+   spent blocked in MPI */
+static gdouble wall_time (GfsDomain * domain)
+{
+#ifdef HAVE_MPI
+  return MPI_Wtime ();
+#else /* not HAVE_MPI */
+  return g_timer_elapsed (domain->clock, NULL);
+#endif /* not HAVE_MPI */
+}
+
+/* Records the time spent computing between @sent and @computed, and
+   the time spent waiting for the messages since @computed */
+static void overlap_stats (GfsDomain * domain, gdouble sent, gdouble computed)
+{
+  const gchar * phase = gfs_domain_phase (domain);
+  GfsOverlap * o = g_hash_table_lookup (domain->overlaps, phase);
+  if (o == NULL) {
+    o = g_malloc0 (sizeof (GfsOverlap));
+    g_hash_table_insert (domain->overlaps, g_strdup (phase), o);
+  }
+  o->n++;
+  o->compute += computed - sent;
+  o->wait += wall_time (domain) - computed;
+}
+
 static void update_other_homogeneous_boundaries (GfsBox * box, BcData * p)
 {
   FttDirection d;
@@ -1101,26 +2309,30 @@ void gfs_traverse_and_homogeneous_bc (GfsDomain * domain,
 {
   g_return_if_fail (domain != NULL);
 
+  FttTraverseFlags bflags = flags & ~FTT_TRAVERSE_THREAD_SAFE;
   if (domain->pid < 0 || !domain->overlap) {
     gfs_domain_cell_traverse (domain, order, flags, max_depth, func, data);
-    gfs_domain_homogeneous_bc (domain, flags, max_depth, ov, v);
+    gfs_domain_homogeneous_bc (domain, bflags, max_depth, ov, v);
   }
   else {
     TraverseBcData d = {
-      { func, data, order, flags, max_depth }, 
-      { flags, max_depth, v, ov, FTT_XYZ }
+      { func, data, order, bflags, max_depth }, 
+      { bflags, max_depth, v, ov, FTT_XYZ }
     };
     /* Update and send MPI boundary values */
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) update_mpi_boundaries, &d);
+    gdouble sent = wall_time (domain);
     /* Update bulk of domain and other boundaries */
     gfs_domain_cell_traverse (domain, order, flags, max_depth, 
 			      (FttCellTraverseFunc) update_other_cell, &d);
     /* Apply homogeneous BC on other boundaries */
     gts_container_foreach (GTS_CONTAINER (domain), 
 			   (GtsFunc) update_other_homogeneous_boundaries, &d.b);
+    gdouble computed = wall_time (domain);
     /* Receive and synchronize */
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc, &d.b);
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &d.b.c);
+    overlap_stats (domain, sent, computed);
   }
 }
 
@@ -1167,7 +2379,8 @@ static void update_other_boundaries (GfsBox * box, BcData * p)
  *
  * For parallel runs, the communications needed to apply the boundary
  * conditions are overlapped with the calls to @func in the bulk of
- * the domain.
+ * the domain. The times spent computing and waiting are added to the
+ * #GfsOverlap statistics of the current phase (see gfs_domain_phase()).
  */
 void gfs_traverse_and_bc (GfsDomain * domain,
 			  FttTraverseType order,
@@ -1180,25 +2393,29 @@ void gfs_traverse_and_bc (GfsDomain * domain,
 {
   g_return_if_fail (domain != NULL);
 
+  FttTraverseFlags bflags = flags & ~FTT_TRAVERSE_THREAD_SAFE;
   if (domain->pid < 0 || !domain->overlap) {
     gfs_domain_cell_traverse (domain, order, flags, max_depth, func, data);
-    gfs_domain_copy_bc (domain, flags, max_depth, v, v1);
+    gfs_domain_copy_bc (domain, bflags, max_depth, v, v1);
   }
   else {
     TraverseBcData d = {
-      { func, data, order, flags, max_depth },
-      { flags, max_depth, v, v1, FTT_XYZ }
+      { func, data, order, bflags, max_depth },
+      { bflags, max_depth, v, v1, FTT_XYZ }
     };
     /* Update and send MPI boundary values */
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) update_mpi_boundaries, &d);
+    gdouble sent = wall_time (domain);
     /* Update bulk of domain and other boundaries */
     gfs_domain_cell_traverse (domain, order, flags, max_depth, 
     			      (FttCellTraverseFunc) update_other_cell, &d);
     /* Apply BC on other boundaries */
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) update_other_boundaries, &d.b);
+    gdouble computed = wall_time (domain);
     /* Receive and synchronize */
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc, &d.b);
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &d.b.c);
+    overlap_stats (domain, sent, computed);
   }
 }
 
@@ -1231,13 +2448,21 @@ void gfs_domain_face_bc (GfsDomain * domain,
     gfs_domain_timer_stop (domain, "face_bc");
 }
 
-static void box_changed (GfsBox * box, gboolean * changed)
+static void box_changed (GfsBox * box, gpointer * data)
 {
+  gboolean * changed = data[0];
+  GHashTable * dirty = data[1];
+  GSList ** boxes = data[2];
   FttDirection d;
 
   for (d = 0; d < FTT_NEIGHBORS; d++)
-    if (GFS_IS_BOUNDARY (box->neighbor[d]))
-      *changed |= GFS_BOUNDARY (box->neighbor[d])->changed;
+    if (GFS_IS_BOUNDARY (box->neighbor[d]) &&
+	boundary_is_dirty (GFS_BOUNDARY (box->neighbor[d]), dirty) &&
+	GFS_BOUNDARY (box->neighbor[d])->changed) {
+      *changed = TRUE;
+      *boxes = g_slist_prepend (*boxes, box);
+      return;
+    }
 }
 
 static void refine_cell_corner (FttCell * cell, GfsDomain * domain)
@@ -1254,27 +2479,110 @@ static void box_depth (GfsBox * box, guint * depth)
     *depth = d;
 }
 
-static gboolean domain_match (GfsDomain * domain)
+typedef struct {
+  GfsDomain * domain;
+  gboolean refined;
+} CornerData;
+
+static void refine_cell_corner_box (FttCell * cell, CornerData * p)
+{
+  if (FTT_CELL_IS_LEAF (cell) && ftt_refine_corner (cell)) {
+    ftt_cell_refine_single (cell, p->domain->cell_init, p->domain->cell_init_data);
+    p->refined = TRUE;
+  }
+}
+
+static void add_dirty_box (GfsBox * box, GHashTable * dirty)
+{
+  g_hash_table_insert (dirty, box, box);
+}
+
+static void prepend_box (GfsBox * box, GfsBox * value, GSList ** boxes)
+{
+  *boxes = g_slist_prepend (*boxes, box);
+}
+
+/* Refines the corners of the boxes in @changed. Refining a cell can
+   only require the refinement of coarser cells, possibly in
+   neighbouring boxes, which are added to @dirty as needed. */
+static void dirty_refine_corners (GfsDomain * domain, GSList * changed, GHashTable * dirty)
+{
+  guint depth = 0;
+  gint l;
+
+  g_slist_foreach (changed, (GFunc) add_dirty_box, dirty);
+  g_slist_foreach (changed, (GFunc) box_depth, &depth);
+  for (l = depth - 2; l >= 0; l--) {
+    GSList * boxes = NULL, * i;
+    g_hash_table_foreach (dirty, (GHFunc) prepend_box, &boxes);
+    for (i = boxes; i; i = i->next) {
+      GfsBox * box = i->data;
+      CornerData p = { domain, FALSE };
+      ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, l,
+			 (FttCellTraverseFunc) refine_cell_corner_box, &p);
+      if (p.refined) {
+	FttDirection d;
+	for (d = 0; d < FTT_NEIGHBORS; d++)
+	  if (GFS_IS_BOX (box->neighbor[d]))
+	    add_dirty_box (GFS_BOX (box->neighbor[d]), dirty);
+      }
+    }
+    g_slist_free (boxes);
+  }
+}
+
+static gboolean domain_match (GfsDomain * domain, GHashTable * dirty)
 {
-  BcData b = { FTT_TRAVERSE_LEAFS, -1, NULL, NULL, FTT_XYZ };
+  BcData b = { FTT_TRAVERSE_LEAFS, -1, NULL, NULL, FTT_XYZ, NULL, dirty };
   gboolean changed = FALSE;
-  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_match, NULL);
+  GSList * boxes = NULL;
+  gpointer data[3] = { &changed, dirty, &boxes };
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_match, dirty);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc, &b);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &b.c);
-  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_changed, &changed);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_changed, data);
   if (changed) {
-    gint l;
-    guint depth = 0;
-    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_depth, &depth);
-    for (l = depth - 2; l >= 0; l--)
-      gfs_domain_cell_traverse (domain,
-				FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, l,
-				(FttCellTraverseFunc) refine_cell_corner, domain);
+    if (dirty)
+      dirty_refine_corners (domain, boxes, dirty);
+    else {
+      gint l;
+      guint depth = 0;
+      gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_depth, &depth);
+      for (l = depth - 2; l >= 0; l--)
+	gfs_domain_cell_traverse (domain,
+				  FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, l,
+				  (FttCellTraverseFunc) refine_cell_corner, domain);
+    }
   }
+  g_slist_free (boxes);
   gfs_all_reduce (domain, changed, MPI_INT, MPI_MAX);
   return changed;
 }
 
+static gboolean domain_match_dirty (GfsDomain * domain, GHashTable * dirty)
+{
+  gboolean changed = FALSE;
+
+  if (domain->profile_bc)
+    gfs_domain_timer_start (domain, "match");
+
+  while (domain_match (domain, dirty))
+    changed = TRUE;
+  gfs_boundary_mpi_shared_setup (domain);
+
+  if (domain->sfc) {
+    if (domain->cells == NULL)
+      domain->cells = gfs_cell_cache_new (domain);
+    if (domain->cells->dirty)
+      gfs_cell_cache_update (domain->cells);
+  }
+
+  if (domain->profile_bc)
+    gfs_domain_timer_stop (domain, "match");
+
+  return changed;
+}
+
 /**
  * gfs_domain_match:
  * @domain: a #GfsDomain.
@@ -1285,13 +2593,32 @@ void gfs_domain_match (GfsDomain * domain)
 {
   g_return_if_fail (domain != NULL);
 
-  if (domain->profile_bc)
-    gfs_domain_timer_start (domain, "match");
+  domain_match_dirty (domain, NULL);
+}
 
-  while (domain_match (domain));
+/**
+ * gfs_domain_match_dirty:
+ * @domain: a #GfsDomain.
+ * @dirty: a set of #GfsBox.
+ *
+ * Same as gfs_domain_match() but only the boundaries of the boxes in
+ * @dirty are matched, together with the periodic boundaries matching
+ * these boxes and the parallel boundaries (which are always
+ * matched). This is enough if the cells of the other boxes have not
+ * changed since the boundaries were last matched.
+ *
+ * The boxes whose cells are refined while matching the boundaries
+ * are added to @dirty.
+ *
+ * Returns: %TRUE if the cells of some of the boxes of @dirty may have
+ * been refined while matching the boundaries, %FALSE otherwise.
+ */
+gboolean gfs_domain_match_dirty (GfsDomain * domain, GHashTable * dirty)
+{
+  g_return_val_if_fail (domain != NULL, FALSE);
+  g_return_val_if_fail (dirty != NULL, FALSE);
 
-  if (domain->profile_bc)
-    gfs_domain_timer_stop (domain, "match");
+  return domain_match_dirty (domain, dirty);
 }
 
 /**
@@ -1370,6 +2697,56 @@ static void box_traverse (GfsBox * box, TraverseData * d)
   ftt_cell_traverse (box->root, d->order, d->flags, d->max_depth, d->func, d->data);
 }
 
+static void add_subtree (FttCell * cell, GPtrArray * subtrees)
+{
+  g_ptr_array_add (subtrees, cell);
+}
+
+/* Applies @func to the cells of @domain using several threads. The
+   trees are split into subtrees (at a level giving a few subtrees per
+   thread) which are traversed concurrently. Only traversals which do
+   not depend on the order in which the cells are visited are
+   threaded. Returns %FALSE if no cell has been visited. */
+static gboolean traverse_threaded (GfsDomain * domain,
+				   FttTraverseType order,
+				   FttTraverseFlags flags,
+				   gint max_depth,
+				   FttCellTraverseFunc func,
+				   gpointer data)
+{
+#ifdef _OPENMP
+  if (domain->nthreads < 2 || omp_in_parallel () ||
+      ((flags & FTT_TRAVERSE_LEVEL) != 0 ? max_depth < 0 : flags != FTT_TRAVERSE_LEAFS))
+    return FALSE;
+
+  domain->threaded++;
+  if (domain->cells && 
+      gfs_cell_cache_traverse (domain->cells, flags | FTT_TRAVERSE_THREAD_SAFE, max_depth, 
+			       func, data))
+    return TRUE;
+
+  guint n = gts_container_size (GTS_CONTAINER (domain));
+  gint level = domain->rootlevel;
+  while (n < 4*domain->nthreads) {
+    n *= FTT_CELLS;
+    level++;
+  }
+  if (max_depth >= 0)
+    level = MIN (level, max_depth);
+  GPtrArray * subtrees = g_ptr_array_new ();
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, level,
+			    (FttCellTraverseFunc) add_subtree, subtrees);
+  gint i, nsubtrees = subtrees->len;
+#pragma omp parallel for num_threads (domain->nthreads) schedule (dynamic)
+  for (i = 0; i < nsubtrees; i++)
+    ftt_cell_traverse (g_ptr_array_index (subtrees, i), order, flags, max_depth, func, data);
+  g_ptr_array_free (subtrees, TRUE);
+  return TRUE;
+#else
+  return FALSE;
+#endif /* _OPENMP */
+}
+
 /**
  * gfs_domain_cell_traverse:
  * @domain: a #GfsDomain.
@@ -1384,6 +2761,16 @@ static void box_traverse (GfsBox * box, TraverseData * d)
  *
  * Traverses the cell trees of @domain. Calls the given function for
  * each cell visited.  
+ *
+ * If @domain uses space-filling-curve ordering, leaf and level
+ * traversals are flat loops over the arrays of its #GfsCellCache
+ * (see gfs_cell_cache_traverse()).
+ *
+ * If %FTT_TRAVERSE_THREAD_SAFE is set in @flags and @domain uses
+ * several threads (the @nthreads parameter), leaf and level
+ * traversals are split between threads. @func must then only modify
+ * the cell it is called with (or use GFS_ATOMIC_ADD()), must not
+ * modify the cell trees and must not traverse @domain itself.
  */
 void gfs_domain_cell_traverse (GfsDomain * domain,
 			       FttTraverseType order,
@@ -1392,11 +2779,18 @@ void gfs_domain_cell_traverse (GfsDomain * domain,
 			       FttCellTraverseFunc func,
 			       gpointer data)
 {
-  TraverseData d = { func, data, order, flags, max_depth };
-
   g_return_if_fail (domain != NULL);
   g_return_if_fail (func != NULL);
 
+  if ((flags & FTT_TRAVERSE_THREAD_SAFE) != 0) {
+    flags &= ~FTT_TRAVERSE_THREAD_SAFE;
+    if (traverse_threaded (domain, order, flags, max_depth, func, data))
+      return;
+  }
+
+  TraverseData d = { func, data, order, flags, max_depth };
+  if (domain->cells && gfs_cell_cache_traverse (domain->cells, flags, max_depth, func, data))
+    return;
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_traverse, &d);
 }
 
@@ -1699,6 +3093,76 @@ guint gfs_domain_depth (GfsDomain * domain)
   return depth;
 }
 
+/**
+ * gfs_domain_leaf_index:
+ * @domain: a #GfsDomain.
+ *
+ * Returns: the (updated if necessary) #GfsLeafIndex of @domain or
+ * %NULL if @domain does not use structure-of-arrays leaf storage.
+ */
+GfsLeafIndex * gfs_domain_leaf_index (GfsDomain * domain)
+{
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  if (!domain->soa)
+    return NULL;
+  if (domain->leaves == NULL)
+    domain->leaves = gfs_leaf_index_new (domain);
+  if (domain->leaves->dirty)
+    gfs_leaf_index_update (domain->leaves);
+  return domain->leaves;
+}
+
+static void add_box (GfsBox * box, GPtrArray * a)
+{
+  g_ptr_array_add (a, box);
+}
+
+/**
+ * gfs_domain_sfc_partition:
+ * @domain: a #GfsDomain.
+ * @np: the number of partitions.
+ *
+ * Sets the pid of each box of @domain by cutting the list of boxes,
+ * sorted along a Morton space-filling curve, into @np contiguous
+ * chunks of approximately equal weight (number of cells). If @domain
+ * has at least @np boxes, each chunk contains at least one box.
+ *
+ * Returns: the number of partitions created.
+ */
+guint gfs_domain_sfc_partition (GfsDomain * domain, guint np)
+{
+  g_return_val_if_fail (domain != NULL, 0);
+  g_return_val_if_fail (np > 0, 0);
+
+  GPtrArray * a = g_ptr_array_new ();
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) add_box, a);
+  qsort (a->pdata, a->len, sizeof (gpointer), compare_boxes_sfc);
+
+  gdouble total = 0., sum = 0.;
+  guint i, n = 0;
+  gint pid = -1;
+  for (i = 0; i < a->len; i++)
+    total += gts_gnode_weight (a->pdata[i]);
+  for (i = 0; i < a->len; i++) {
+    GfsBox * box = a->pdata[i];
+    gdouble w = gts_gnode_weight (GTS_GNODE (box));
+    gint p = total > 0. ? (sum + w/2.)*np/total : i*np/a->len;
+    /* no partition is skipped and enough boxes are left for the next ones */
+    p = MAX (p, MAX (pid, (gint) np - (gint) (a->len - i)));
+    box->pid = MIN (p, MIN (pid + 1, (gint) np - 1));
+    if (box->pid != pid) {
+      pid = box->pid;
+      n++;
+    }
+    sum += w;
+  }
+  g_ptr_array_free (a, TRUE);
+  return n;
+}
+
+/* face traversals use the table of neighbors of the leaf index (if any) */
+#define FTT_FACE_NEIGHBOR(cell, d, datum) gfs_leaf_index_neighbor (datum[6], cell, d)
 #include "ftt_internal.c"
 
 /**
@@ -1721,6 +3185,13 @@ guint gfs_domain_depth (GfsDomain * domain)
  * If %FTT_TRAVERSE_BOUNDARY_FACES is not set in @flags, only
  * "double-sided" faces are traversed i.e. the @neighbor field of the
  * face is never %NULL.  
+ *
+ * If %FTT_TRAVERSE_THREAD_SAFE is set in @flags (and
+ * %FTT_TRAVERSE_BOUNDARY_FACES is not), the faces in the bulk of the
+ * domain are traversed by several threads (see
+ * gfs_domain_cell_traverse()). @func can then modify the face values
+ * of both cells of the face but must use GFS_ATOMIC_ADD() to modify
+ * cell values.
  */
 void gfs_domain_face_traverse (GfsDomain * domain,
 			       FttComponent c,
@@ -1731,7 +3202,7 @@ void gfs_domain_face_traverse (GfsDomain * domain,
 			       gpointer data)
 {
   FttDirection d;
-  gpointer datum[6];
+  gpointer datum[7];
   gboolean check = FALSE;
   gboolean boundary_faces;
   
@@ -1740,11 +3211,16 @@ void gfs_domain_face_traverse (GfsDomain * domain,
   g_return_if_fail (func != NULL);
 
   boundary_faces = ((flags & FTT_TRAVERSE_BOUNDARY_FACES) != 0);
+  /* faces are checked using the flags of the cells which is not thread-safe */
+  FttTraverseFlags sflags = flags & ~FTT_TRAVERSE_THREAD_SAFE;
+  if (boundary_faces)
+    flags = sflags;
   datum[1] = &max_depth;
   datum[2] = func;
   datum[3] = data;
   datum[4] = &check;
   datum[5] = &boundary_faces;
+  datum[6] = domain->leaves;
   if (c == FTT_XYZ) {
     if (boundary_faces) {
       check = TRUE;
@@ -1760,7 +3236,7 @@ void gfs_domain_face_traverse (GfsDomain * domain,
       check = TRUE;
       for (d = 1; d < FTT_NEIGHBORS; d += 2)
 	gfs_domain_cell_traverse_boundary (domain, 
-					   d, order, flags, max_depth, 
+					   d, order, sflags, max_depth, 
 					   (FttCellTraverseFunc) traverse_face, datum);
     }
   }
@@ -1784,7 +3260,7 @@ void gfs_domain_face_traverse (GfsDomain * domain,
 				datum);
       d = 2*c + 1;
       check = TRUE;
-      gfs_domain_cell_traverse_boundary (domain, d, order, flags, max_depth, 
+      gfs_domain_cell_traverse_boundary (domain, d, order, sflags, max_depth, 
 					 (FttCellTraverseFunc) traverse_face, datum);
     }
   }
@@ -2138,7 +3614,7 @@ static void norm_reduce (void * i, void * o,
 {
   gdouble * in = (gdouble *) i;
   gdouble * inout = (gdouble *) o;
-  g_assert (*len == 5);
+  g_assert (*len == 5 || *len == 6);
   
   inout[0] += in[0];    /* bias */
   inout[1] += in[1];    /* first */
@@ -2146,6 +3622,16 @@ static void norm_reduce (void * i, void * o,
   if (in[3] > inout[3]) /* infty */
     inout[3] = in[3];    
   inout[4] += in[4];    /* w */
+  if (*len == 6)
+    inout[5] += in[5];  /* residual bias */
+}
+
+static MPI_Op norm_op (void)
+{
+  static MPI_Op op = MPI_OP_NULL;
+  if (op == MPI_OP_NULL)
+    MPI_Op_create (norm_reduce, TRUE, &op);
+  return op;
 }
 
 static void domain_norm_reduce (GfsDomain * domain, GfsNorm * n)
@@ -2246,45 +3732,192 @@ static void add_norm_residual (const FttCell * cell, ResData * p)
 }
 
 /**
- * gfs_domain_norm_residual:
+ * gfs_domain_norm_residual:
+ * @domain: the domain to obtain the norm from.
+ * @flags: which types of cells are to be visited.
+ * @max_depth: maximum depth of the traversal.
+ * @dt: the time step.
+ * @res: the residual.
+ *
+ * Traverses the domain defined by @domain using gfs_domain_cell_traverse()
+ * and gathers norm statistics about the volume weighted relative residual
+ * (i.e. the sum of the residual over the volume defined by each cell
+ * divided by the total volume of the cell).
+ *
+ * Returns: a #GfsNorm containing the norm statistics about the volume
+ * weighted relative residual.  
+ */
+GfsNorm gfs_domain_norm_residual (GfsDomain * domain,
+				  FttTraverseFlags flags,
+				  gint max_depth,
+				  gdouble dt,
+				  GfsVariable * res)
+{
+  GfsNorm n;
+
+  g_return_val_if_fail (domain != NULL, n);
+  g_return_val_if_fail (res != NULL, n);
+
+  return gfs_domain_norm_residual_end (gfs_domain_norm_residual_begin (domain, flags, max_depth,
+								       dt, res));
+}
+
+struct _GfsReduction {
+  GfsDomain * domain;
+  guint n;
+  gdouble * in, * out;
+  gdouble dt;
+#ifdef HAVE_MPI
+  MPI_Request request;
+#endif
+};
+
+static GfsReduction * reduction_new (GfsDomain * domain, const gdouble * values, guint n)
+{
+  GfsReduction * r = g_malloc (sizeof (GfsReduction) + 2*n*sizeof (gdouble));
+  r->domain = domain;
+  r->n = n;
+  r->in = (gdouble *) (r + 1);
+  r->out = r->in + n;
+  memcpy (r->in, values, n*sizeof (gdouble));
+  memcpy (r->out, values, n*sizeof (gdouble));
+  return r;
+}
+
+#ifdef HAVE_MPI
+static void reduction_start (GfsReduction * r, MPI_Op op)
+{
+  r->request = MPI_REQUEST_NULL;
+  if (r->domain->pid >= 0) {
+#if MPI_VERSION >= 3
+    MPI_Iallreduce (r->in, r->out, r->n, MPI_DOUBLE, op, MPI_COMM_WORLD, &r->request);
+#else /* MPI-2 does not have non-blocking collectives */
+    MPI_Allreduce (r->in, r->out, r->n, MPI_DOUBLE, op, MPI_COMM_WORLD);
+#endif /* MPI-2 */
+  }
+}
+#endif /* HAVE_MPI */
+
+static void reduction_wait (GfsReduction * r)
+{
+#ifdef HAVE_MPI
+  MPI_Wait (&r->request, MPI_STATUS_IGNORE);
+#endif /* HAVE_MPI */
+}
+
+/**
+ * gfs_domain_reduce_begin:
+ * @domain: a #GfsDomain.
+ * @values: an array of @n local values.
+ * @n: the number of values.
+ * @op: the reduction operator.
+ *
+ * Starts the reduction of @values over all the PEs. The reduction
+ * proceeds in the background (when the MPI library supports
+ * non-blocking collectives) until gfs_domain_reduce_end() is called.
+ *
+ * All the PEs must start the same reductions in the same order.
+ *
+ * Returns: a new #GfsReduction.
+ */
+GfsReduction * gfs_domain_reduce_begin (GfsDomain * domain,
+					const gdouble * values,
+					guint n,
+					GfsReduceOp op)
+{
+  g_return_val_if_fail (domain != NULL, NULL);
+  g_return_val_if_fail (values != NULL, NULL);
+
+  GfsReduction * r = reduction_new (domain, values, n);
+#ifdef HAVE_MPI
+  reduction_start (r, op == GFS_REDUCE_SUM ? MPI_SUM : op == GFS_REDUCE_MIN ? MPI_MIN : MPI_MAX);
+#endif /* HAVE_MPI */
+  return r;
+}
+
+/**
+ * gfs_domain_reduce_end:
+ * @r: a #GfsReduction.
+ * @values: an array of values.
+ *
+ * Waits for the completion of @r, fills @values with the results of
+ * the reduction and frees @r.
+ */
+void gfs_domain_reduce_end (GfsReduction * r, gdouble * values)
+{
+  g_return_if_fail (r != NULL);
+  g_return_if_fail (values != NULL);
+
+  reduction_wait (r);
+  memcpy (values, r->out, r->n*sizeof (gdouble));
+  g_free (r);
+}
+
+/**
+ * gfs_domain_norm_residual_begin:
  * @domain: the domain to obtain the norm from.
  * @flags: which types of cells are to be visited.
  * @max_depth: maximum depth of the traversal.
  * @dt: the time step.
  * @res: the residual.
  *
- * Traverses the domain defined by @domain using gfs_domain_cell_traverse()
- * and gathers norm statistics about the volume weighted relative residual
- * (i.e. the sum of the residual over the volume defined by each cell
- * divided by the total volume of the cell).
+ * Gathers the local norm statistics about @res (see
+ * gfs_domain_norm_residual()) and starts their reduction over all
+ * the PEs. @res can be modified before calling
+ * gfs_domain_norm_residual_end().
  *
- * Returns: a #GfsNorm containing the norm statistics about the volume
- * weighted relative residual.  
+ * Returns: a new #GfsReduction.
  */
-GfsNorm gfs_domain_norm_residual (GfsDomain * domain,
-				  FttTraverseFlags flags,
-				  gint max_depth,
-				  gdouble dt,
-				  GfsVariable * res)
+GfsReduction * gfs_domain_norm_residual_begin (GfsDomain * domain,
+					       FttTraverseFlags flags,
+					       gint max_depth,
+					       gdouble dt,
+					       GfsVariable * res)
 {
   ResData p = { res, 0. };
 
-  g_return_val_if_fail (domain != NULL, p.n);
-  g_return_val_if_fail (res != NULL, p.n);
+  g_return_val_if_fail (domain != NULL, NULL);
+  g_return_val_if_fail (res != NULL, NULL);
   
   gfs_norm_init (&p.n);
   gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, flags, max_depth, 
 			   (FttCellTraverseFunc) add_norm_residual, &p);
-  domain_norm_reduce (domain, &p.n);
-  gfs_all_reduce (domain, p.bias, MPI_DOUBLE, MPI_SUM);
-  gfs_norm_update (&p.n);
+  gdouble in[6] = { p.n.bias, p.n.first, p.n.second, p.n.infty, p.n.w, p.bias };
+  GfsReduction * r = reduction_new (domain, in, 6);
+  r->dt = dt;
+#ifdef HAVE_MPI
+  reduction_start (r, norm_op ());
+#endif /* HAVE_MPI */
+  return r;
+}
+
+/**
+ * gfs_domain_norm_residual_end:
+ * @r: a #GfsReduction returned by gfs_domain_norm_residual_begin().
+ *
+ * Waits for the completion of @r and frees it.
+ *
+ * Returns: a #GfsNorm containing the norm statistics about the volume
+ * weighted relative residual.  
+ */
+GfsNorm gfs_domain_norm_residual_end (GfsReduction * r)
+{
+  GfsNorm n;
+
+  g_return_val_if_fail (r != NULL, n);
+
+  reduction_wait (r);
+  n.bias = r->out[0]; n.first = r->out[1]; n.second = r->out[2]; n.infty = r->out[3];
+  n.w = r->out[4];
+  gfs_norm_update (&n);
 
-  dt *= dt;
-  p.n.bias = p.bias*dt;
-  p.n.first *= dt;
-  p.n.second *= dt;
-  p.n.infty *= dt;
-  return p.n;
+  gdouble dt = r->dt*r->dt;
+  n.bias = r->out[5]*dt;
+  n.first *= dt;
+  n.second *= dt;
+  n.infty *= dt;
+  g_free (r);
+  return n;
 }
 
 /**
@@ -2360,6 +3993,26 @@ GfsNorm gfs_domain_norm_velocity (GfsDomain * domain,
  * the corresponding @fp fields (@pos and @error) are set.
  */
 GfsDomain * gfs_domain_read (GtsFile * fp)
+{
+  g_return_val_if_fail (fp != NULL, NULL);
+
+  return gfs_domain_read_variables (fp, NULL);
+}
+
+/**
+ * gfs_domain_read_variables:
+ * @fp: a #GtsFile.
+ * @variables: a comma-separated list of variable names or %NULL.
+ *
+ * As gfs_domain_read() but only the variables in @variables are read
+ * from the indexed data file of the domain (if any), the values of
+ * the others are left uninitialised. If @variables is %NULL, all the
+ * variables are read.
+ *
+ * Returns: the #GfsDomain or %NULL if an error occured, in which case
+ * the corresponding @fp fields (@pos and @error) are set.
+ */
+GfsDomain * gfs_domain_read_variables (GtsFile * fp, const gchar * variables)
 {
   GfsDomain * domain;
 
@@ -2368,7 +4021,10 @@ GfsDomain * gfs_domain_read (GtsFile * fp)
   if (!(domain = GFS_DOMAIN (gts_graph_read (fp))))
     return NULL;
 
+  domain->data_variables = variables ? g_strdup (variables) : NULL;
   (* GFS_DOMAIN_CLASS (GTS_OBJECT (domain)->klass)->post_read) (domain, fp);
+  g_free (domain->data_variables);
+  domain->data_variables = NULL;
   if (fp->type == GTS_ERROR) {
     gts_object_destroy (GTS_OBJECT (domain));
     return NULL;
@@ -2384,8 +4040,52 @@ typedef struct {
   gint pid;
   GfsVariable * newboxp;
   GfsDomain * domain;
+  guint * mask, * offset; /* children of all the boxes (parallel only) */
 } SplitPar;
 
+/* index of the child of the neighboring box touching child (first
+   index) in direction (second index), -1 if both are in the same box */
+static gint split_match[FTT_CELLS][FTT_NEIGHBORS] = {
+#if FTT_2D
+  { -1, 1, 2, -1 },
+  { 0, -1, 3, -1 },
+  { -1, 3, -1, 0 },
+  { 2, -1, -1, 1 }
+#else /* 3D */
+  { -1, 1, 2, -1, 4, -1 },
+  { 0, -1, 3, -1, 5, -1 },
+  { -1, 3, -1, 0, 6, -1 },
+  { 2, -1, -1, 1, 7, -1 },
+  { -1, 5, 6, -1, -1, 0 },
+  { 4, -1, 7, -1, -1, 1 },
+  { -1, 7, -1, 4, -1, 2 },
+  { 6, -1, -1, 5, -1, 3 },	     
+#endif /* 3D */
+};
+
+/* In parallel, the id of the box created from child @i of box @id
+   must be known by all the PEs: the children of all the boxes are
+   numbered consecutively, child refid of box 1 becoming box 1. */
+static guint split_id (SplitPar * p, guint id, guint i)
+{
+  guint refid = FTT_DIMENSION == 2 ? 2 : 6;
+  guint mask = p->mask[id - 1], n = p->offset[id - 1], j;
+
+  if (id == 1 && (mask & (1 << refid))) {
+    if (i == refid)
+      return 1;
+    guint first = 0;
+    while (!(mask & (1 << first)))
+      first++;
+    if (i == first)
+      i = refid;
+  }
+  for (j = 0; j < i; j++)
+    if (mask & (1 << j))
+      n++;
+  return n + 1;
+}
+
 static void box_split (GfsBox * box, SplitPar * p)
 {
   guint refid = FTT_DIMENSION == 2 ? 2 : 6;
@@ -2397,7 +4097,7 @@ static void box_split (GfsBox * box, SplitPar * p)
   p->boxlist = g_slist_prepend (p->boxlist, box);
 
   if (FTT_CELL_IS_LEAF (box->root))
-    ftt_cell_refine_single (box->root, (FttCellInitFunc) gfs_cell_init, domain);
+    ftt_cell_refine_single (box->root, domain->cell_init, domain->cell_init_data);
 
   ftt_cell_children (box->root, &child);
   for (i = 0; i < FTT_CELLS; i++)
@@ -2409,7 +4109,9 @@ static void box_split (GfsBox * box, SplitPar * p)
 	newbox->pid = (p->pid)++;
       else
 	newbox->pid = box->pid;
-      if (box->id == 1 && i == refid)
+      if (p->mask)
+	newbox->id = split_id (p, box->id, i);
+      else if (box->id == 1 && i == refid)
 	newbox->id = 1;
       else
 	newbox->id = (p->bid)++;
@@ -2417,7 +4119,7 @@ static void box_split (GfsBox * box, SplitPar * p)
       GFS_DOUBLE_TO_POINTER (GFS_VALUE (child.c[i], p->newboxp)) = newbox;
 
       if (FTT_CELL_IS_LEAF (child.c[i]))
-	ftt_cell_refine_single (child.c[i], (FttCellInitFunc) gfs_cell_init, domain);
+	ftt_cell_refine_single (child.c[i], domain->cell_init, domain->cell_init_data);
     }
 
   for (d = 0; d < FTT_NEIGHBORS; d++)
@@ -2438,6 +4140,13 @@ static void box_split (GfsBox * box, SplitPar * p)
 	    GFS_BOUNDARY_PERIODIC (newboundary)->matching = 
 	      GFS_BOUNDARY_PERIODIC (boundary)->matching;
 	    GFS_BOUNDARY_PERIODIC (newboundary)->d = GFS_BOUNDARY_PERIODIC (boundary)->d;
+	    if (GFS_IS_BOUNDARY_MPI (newboundary)) {
+	      GfsBoundaryMpi * mpi = GFS_BOUNDARY_MPI (boundary);
+	      gint ci = split_match[FTT_CELL_ID (child.c[i])][d];
+	      g_assert (p->mask && ci >= 0);
+	      GFS_BOUNDARY_MPI (newboundary)->process = mpi->process;
+	      GFS_BOUNDARY_MPI (newboundary)->id = split_id (p, mpi->id, ci);
+	    }
 	  }
 	  else
 	    gfs_object_clone (GTS_OBJECT (boundary), GTS_OBJECT (newboundary));
@@ -2474,26 +4183,10 @@ static void box_link (GfsBox * box, SplitPar * p)
        gts_container_add (GTS_CONTAINER (p->domain), GTS_CONTAINEE (newbox));
 
        for (d = 0; d < FTT_NEIGHBORS; d++)
-	 if (newbox->neighbor[d] != NULL && GFS_IS_BOUNDARY_PERIODIC (newbox->neighbor[d])) {
+	 if (newbox->neighbor[d] != NULL && GFS_IS_BOUNDARY_PERIODIC (newbox->neighbor[d]) &&
+	     !GFS_IS_BOUNDARY_MPI (newbox->neighbor[d])) {
 	   GfsBox * matching =  GFS_BOUNDARY_PERIODIC (newbox->neighbor[d])->matching;
-	   static gint match[FTT_CELLS][FTT_NEIGHBORS] = {
-#if FTT_2D
-	     { -1, 1, 2, -1 },
-	     { 0, -1, 3, -1 },
-	     { -1, 3, -1, 0 },
-	     { 2, -1, -1, 1 }
-#else /* 3D */
-	     { -1, 1, 2, -1, 4, -1 },
-	     { 0, -1, 3, -1, 5, -1 },
-	     { -1, 3, -1, 0, 6, -1 },
-	     { 2, -1, -1, 1, 7, -1 },
-	     { -1, 5, 6, -1, -1, 0 },
-	     { 4, -1, 7, -1, -1, 1 },
-	     { -1, 7, -1, 4, -1, 2 },
-	     { 6, -1, -1, 5, -1, 3 },	     
-#endif /* 3D */
-	   };
-	   gint ci = match[FTT_CELL_ID (child.c[i])][d];
+	   gint ci = split_match[FTT_CELL_ID (child.c[i])][d];
 	   g_assert (ci >= 0);
 	   FttCellChildren neighbors;
 	   ftt_cell_children (matching->root, &neighbors);
@@ -2562,6 +4255,33 @@ static void get_ref_pos (GfsBox * box, FttVector * pos)
     ftt_cell_pos (box->root, pos);
 }
 
+#ifdef HAVE_MPI
+static void box_children_mask (GfsBox * box, guint * mask)
+{
+  guint m = 0;
+  if (FTT_CELL_IS_LEAF (box->root))
+    m = (1 << FTT_CELLS) - 1;
+  else {
+    FttCellChildren child;
+    guint i;
+    ftt_cell_children (box->root, &child);
+    for (i = 0; i < FTT_CELLS; i++)
+      if (child.c[i])
+	m |= 1 << i;
+  }
+  mask[box->id - 1] = m;
+}
+
+static void box_is_rotated (GfsBox * box, gint * rotated)
+{
+  FttDirection d;
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY_MPI (box->neighbor[d]) &&
+	GFS_BOUNDARY_PERIODIC (box->neighbor[d])->rotate != 0.)
+      *rotated = TRUE;
+}
+#endif /* HAVE_MPI */
+
 /**
  * gfs_domain_split:
  * @domain: a #GfsDomain.
@@ -2572,12 +4292,47 @@ static void get_ref_pos (GfsBox * box, FttVector * pos)
  * Splits each box of @domain into its (4 in 2D, 8 in 3D)
  * children. The corresponding newly created boxes are added to the
  * graph and the parent boxes are destroyed.
+ *
+ * In parallel, all the PEs must call this function, @one_box_per_pe
+ * must be %FALSE and rotated parallel boundaries are not supported.
  */
 void gfs_domain_split (GfsDomain * domain, gboolean one_box_per_pe)
 {
   SplitPar p;
 
   g_return_if_fail (domain != NULL);
+  g_return_if_fail (domain->pid < 0 || !one_box_per_pe);
+
+  p.mask = p.offset = NULL;
+#ifdef HAVE_MPI
+  if (domain->pid >= 0) {
+    gint rotated = FALSE;
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_is_rotated, &rotated);
+    gfs_all_reduce (domain, rotated, MPI_INT, MPI_MAX);
+    if (rotated) {
+      if (domain->pid == 0)
+	g_warning ("gfs_domain_split(): rotated parallel boundaries are not supported");
+      return;
+    }
+
+    guint nb = gts_container_size (GTS_CONTAINER (domain)), i;
+    gfs_all_reduce (domain, nb, MPI_UNSIGNED, MPI_SUM);
+    guint * mask = g_malloc0 (nb*sizeof (guint));
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_children_mask, mask);
+    p.mask = g_malloc (nb*sizeof (guint));
+    MPI_Allreduce (mask, p.mask, nb, MPI_UNSIGNED, MPI_BOR, MPI_COMM_WORLD);
+    g_free (mask);
+    p.offset = g_malloc (nb*sizeof (guint));
+    p.offset[0] = 0;
+    for (i = 1; i < nb; i++) {
+      guint j, n = 0;
+      for (j = 0; j < FTT_CELLS; j++)
+	if (p.mask[i - 1] & (1 << j))
+	  n++;
+      p.offset[i] = p.offset[i - 1] + n;
+    }
+  }
+#endif /* HAVE_MPI */
 
   p.newboxp = gfs_temporary_variable (domain);
   gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, 1,
@@ -2595,7 +4350,22 @@ void gfs_domain_split (GfsDomain * domain, gboolean one_box_per_pe)
 
   gfs_domain_match (domain);
   domain->rootlevel++;
-  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) get_ref_pos, &domain->refpos);
+  if (p.mask) {
+#ifdef HAVE_MPI
+    /* box 1 belongs to a single PE */
+    FttVector pos = { 0., 0., 0. };
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) get_ref_pos, &pos);
+    MPI_Allreduce (&pos, &domain->refpos, 3, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif /* HAVE_MPI */
+    g_free (p.mask);
+    g_free (p.offset);
+  }
+  else
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) get_ref_pos, &domain->refpos);
+  if (domain->array) {
+    gfs_locate_array_destroy (domain->array);
+    domain->array = gfs_locate_array_new (domain);
+  }
 }
 
 /**
@@ -2906,10 +4676,30 @@ static void minimum_cfl (FttCell * cell, CflData * p)
 gdouble gfs_domain_cfl (GfsDomain * domain,
 			FttTraverseFlags flags,
 			gint max_depth)
+{
+  g_return_val_if_fail (domain != NULL, 0.);
+
+  return gfs_domain_cfl_end (gfs_domain_cfl_begin (domain, flags, max_depth));
+}
+
+/**
+ * gfs_domain_cfl_begin:
+ * @domain: a #GfsDomain.
+ * @flags: which types of cells are to be visited.
+ * @max_depth: maximum depth of the traversal.
+ *
+ * Computes the local time scale (see gfs_domain_cfl()) and starts its
+ * reduction over all the PEs.
+ *
+ * Returns: a new #GfsReduction.
+ */
+GfsReduction * gfs_domain_cfl_begin (GfsDomain * domain,
+				     FttTraverseFlags flags,
+				     gint max_depth)
 {
   CflData p;
 
-  g_return_val_if_fail (domain != NULL, 0.);
+  g_return_val_if_fail (domain != NULL, NULL);
 
   p.cfl = G_MAXDOUBLE;
   p.v = gfs_domain_velocity (domain);
@@ -2918,8 +4708,25 @@ gdouble gfs_domain_cfl (GfsDomain * domain,
 			    (FttFaceTraverseFunc) minimum_mac_cfl, &p);
   gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, flags, max_depth, 
 			    (FttCellTraverseFunc) minimum_cfl, &p);
-  gfs_all_reduce (domain, p.cfl, MPI_DOUBLE, MPI_MIN);
-  return sqrt (p.cfl);
+  return gfs_domain_reduce_begin (domain, &p.cfl, 1, GFS_REDUCE_MIN);
+}
+
+/**
+ * gfs_domain_cfl_end:
+ * @r: a #GfsReduction returned by gfs_domain_cfl_begin().
+ *
+ * Waits for the completion of @r and frees it.
+ *
+ * Returns: the minimum time scale over all the PEs.
+ */
+gdouble gfs_domain_cfl_end (GfsReduction * r)
+{
+  gdouble cfl;
+
+  g_return_val_if_fail (r != NULL, 0.);
+
+  gfs_domain_reduce_end (r, &cfl);
+  return sqrt (cfl);
 }
 
 /**
@@ -2927,7 +4734,8 @@ gdouble gfs_domain_cfl (GfsDomain * domain,
  * @cell: a #FttCell.
  * @domain: a #GfsDomain containing @cell.
  *
- * Allocates the memory for fluid state data associated to @cell or its children.
+ * Allocates the memory for fluid state data associated to @cell or
+ * its children from the #GfsStatePool of @domain.
  */
 void gfs_cell_init (FttCell * cell, GfsDomain * domain)
 {
@@ -2936,7 +4744,7 @@ void gfs_cell_init (FttCell * cell, GfsDomain * domain)
 
   if (FTT_CELL_IS_LEAF (cell)) {
     g_return_if_fail (cell->data == NULL);
-    cell->data = g_malloc0 (gfs_domain_variables_size (domain));
+    cell->data = gfs_state_pool_alloc (domain->pool);
   }
   else {
     FttCellChildren child;
@@ -2945,12 +4753,17 @@ void gfs_cell_init (FttCell * cell, GfsDomain * domain)
     ftt_cell_children (cell, &child);
     for (n = 0; n < FTT_CELLS; n++) {
       g_return_if_fail (child.c[n]->data == NULL);
-      child.c[n]->data = g_malloc0 (gfs_domain_variables_size (domain));
+      child.c[n]->data = gfs_state_pool_alloc (domain->pool);
     }
     if (GFS_CELL_IS_BOUNDARY (cell))
       for (n = 0; n < FTT_CELLS; n++)
 	child.c[n]->flags |= GFS_FLAG_BOUNDARY;
   }
+  domain->topology++;
+  if (domain->leaves)
+    domain->leaves->dirty = TRUE;
+  if (domain->cells)
+    domain->cells->dirty = TRUE;
 }
 
 /**
@@ -2958,7 +4771,9 @@ void gfs_cell_init (FttCell * cell, GfsDomain * domain)
  * @cell: a #FttCell.
  * @domain: a #GfsDomain containing @cell.
  *
- * Re-allocates the memory for fluid state data associated to @cell.
+ * Re-allocates the memory for fluid state data associated to @cell,
+ * while the #GfsStatePool of @domain is being resized (see
+ * gfs_state_pool_resize()).
  */
 void gfs_cell_reinit (FttCell * cell, GfsDomain * domain)
 {
@@ -2966,7 +4781,7 @@ void gfs_cell_reinit (FttCell * cell, GfsDomain * domain)
   g_return_if_fail (cell->data != NULL);
   g_return_if_fail (domain != NULL);
 
-  cell->data = g_realloc (cell->data, gfs_domain_variables_size (domain));
+  cell->data = gfs_state_pool_realloc (domain->pool, cell->data);
 }
 
 /**
@@ -3268,6 +5083,76 @@ void gfs_cell_read_binary (FttCell * cell, GtsFile * fp, GfsDomain * domain)
   }
 }
 
+/**
+ * gfs_cell_write_raw:
+ * @cell: a #FttCell.
+ * @fp: a file pointer.
+ * @domain: the #GfsDomain containing @cell.
+ *
+ * Writes in @fp the whole state vector of @cell (and its solid
+ * fraction data if any) as raw bytes. This is much faster than
+ * gfs_cell_write_binary() but the data can only be read back by a
+ * domain with the same variables layout, using gfs_cell_read_raw().
+ * This is used to migrate boxes between the PEs of a parallel
+ * simulation. The size of the state vectors is written in the header
+ * of each box and checked when reading.
+ */
+void gfs_cell_write_raw (const FttCell * cell, FILE * fp, GfsDomain * domain)
+{
+  g_return_if_fail (cell != NULL);
+  g_return_if_fail (fp != NULL);
+  g_return_if_fail (domain != NULL);
+
+  GfsStateVector * s = GFS_STATE (cell);
+  guint solid = (s->solid != NULL);
+  fwrite (&solid, sizeof (guint), 1, fp);
+  if (solid)
+    fwrite (s->solid, sizeof (GfsSolidVector), 1, fp);
+  fwrite (s, gfs_domain_variables_size (domain), 1, fp);
+}
+
+/**
+ * gfs_cell_read_raw:
+ * @cell: a #FttCell.
+ * @fp: a #GtsFile.
+ * @domain: the #GfsDomain containing @cell.
+ *
+ * Reads from @fp the state vector of @cell written by
+ * gfs_cell_write_raw().
+ */
+void gfs_cell_read_raw (FttCell * cell, GtsFile * fp, GfsDomain * domain)
+{
+  guint solid;
+  GfsSolidVector * s = NULL;
+
+  g_return_if_fail (cell != NULL);
+  g_return_if_fail (fp != NULL);
+  g_return_if_fail (domain != NULL);
+
+  if (gts_file_read (fp, &solid, sizeof (guint), 1) != 1) {
+    gts_file_error (fp, "expecting an integer (solid)");
+    return;
+  }
+  if (solid) {
+    s = g_malloc (sizeof (GfsSolidVector));
+    if (gts_file_read (fp, s, sizeof (GfsSolidVector), 1) != 1) {
+      gts_file_error (fp, "expecting a solid vector");
+      g_free (s);
+      return;
+    }
+    s->merged = NULL;
+  }
+
+  gfs_cell_init (cell, domain);
+  if (gts_file_read (fp, cell->data, gfs_domain_variables_size (domain), 1) != 1) {
+    gts_file_error (fp, "expecting a state vector");
+    g_free (s);
+    GFS_STATE (cell)->solid = NULL;
+    return;
+  }
+  GFS_STATE (cell)->solid = s;
+}
+
 static void box_realloc (GfsBox * box, GfsDomain * domain)
 {
   FttDirection d;
@@ -3298,7 +5183,11 @@ guint gfs_domain_alloc (GfsDomain * domain)
     i++;
   if (i == domain->allocated->len) {
     g_array_set_size (domain->allocated, domain->allocated->len + 1);
+    gfs_state_pool_resize (domain->pool, gfs_domain_variables_size (domain));
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_realloc, domain);
+    gfs_state_pool_release (domain->pool);
+    if (domain->pool->retired)
+      g_warning ("%u state vectors could not be reallocated", domain->pool->retired_used);
   }
   g_array_index (domain->allocated, gboolean, i) = TRUE;
   return i;
@@ -3320,6 +5209,123 @@ void gfs_domain_free (GfsDomain * domain, guint i)
   g_array_index (domain->allocated, gboolean, i) = FALSE;
 }
 
+static void temporary_reset (GfsVariable * v)
+{
+  FttComponent c;
+
+  g_free (v->name);
+  v->name = NULL;
+  g_free (v->description);
+  v->description = NULL;
+  if (v->sources) {
+    gts_object_destroy (GTS_OBJECT (v->sources));
+    v->sources = NULL;
+  }
+  if (v->surface_bc) {
+    gts_object_destroy (GTS_OBJECT (v->surface_bc));
+    v->surface_bc = NULL;
+  }
+  if (v->default_bc) {
+    gts_object_destroy (GTS_OBJECT (v->default_bc));
+    v->default_bc = NULL;
+  }
+  v->centered = FALSE;
+  v->component = FTT_DIMENSION;
+  for (c = 0; c < FTT_DIMENSION; c++)
+    v->vector[c] = NULL;
+  memset (v->face, 0, sizeof (v->face));
+  v->fine_coarse = (GfsVariableFineCoarseFunc) gfs_get_from_below_intensive;
+  v->coarse_fine = (GfsVariableFineCoarseFunc) gfs_cell_coarse_fine;
+  v->cleanup = NULL;
+  v->units = 0.;
+  v->face_source = FALSE;
+  v->orientation = 0.;
+  v->even = FALSE;
+}
+
+/**
+ * gfs_domain_temporary_get:
+ * @domain: a #GfsDomain.
+ *
+ * Returns a temporary variable taken from the pool of @domain. The
+ * memory location of the variable is kept allocated when it is
+ * released, so that repeated calls do not reallocate the state
+ * vectors of the cells.
+ *
+ * The variable must be returned to the pool using
+ * gfs_domain_temporary_release() rather than destroyed. Its values
+ * are undefined.
+ *
+ * Returns: a #GfsVariable.
+ */
+GfsVariable * gfs_domain_temporary_get (GfsDomain * domain)
+{
+  GfsVariable * v;
+
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  if (domain->ntemporary == domain->temporary->len)
+    g_ptr_array_add (domain->temporary, gfs_temporary_variable (domain));
+  v = g_ptr_array_index (domain->temporary, domain->ntemporary++);
+  if (domain->ntemporary > domain->temporary_peak)
+    domain->temporary_peak = domain->ntemporary;
+  return v;
+}
+
+/**
+ * gfs_domain_temporary_mark:
+ * @domain: a #GfsDomain.
+ *
+ * The pool of temporary variables follows a stack discipline: a scope
+ * starts with a call to this function and ends with a call to
+ * gfs_domain_temporary_release() which returns all the variables
+ * obtained within the scope.
+ *
+ * Returns: the current top of the temporary variable stack of @domain.
+ */
+guint gfs_domain_temporary_mark (GfsDomain * domain)
+{
+  g_return_val_if_fail (domain != NULL, 0);
+
+  return domain->ntemporary;
+}
+
+/**
+ * gfs_domain_temporary_release:
+ * @domain: a #GfsDomain.
+ * @mark: a value returned by gfs_domain_temporary_mark().
+ *
+ * Returns to the pool all the temporary variables obtained from
+ * @domain since the call to gfs_domain_temporary_mark() which
+ * returned @mark.
+ */
+void gfs_domain_temporary_release (GfsDomain * domain, guint mark)
+{
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (mark <= domain->ntemporary);
+
+  while (domain->ntemporary > mark)
+    temporary_reset (g_ptr_array_index (domain->temporary, --domain->ntemporary));
+}
+
+/**
+ * gfs_domain_temporary_reserve:
+ * @domain: a #GfsDomain.
+ * @n: a number of temporary variables.
+ *
+ * Makes sure that the pool of @domain contains at least @n temporary
+ * variables. This is best done before any cell is created, using for
+ * example the peak usage reported by #GfsOutputTiming for a previous
+ * run.
+ */
+void gfs_domain_temporary_reserve (GfsDomain * domain, guint n)
+{
+  g_return_if_fail (domain != NULL);
+
+  while (domain->temporary->len < n)
+    g_ptr_array_add (domain->temporary, gfs_temporary_variable (domain));
+}
+
 /**
  * gfs_domain_add_variable:
  * @domain: a #GfsDomain.
@@ -4134,18 +6140,20 @@ void gfs_domain_remove_specks (GfsDomain * domain)
 void gfs_domain_timer_start (GfsDomain * domain, const gchar * name)
 {
   GfsTimer * t;
+  gchar * key;
 
   g_return_if_fail (domain != NULL);
   g_return_if_fail (name != NULL);
 
-  t = g_hash_table_lookup (domain->timers, name);
-  if (t == NULL) {
+  if (!g_hash_table_lookup_extended (domain->timers, name, (gpointer *) &key, (gpointer *) &t)) {
     t = g_malloc (sizeof (GfsTimer));
     gts_range_init (&t->r);
-    g_hash_table_insert (domain->timers, g_strdup (name), t);
+    key = g_strdup (name);
+    g_hash_table_insert (domain->timers, key, t);
   }
   else
     g_return_if_fail (t->start < 0.);
+  domain->phases = g_slist_prepend (domain->phases, key);
   t->start = gfs_clock_elapsed (domain->timer);
   gfs_debug ("starting %s at %g", name, t->start);
 }
@@ -4161,15 +6169,17 @@ void gfs_domain_timer_start (GfsDomain * domain, const gchar * name)
 void gfs_domain_timer_stop (GfsDomain * domain, const gchar * name)
 {
   GfsTimer * t;
+  gchar * key;
   gdouble end;
 
   g_return_if_fail (domain != NULL);
   end = gfs_clock_elapsed (domain->timer);
   g_return_if_fail (name != NULL);
 
-  t = g_hash_table_lookup (domain->timers, name);
-  g_return_if_fail (t != NULL);
+  g_return_if_fail (g_hash_table_lookup_extended (domain->timers, name,
+						  (gpointer *) &key, (gpointer *) &t));
   g_return_if_fail (t->start >= 0.);
+  domain->phases = g_slist_remove (domain->phases, key);
 
   gts_range_add_value (&t->r, end - t->start);
   gts_range_update (&t->r);
@@ -4177,6 +6187,87 @@ void gfs_domain_timer_stop (GfsDomain * domain, const gchar * name)
   t->start = -1.;
 }
 
+/**
+ * gfs_domain_phase:
+ * @domain: a #GfsDomain.
+ *
+ * Returns: the name of the innermost running timer of @domain,
+ * ignoring the timers of the boundary conditions (see
+ * #GfsDomain.profile_bc), or "none".
+ */
+const gchar * gfs_domain_phase (GfsDomain * domain)
+{
+  GSList * i;
+
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  i = domain->phases;
+  while (i) {
+    const gchar * name = i->data;
+    if (strcmp (name, "bc") && strcmp (name, "face_bc") && strcmp (name, "match"))
+      return name;
+    i = i->next;
+  }
+  return "none";
+}
+
+static void mpi_profile_destroy (GfsMpiProfile * p)
+{
+  g_free (p->phase);
+  g_free (p->variable);
+  g_free (p);
+}
+
+/**
+ * gfs_domain_mpi_profile_init:
+ * @domain: a #GfsDomain.
+ *
+ * Starts recording statistics for each message exchanged by the
+ * parallel boundaries of @domain (see gfs_domain_mpi_profile()).
+ */
+void gfs_domain_mpi_profile_init (GfsDomain * domain)
+{
+  g_return_if_fail (domain != NULL);
+
+  if (domain->mpi_profile == NULL)
+    domain->mpi_profile = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						 (GDestroyNotify) mpi_profile_destroy);
+}
+
+/**
+ * gfs_domain_mpi_profile:
+ * @domain: a #GfsDomain.
+ * @v: the variable exchanged or %NULL.
+ * @process: the neighbouring process.
+ *
+ * Returns: the statistics of the messages exchanged with @process
+ * for @v during the current phase (see gfs_domain_phase()), or %NULL
+ * if gfs_domain_mpi_profile_init() has not been called.
+ */
+GfsMpiProfile * gfs_domain_mpi_profile (GfsDomain * domain,
+					GfsVariable * v,
+					gint process)
+{
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  if (domain->mpi_profile == NULL)
+    return NULL;
+
+  const gchar * phase = gfs_domain_phase (domain);
+  const gchar * variable = v == NULL ? "(topology)" : v->name ? v->name : "(temporary)";
+  gchar key[256];
+  g_snprintf (key, 256, "%s %s %d", phase, variable, process);
+  GfsMpiProfile * p = g_hash_table_lookup (domain->mpi_profile, key);
+  if (p == NULL) {
+    p = g_malloc0 (sizeof (GfsMpiProfile));
+    p->phase = g_strdup (phase);
+    p->variable = g_strdup (variable);
+    p->process = process;
+    g_hash_table_insert (domain->mpi_profile, g_strdup (key), p);
+  }
+  return p;
+}
+
 static void cell_combine_traverse (FttCell * cell,
 				   FttCell * parent,
 				   FttCellCombineTraverseFunc inside,
@@ -4586,6 +6677,17 @@ static void unlink_box (GfsBox * box, gint * dest)
     }
 }
 
+static void count_migrated (FttCell * cell, gulong * n)
+{
+  (*n)++;
+}
+
+static void box_count_cells (GfsBox * box, gulong * n)
+{
+  ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+		     (FttCellTraverseFunc) count_migrated, n);
+}
+
 static void setup_binary_IO (GfsDomain * domain)
 {
   /* make sure that all the variables are sent */
@@ -4609,6 +6711,9 @@ static void setup_binary_IO (GfsDomain * domain)
  * Send boxes to @dest and removes them from @domain.
  * This is a non-blocking operation.
  *
+ * If @domain->raw is set, the cell data is sent as raw state vectors
+ * (see gfs_cell_write_raw()) rather than variable by variable.
+ *
  * Returns: a #GfsRequest which must be cleared using gfs_wait().
  */
 GfsRequest * gfs_send_boxes (GfsDomain * domain, GSList * boxes, int dest)
@@ -4616,9 +6721,13 @@ GfsRequest * gfs_send_boxes (GfsDomain * domain, GSList * boxes, int dest)
   g_return_val_if_fail (domain != NULL, NULL);
   g_return_val_if_fail (dest != domain->pid, NULL);
 
+  GTimer * timer = g_timer_new ();
   g_slist_foreach (boxes, (GFunc) unlink_box, &dest);
+  g_slist_foreach (boxes, (GFunc) box_count_cells, &domain->migrated);
   setup_binary_IO (domain);
   GfsRequest * r = gfs_send_objects (boxes, dest);
+  domain->migration += g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
   g_slist_foreach (boxes, (GFunc) gts_object_destroy, NULL);
   gfs_locate_array_destroy (domain->array);
   domain->array = gfs_locate_array_new (domain);
@@ -4639,8 +6748,11 @@ GSList * gfs_receive_boxes (GfsDomain * domain, int src)
   g_return_val_if_fail (domain != NULL, NULL);
   g_return_val_if_fail (src != domain->pid, NULL);
 
+  GTimer * timer = g_timer_new ();
   setup_binary_IO (domain);
   GSList * boxes = gfs_receive_objects (domain, src);
+  domain->migration += g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
   if (boxes) {
     /* Create array for fast linking of ids to GfsBox pointers */
     GPtrArray * ids = box_ids (domain);
@@ -40,24 +40,150 @@ GSList *         gfs_locate_array_locate  (GfsLocateArray * a,
 					   FttVector * p);
 void             gfs_locate_array_destroy (GfsLocateArray * a);
 
+/* GfsStatePool: Header */
+
+typedef struct _GfsStatePool GfsStatePool;
+
+struct _GfsStatePool {
+  /*< private >*/
+  GSList * slabs, * retired;
+  gchar * top, * end;
+  gpointer free;
+  guint next;
+  gsize retired_size;
+  guint retired_used;
+
+  /*< public >*/
+  gsize size;                     /**< size in bytes of each block */
+  guint nblocks, used;            /**< number of blocks allocated and in use */
+  guint nslabs;                   /**< number of slabs */
+  gulong allocs, frees, resizes;  /**< cumulative counters */
+};
+
+GfsStatePool * gfs_state_pool_new           (gsize size);
+gpointer       gfs_state_pool_alloc         (GfsStatePool * pool);
+void           gfs_state_pool_free          (GfsStatePool * pool,
+					     gpointer block);
+void           gfs_state_pool_resize        (GfsStatePool * pool,
+					     gsize size);
+gpointer       gfs_state_pool_realloc       (GfsStatePool * pool,
+					     gpointer block);
+void           gfs_state_pool_release       (GfsStatePool * pool);
+gdouble        gfs_state_pool_fragmentation (GfsStatePool * pool);
+void           gfs_state_pool_destroy       (GfsStatePool * pool);
+
+/* GfsLeafIndex: Header */
+
+typedef struct _GfsLeafIndex GfsLeafIndex;
+
+struct _GfsLeafIndex {
+  /*< private >*/
+  GfsDomain * domain;
+  GfsVariable * id;
+  GPtrArray * arrays;
+  guint size;
+
+  /*< public >*/
+  FttCell ** cells;    /**< the leaf cells, indexed by their id */
+  guint n;             /**< number of leaf cells */
+  gint * neighbor;     /**< ids of same-level leaf neighbors (FTT_NEIGHBORS per leaf) */
+  FttCell ** neighbors; /**< neighboring cells (FTT_NEIGHBORS per leaf) */
+  guchar * type;       /**< #FttFaceType of each face (FTT_NEIGHBORS per leaf) */
+  gboolean * regular;  /**< whether all the neighbors of a leaf are in @neighbor */
+  guchar * colour;     /**< red-black colour (0 or 1) of each leaf */
+  gdouble * weight;    /**< face weights (FTT_NEIGHBORS per leaf) */
+  guint nregular;      /**< number of regular leaves */
+  gboolean dirty;      /**< whether the index needs updating */
+  gulong updates, kept, added; /**< cumulative counters */
+  gulong lookups, misses;       /**< neighbor lookups served by/missing the table */
+};
+
+#define GFS_LEAF_ARRAY(index, v) ((gdouble *) g_ptr_array_index ((index)->arrays, (v)->i))
+
+GfsLeafIndex * gfs_leaf_index_new          (GfsDomain * domain);
+void           gfs_leaf_index_update       (GfsLeafIndex * index);
+void           gfs_leaf_index_remove       (GfsLeafIndex * index,
+					    FttCell * cell);
+gdouble *      gfs_leaf_index_gather       (GfsLeafIndex * index,
+					    GfsVariable * v);
+void           gfs_leaf_index_scatter      (GfsLeafIndex * index,
+					    GfsVariable * v);
+gdouble *      gfs_leaf_index_gather_weights (GfsLeafIndex * index);
+void           gfs_leaf_index_neighbors    (GfsLeafIndex * index,
+					    const FttCell * cell,
+					    FttCellNeighbors * neighbors);
+FttCell *      gfs_leaf_index_neighbor     (GfsLeafIndex * index,
+					    const FttCell * cell,
+					    FttDirection d);
+void           gfs_leaf_index_destroy      (GfsLeafIndex * index);
+
+/* GfsCellCache: Header */
+
+typedef struct _GfsCellCache GfsCellCache;
+
+struct _GfsCellCache {
+  /*< private >*/
+  GfsDomain * domain;
+  GHashTable * destroyed;
+  guint traversing;
+
+  /*< public >*/
+  GPtrArray * leaves;  /**< the leaf cells in Morton order */
+  GPtrArray * levels;  /**< the cells of each level in Morton order */
+  gboolean dirty;      /**< whether the arrays need rebuilding */
+  gulong builds, flat; /**< number of rebuilds and of flat traversals */
+};
+
+GfsCellCache * gfs_cell_cache_new          (GfsDomain * domain);
+void           gfs_cell_cache_update       (GfsCellCache * cache);
+void           gfs_cell_cache_remove       (GfsCellCache * cache,
+					    FttCell * cell);
+gboolean       gfs_cell_cache_traverse     (GfsCellCache * cache,
+					    FttTraverseFlags flags,
+					    gint max_depth,
+					    FttCellTraverseFunc func,
+					    gpointer data);
+void           gfs_cell_cache_destroy      (GfsCellCache * cache);
+
 /* GfsDomain: Header */
 
 typedef struct _GfsDomainClass     GfsDomainClass;
 typedef struct _GfsDiffusion       GfsDiffusion;
 typedef struct _GfsSourceDiffusion GfsSourceDiffusion;
 typedef struct _GfsTimer           GfsTimer;
+typedef struct _GfsMpiProfile      GfsMpiProfile;
+typedef struct _GfsOverlap         GfsOverlap;
 
 struct _GfsTimer {
   GtsRange r;
   gdouble start;
 };
 
+/* Statistics of the messages exchanged with a given neighbour, for a
+   given variable and during a given phase (timer) */
+struct _GfsMpiProfile {
+  gchar * phase, * variable;
+  gint process;
+  gulong bytes, messages;
+  gdouble wait;  /**< time spent waiting for completion */
+  gdouble late;  /**< time spent waiting for messages not yet sent */
+};
+
+/* Overlap of communications with computations for a given phase
+   (see gfs_traverse_and_bc()) */
+struct _GfsOverlap {
+  gulong n;
+  gdouble compute; /**< time spent computing while messages are in flight */
+  gdouble wait;    /**< time spent waiting for the messages afterwards */
+};
+
 struct _GfsDomain {
   GtsWGraph parent;
 
   int pid;
   GfsClock * timer;
   GHashTable * timers;
+  GSList * phases;          /**< names of the running timers, innermost first */
 
   GtsRange timestep;
   GtsRange size;
@@ -66,12 +192,24 @@ struct _GfsDomain {
 
   GtsRange mpi_messages;
   GtsRange mpi_wait;
+  gulong mpi_requests;
+  GHashTable * mpi_profile; /**< per-exchange statistics (%NULL if disabled) */
+  GHashTable * overlaps;    /**< #GfsOverlap statistics of each phase */
+  gulong migrated;      /**< number of cells migrated by gfs_send_boxes() */
+  gdouble migration;    /**< time spent packing and unpacking migrated boxes */
+  gulong reshapes;      /**< number of calls to gfs_domain_reshape_dirty() */
+  gdouble reshaped;     /**< number of dirty cells repaired by gfs_domain_reshape_dirty() */
+  gulong topology;      /**< incremented each time a cell is created or destroyed */
+  gboolean band;        /**< whether VOF reconstruction is restricted to the interfacial band */
+  gboolean reshape_dirty; /**< whether only the neighborhoods of the adapted cells are reshaped */
+  gboolean fused;       /**< whether the VOF concentrations are advected in a single sweep */
 
   guint rootlevel;
   FttVector refpos;
   FttVector lambda;
 
   GArray * allocated;
+  GfsStatePool * pool; /**< allocator for the state vectors of the cells */
   GSList * variables;
   GSList * derived_variables;
 
@@ -79,7 +217,10 @@ struct _GfsDomain {
 
   GSList * variables_io;
   gboolean binary;
+  gboolean raw;         /**< whether binary cell data is written as raw state vectors */
   gint max_depth_write;
+  gchar * data;         /**< indexed data file containing the cell data of the boxes */
+  gchar * data_variables; /**< variables read from @data (all if %NULL) */
 
   FttCellInitFunc cell_init;
   gpointer cell_init_data;
@@ -89,6 +230,23 @@ struct _GfsDomain {
   gpointer array;
 
   gboolean overlap; /* whether to overlap MPI communications with computation */
+  gboolean shared;  /**< whether to use shared memory between the PEs of a node */
+  gpointer mpi_shared;
+  gulong mpi_shared_messages; /**< number of messages sent through shared memory */
+
+  gboolean soa;         /**< whether to use structure-of-arrays leaf storage */
+  GfsLeafIndex * leaves; /**< the leaf index used when @soa is set */
+
+  gboolean sfc;         /**< whether to use space-filling-curve ordering */
+  GfsCellCache * cells; /**< the Morton-ordered cell arrays used when @sfc is set */
+
+  guint nthreads;       /**< number of threads used by thread-safe traversals */
+  gulong threaded;      /**< number of threaded traversals */
+
+  GPtrArray * temporary; /**< pool of temporary variables, see gfs_domain_temporary_get() */
+  guint ntemporary;      /**< number of pooled temporary variables in use */
+  guint temporary_peak;  /**< maximum of @ntemporary */
+  guint temporaries;     /**< number of temporary variables reserved when reading */
 
   /* coordinate metrics */
   gpointer metric_data;
@@ -213,6 +371,13 @@ void         gfs_domain_bc                    (GfsDomain * domain,
 					       FttTraverseFlags flags,
 					       gint max_depth,
 					       GfsVariable * v);
+void         gfs_domain_bc_dirty              (GfsDomain * domain,
+					       GfsVariable * v,
+					       GHashTable * dirty);
+void         gfs_domain_bc_multi              (GfsDomain * domain,
+					       FttTraverseFlags flags,
+					       gint max_depth,
+					       GSList * list);
 void         gfs_domain_copy_bc               (GfsDomain * domain,
 					       FttTraverseFlags flags,
 					       gint max_depth,
@@ -249,11 +414,16 @@ void         gfs_domain_face_bc               (GfsDomain * domain,
 					       FttComponent c,
 					       GfsVariable * v);
 void         gfs_domain_match                 (GfsDomain * domain);
+gboolean     gfs_domain_match_dirty           (GfsDomain * domain,
+					       GHashTable * dirty);
 void         gfs_domain_forget_boundary       (GfsDomain * domain, 
 					       GfsBoundary * boundary);
 void         gfs_domain_surface_bc            (GfsDomain * domain,
 					       GfsVariable * v);
 guint        gfs_domain_depth                 (GfsDomain * domain);
+GfsLeafIndex * gfs_domain_leaf_index          (GfsDomain * domain);
+guint        gfs_domain_sfc_partition         (GfsDomain * domain,
+					       guint np);
 GtsRange     gfs_domain_stats_variable        (GfsDomain * domain,
 					       GfsVariable * v,
 					       FttTraverseFlags flags,
@@ -285,6 +455,8 @@ GfsNorm      gfs_domain_norm_velocity         (GfsDomain * domain,
 					       FttTraverseFlags flags,
 					       gint max_depth);
 GfsDomain *  gfs_domain_read                  (GtsFile * fp);
+GfsDomain *  gfs_domain_read_variables        (GtsFile * fp,
+					       const gchar * variables);
 void         gfs_domain_split                 (GfsDomain * domain,
 					       gboolean one_box_per_pe);
 FttCell *    gfs_domain_locate                (GfsDomain * domain,
@@ -311,6 +483,31 @@ guint        gfs_domain_size                  (GfsDomain * domain,
 gdouble      gfs_domain_cfl                   (GfsDomain * domain,
 					       FttTraverseFlags flags,
 					       gint max_depth);
+
+typedef enum {
+  GFS_REDUCE_SUM,
+  GFS_REDUCE_MIN,
+  GFS_REDUCE_MAX
+} GfsReduceOp;
+
+typedef struct _GfsReduction GfsReduction;
+
+GfsReduction * gfs_domain_reduce_begin        (GfsDomain * domain,
+					       const gdouble * values,
+					       guint n,
+					       GfsReduceOp op);
+void         gfs_domain_reduce_end            (GfsReduction * r,
+					       gdouble * values);
+GfsReduction * gfs_domain_norm_residual_begin (GfsDomain * domain,
+					       FttTraverseFlags flags,
+					       gint max_depth,
+					       gdouble dt,
+					       GfsVariable * res);
+GfsNorm      gfs_domain_norm_residual_end     (GfsReduction * r);
+GfsReduction * gfs_domain_cfl_begin           (GfsDomain * domain,
+					       FttTraverseFlags flags,
+					       gint max_depth);
+gdouble      gfs_domain_cfl_end               (GfsReduction * r);
 void         gfs_cell_init                    (FttCell * cell,
 					       GfsDomain * domain);
 void         gfs_cell_reinit                  (FttCell * cell, 
@@ -332,9 +529,21 @@ void         gfs_cell_read_binary             (FttCell * cell,
 void         gfs_cell_write_binary            (const FttCell * cell, 
 					       FILE * fp,
 					       GSList * variables);
+void         gfs_cell_read_raw                (FttCell * cell, 
+					       GtsFile * fp,
+					       GfsDomain * domain);
+void         gfs_cell_write_raw               (const FttCell * cell, 
+					       FILE * fp,
+					       GfsDomain * domain);
 guint        gfs_domain_alloc                 (GfsDomain * domain);
 void         gfs_domain_free                  (GfsDomain * domain, 
 					       guint i);
+GfsVariable * gfs_domain_temporary_get        (GfsDomain * domain);
+guint        gfs_domain_temporary_mark        (GfsDomain * domain);
+void         gfs_domain_temporary_release     (GfsDomain * domain,
+					       guint mark);
+void         gfs_domain_temporary_reserve     (GfsDomain * domain,
+					       guint n);
 GfsVariable * gfs_domain_add_variable         (GfsDomain * domain, 
 					       const gchar * name,
 					       const gchar * description);
@@ -364,6 +573,11 @@ void         gfs_domain_timer_start           (GfsDomain * domain,
 					       const gchar * name);
 void         gfs_domain_timer_stop            (GfsDomain * domain, 
 					       const gchar * name);
+const gchar * gfs_domain_phase                (GfsDomain * domain);
+void         gfs_domain_mpi_profile_init      (GfsDomain * domain);
+GfsMpiProfile * gfs_domain_mpi_profile        (GfsDomain * domain,
+					       GfsVariable * v,
+					       gint process);
 typedef
 void      (* FttCellCombineTraverseFunc)      (FttCell * cell1, 
 					       FttCell * cell2, 
@@ -1954,6 +1954,12 @@ void gfs_cell_cleanup (FttCell * cell, GfsDomain * domain)
   g_return_if_fail (domain != NULL);
 
   if (cell->data) {
+    domain->topology++;
+    if (domain->leaves)
+      gfs_leaf_index_remove (domain->leaves, cell);
+    if (domain->cells)
+      gfs_cell_cache_remove (domain->cells, cell);
+
     GSList * i = domain->variables;
     while (i) {
       GfsVariable * v = i->data;
@@ -1965,9 +1971,27 @@ void gfs_cell_cleanup (FttCell * cell, GfsDomain * domain)
       g_free (GFS_STATE (cell)->solid);
       GFS_STATE (cell)->solid = NULL;
     }    
+    gfs_state_pool_free (domain->pool, cell->data);
+    cell->data = NULL;
   }
-  g_free (cell->data);
-  cell->data = NULL;
+}
+
+/**
+ * gfs_cell_colour:
+ * @cell: a #FttCell.
+ *
+ * Returns: the red-black colour (0 or 1) of @cell i.e. the parity of
+ * the sum of its integer coordinates on the grid of its level. Two
+ * neighboring cells of the same level always have different colours.
+ */
+guint gfs_cell_colour (const FttCell * cell)
+{
+  g_return_val_if_fail (cell != NULL, 0);
+
+  gdouble h = ftt_cell_size (cell);
+  FttVector p;
+  ftt_cell_pos (cell, &p);
+  return ((gint64) (floor (p.x/h) + floor (p.y/h) + floor (p.z/h))) & 1;
 }
 
 /**
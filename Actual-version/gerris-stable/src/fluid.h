@@ -71,6 +71,14 @@ typedef enum {
 #define GFS_STATE(cell)               ((GfsStateVector *) (cell)->data)
 #define GFS_VALUEI(cell, index)     ((&GFS_STATE (cell)->place_holder)[index])
 
+/* x += a, atomic when compiled with OpenMP i.e. safe to use in
+   functions called by threaded traversals (FTT_TRAVERSE_THREAD_SAFE) */
+#ifdef _OPENMP
+# define GFS_ATOMIC_ADD(x, a) do { _Pragma ("omp atomic") (x) += (a); } while (0)
+#else
+# define GFS_ATOMIC_ADD(x, a) ((x) += (a))
+#endif
+
 #define GFS_FACE_NORMAL_VELOCITY(fa)\
   (GFS_STATE ((fa)->cell)->f[(fa)->d].un)
 #define GFS_FACE_NORMAL_VELOCITY_LEFT(fa)\
@@ -96,6 +104,7 @@ FttCellFace           gfs_cell_face                 (FttCell * cell,
 						     FttDirection d);
 void                  gfs_cell_cleanup              (FttCell * cell,
 						     GfsDomain * domain);
+guint                 gfs_cell_colour               (const FttCell * cell);
 void                  gfs_cell_reset                (FttCell * cell, 
 						     GfsVariable * v);
 void                  gfs_face_reset                (FttCellFace * face,
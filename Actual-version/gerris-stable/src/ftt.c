@@ -21,6 +21,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "ftt.h"
 
 #define  FTT_CELL_IS_DESTROYED(c) (((c)->flags & FTT_FLAG_DESTROYED) != 0)
@@ -899,6 +900,8 @@ void ftt_cell_traverse (FttCell * root,
   if (max_depth >= 0 && ftt_cell_level (root) > max_depth)
     return;
 
+  /* the traversal of a single tree is not threaded */
+  flags &= ~FTT_TRAVERSE_THREAD_SAFE;
   if (flags == FTT_TRAVERSE_ALL) {
     if (order == FTT_PRE_ORDER)
       cell_traverse_pre_order_all (root, max_depth, func, data);
@@ -2003,6 +2006,107 @@ FttCell * ftt_cell_read_binary (GtsFile * fp,
   return root;
 }
 
+static gboolean oct_read_memory (FttCell * parent, 
+				 const gchar ** p,
+				 const gchar * end,
+				 FttCellReadMemoryFunc read,
+				 gpointer data);
+
+static gboolean cell_read_memory (FttCell * cell, 
+				  const gchar ** p,
+				  const gchar * end,
+				  FttCellReadMemoryFunc read,
+				  gpointer data)
+{
+  guint flags;
+
+  if (*p + sizeof (guint) > end)
+    return FALSE;
+  memcpy (&flags, *p, sizeof (guint));
+  *p += sizeof (guint);
+  if (FTT_CELL_ID (cell) != (flags & FTT_FLAG_ID))
+    return FALSE;
+  cell->flags = flags;
+
+  if (read && !FTT_CELL_IS_DESTROYED (cell) && !(* read) (cell, p, end, data))
+    return FALSE;
+
+  if (!FTT_CELL_IS_DESTROYED (cell) && !FTT_CELL_IS_FLAGGED_LEAF (cell))
+    return oct_read_memory (cell, p, end, read, data);
+
+  cell->flags &= ~FTT_FLAG_LEAF;
+  return TRUE;
+}
+
+static gboolean oct_read_memory (FttCell * parent,
+				 const gchar ** p,
+				 const gchar * end,
+				 FttCellReadMemoryFunc read,
+				 gpointer data)
+{
+  FttOct * oct;
+  guint n;
+
+  oct = g_malloc0 (sizeof (FttOct));
+  oct->level = ftt_cell_level (parent);
+  oct->parent = parent;
+  parent->children = oct;
+  ftt_cell_pos (parent, &(oct->pos));
+  
+  for (n = 0; n < FTT_CELLS; n++) {
+    oct->cell[n].parent = oct;
+    oct->cell[n].flags = n;
+  }
+
+  for (n = 0; n < FTT_CELLS; n++)
+    if (!cell_read_memory (&(oct->cell[n]), p, end, read, data))
+      return FALSE;
+  
+  return TRUE;
+}
+
+/**
+ * ftt_cell_read_memory:
+ * @p: a pointer on the start of the data.
+ * @end: the end of the data.
+ * @read: a #FttCellReadMemoryFunc function or %NULL.
+ * @data: user data to pass to @read.
+ *
+ * Reads a tree written by ftt_cell_write_binary() from memory
+ * (e.g. a memory-mapped file) rather than through a #GtsFile. On
+ * return @p points after the data of the tree.
+ *
+ * If an error occurs (i.e. truncated data or incorrect format), @p
+ * is set to %NULL. A possibly incomplete tree is then returned.
+ *
+ * Returns: the root cell of the tree. If not %NULL, the user-defined
+ * function @read is used to read the extra user data associated with
+ * each cell.
+ */
+FttCell * ftt_cell_read_memory (const gchar ** p,
+				const gchar * end,
+				FttCellReadMemoryFunc read,
+				gpointer data)
+{
+  FttCell * root;
+  guint l, depth;
+
+  g_return_val_if_fail (p != NULL && *p != NULL, NULL);
+  g_return_val_if_fail (end != NULL, NULL);
+
+  root = ftt_cell_new (NULL, NULL);
+  if (!cell_read_memory (root, p, end, read, data))
+    *p = NULL;
+
+  depth = ftt_cell_depth (root);
+  for (l = 0; l < depth; l++)
+    ftt_cell_traverse (root, FTT_PRE_ORDER, 
+		       FTT_TRAVERSE_LEVEL|FTT_TRAVERSE_NON_LEAFS, l, 
+		       (FttCellTraverseFunc) set_neighbors, NULL);
+
+  return root;
+}
+
 /**
  * ftt_refine_corner:
  * @cell: a #FttCell.
@@ -66,6 +66,7 @@ typedef enum
   FTT_TRAVERSE_LEVEL          = 1 << 2,
   FTT_TRAVERSE_BOUNDARY_FACES = 1 << 3,
   FTT_TRAVERSE_DESTROYED      = 1 << 4,
+  FTT_TRAVERSE_THREAD_SAFE    = 1 << 5, /* the function can be called by concurrent threads */
   FTT_TRAVERSE_ALL            = FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_NON_LEAFS
 } FttTraverseFlags;
 
@@ -776,6 +777,14 @@ FttCell *            ftt_cell_read                   (GtsFile * fp,
 FttCell *            ftt_cell_read_binary            (GtsFile * fp,
 						      FttCellReadFunc read,
 						      gpointer data);
+typedef gboolean  (* FttCellReadMemoryFunc)          (FttCell * cell,
+						      const gchar ** p,
+						      const gchar * end,
+						      gpointer data);
+FttCell *            ftt_cell_read_memory            (const gchar ** p,
+						      const gchar * end,
+						      FttCellReadMemoryFunc read,
+						      gpointer data);
 typedef void      (* FttCellCleanupFunc)             (FttCell * cell,
 						      gpointer data);
 void                 ftt_cell_destroy           (FttCell * cell,
@@ -1,6 +1,9 @@
-static void traverse_face (FttCell * cell, gpointer * datum)
+#ifndef FTT_FACE_NEIGHBOR
+# define FTT_FACE_NEIGHBOR(cell, d, datum) ftt_cell_neighbor (cell, d)
+#endif
+
+static void traverse_face_d (FttCell * cell, FttDirection d, gpointer * datum)
 {
-  FttDirection * d = datum[0];
   gint max_depth = *((gint *) datum[1]);
   FttFaceTraverseFunc func = (FttFaceTraverseFunc) datum[2];
   gpointer data = datum[3];
@@ -8,9 +11,9 @@ static void traverse_face (FttCell * cell, gpointer * datum)
   gboolean boundary_faces = *((gboolean *) datum[5]);  
   FttCellFace face;
   
-  face.d = *d;
+  face.d = d;
   face.cell = cell;
-  face.neighbor = ftt_cell_neighbor (cell, face.d);
+  face.neighbor = FTT_FACE_NEIGHBOR (cell, face.d, datum);
   if (face.neighbor) {
     if (!check || (face.neighbor->flags & FTT_FLAG_TRAVERSED) == 0) {
       if (FTT_CELL_IS_LEAF (cell) && 
@@ -36,13 +39,20 @@ static void traverse_face (FttCell * cell, gpointer * datum)
     (* func) (&face, data);
 }
 
+/* the functions below do not modify @datum and can be called by
+   concurrent threads */
+
+static void traverse_face (FttCell * cell, gpointer * datum)
+{
+  traverse_face_d (cell, *((FttDirection *) datum[0]), datum);
+}
+
 static void traverse_all_faces (FttCell * cell, gpointer * datum)
 {
   FttDirection d;
 
-  datum[0] = &d;
   for (d = 0; d < FTT_NEIGHBORS; d++)
-    traverse_face (cell, datum);
+    traverse_face_d (cell, d, datum);
   cell->flags |= FTT_FLAG_TRAVERSED;
 }
 
@@ -50,9 +60,8 @@ static void traverse_all_direct_faces (FttCell * cell, gpointer * datum)
 {
   FttDirection d;
 
-  datum[0] = &d;
   for (d = 0; d < FTT_NEIGHBORS; d += 2)
-    traverse_face (cell, datum);
+    traverse_face_d (cell, d, datum);
   cell->flags |= FTT_FLAG_TRAVERSED;
 }
 
@@ -65,15 +74,10 @@ static void traverse_face_direction (FttCell * cell, gpointer * datum)
 static void traverse_face_component (FttCell * cell, gpointer * datum)
 {
   FttComponent * c = datum[0];
-  FttDirection d;
 
-  datum[0] = &d;
-  d = 2*(*c);
-  traverse_face (cell, datum);
-  d++;
-  traverse_face (cell, datum);
+  traverse_face_d (cell, 2*(*c), datum);
+  traverse_face_d (cell, 2*(*c) + 1, datum);
   cell->flags |= FTT_FLAG_TRAVERSED;
-  datum[0] = c;
 }
 
 static void reset_flag (FttCell * cell)
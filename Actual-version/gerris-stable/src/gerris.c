@@ -366,38 +366,48 @@ int main (int argc, char * argv[])
 		 np);
       return 1;
     }
-    if (bubble)
-      partition = gts_graph_bubble_partition (GTS_GRAPH (simulation), npart, 100, 
-					      verbose ? 
-					      (GtsFunc) gts_graph_partition_print_stats : NULL, 
-					      stderr);
-    else
-      partition = gts_graph_recursive_bisection (GTS_WGRAPH (simulation),
-						 npart, 
-						 ntry, mmax, nmin, imbalance);
-
     gint pid = 0;
-    i = partition;
-    while (i) {
-      if (gts_container_size (GTS_CONTAINER (i->data)) == 0) {
+    if (domain->sfc) {
+      /* use the same ordering as for traversals and output */
+      pid = gfs_domain_sfc_partition (domain, np);
+      if (pid < np) {
 	fprintf (stderr, "gerris: partitioning failed: empty partition\n");
-	if (!bubble)
-	  fprintf (stderr, 
-		   "Try using the '-b' option\n"
-		   "Try `gerris --help' for more information.\n");
 	return 1;
       }
-      gts_container_foreach (GTS_CONTAINER (i->data), (GtsFunc) set_box_pid, &pid);
-      pid++;
-      i = i->next;
+    }
+    else {
+      if (bubble)
+	partition = gts_graph_bubble_partition (GTS_GRAPH (simulation), npart, 100, 
+						verbose ? 
+						(GtsFunc) gts_graph_partition_print_stats : NULL, 
+						stderr);
+      else
+	partition = gts_graph_recursive_bisection (GTS_WGRAPH (simulation),
+						   npart, 
+						   ntry, mmax, nmin, imbalance);
+
+      i = partition;
+      while (i) {
+	if (gts_container_size (GTS_CONTAINER (i->data)) == 0) {
+	  fprintf (stderr, "gerris: partitioning failed: empty partition\n");
+	  if (!bubble)
+	    fprintf (stderr, 
+		     "Try using the '-b' option\n"
+		     "Try `gerris --help' for more information.\n");
+	  return 1;
+	}
+	gts_container_foreach (GTS_CONTAINER (i->data), (GtsFunc) set_box_pid, &pid);
+	pid++;
+	i = i->next;
+      }
+
+      if (verbose && domain->pid <= 0)
+	gts_graph_partition_print_stats (partition, stderr);
+      gts_graph_partition_destroy (partition);
     }
 
     if (pid != np)
       fprintf (stderr, "gerris: warning: only %d partitions were created\n", pid);
-
-    if (verbose && domain->pid <= 0)
-      gts_graph_partition_print_stats (partition, stderr);
-    gts_graph_partition_destroy (partition);
       
     if (domain->pid >= 0) { /* we are running a parallel job */
       /* write partitioned simulation in a temporary file */
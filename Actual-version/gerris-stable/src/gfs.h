@@ -42,6 +42,7 @@
 #include <gerris/unstructured.h>
 #include <gerris/map.h>
 #include <gerris/particle.h>
+#include <gerris/indexed.h>
 #include <gerris/version.h>
 
 #endif /* GFS_H */
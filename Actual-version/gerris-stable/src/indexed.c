@@ -0,0 +1,526 @@
+/* Gerris - The GNU Flow Solver
+ * Copyright (C) 2001-2009 National Institute of Water and Atmospheric Research
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.  
+ */
+/*! \file
+ * \brief Indexed binary data files.
+ *
+ * An indexed data file contains the cell data of the boxes of a
+ * simulation, in the binary format of ftt_cell_write_binary() and
+ * gfs_cell_write_binary(). It starts with a fixed-size
+ * #GfsIndexedHeader and ends with an index table containing the
+ * names of the variables and, for each box, the offset and length
+ * of its data, its number of leaf cells and its depth. All values
+ * are stored with the native byte order.
+ *
+ * The file is memory-mapped when read so that the data of any box
+ * can be accessed directly, without parsing the rest of the file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "config.h"
+#include "indexed.h"
+#include "variable.h"
+
+/* GfsIndexedFile: Object */
+
+typedef struct {
+  FILE * fp;
+  GfsDomain * domain;
+  GArray * index;
+  GPtrArray * boxes;
+} WriteData;
+
+static void count_leaf (FttCell * cell, guint * size)
+{
+  (*size)++;
+}
+
+static void write_box (GfsBox * box, WriteData * w)
+{
+  GfsIndexedBox b;
+  guint size = 0;
+  gint depth = w->domain->max_depth_write;
+
+  ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, depth,
+		     (FttCellTraverseFunc) count_leaf, &size);
+  memset (&b, 0, sizeof (GfsIndexedBox));
+  b.id = box->id;
+  b.pid = box->pid;
+  b.size = size;
+  b.depth = ftt_cell_depth (box->root);
+  if (depth >= 0 && b.depth > depth)
+    b.depth = depth;
+  /* same format as the data of GfsBox, see boundary.c:gfs_box_write() */
+  b.offset = ftello (w->fp);
+  fputs ("{\n", w->fp);
+  ftt_cell_write_binary (box->root, depth, w->fp, 
+			 (FttCellWriteFunc) gfs_cell_write_binary, w->domain->variables_io);
+  fputc ('}', w->fp);
+  b.length = ftello (w->fp) - b.offset;
+  g_array_append_val (w->index, b);
+  g_ptr_array_add (w->boxes, box);
+}
+
+static void shift_offsets (WriteData * w, gint64 base)
+{
+  guint i;
+  for (i = 0; i < w->index->len; i++) {
+    GfsIndexedBox * b = &g_array_index (w->index, GfsIndexedBox, i);
+    GfsBox * box = g_ptr_array_index (w->boxes, i);
+    b->offset += base;
+    box->offset = b->offset;
+    box->length = b->length;
+    box->size = b->size;
+  }
+}
+
+static void header_init (GfsIndexedHeader * h, GfsDomain * domain, guint nbox, gint64 index)
+{
+  memset (h, 0, sizeof (GfsIndexedHeader));
+  strcpy (h->magic, GFS_INDEXED_MAGIC);
+  h->version = GFS_INDEXED_VERSION;
+  h->dimension = FTT_DIMENSION;
+  h->nvar = g_slist_length (domain->variables_io);
+  h->nbox = nbox;
+  h->index = index;
+}
+
+static GByteArray * index_new (GfsDomain * domain, gconstpointer box, guint size)
+{
+  GByteArray * a = g_byte_array_new ();
+  GSList * i = domain->variables_io;
+  while (i) {
+    const gchar * name = GFS_VARIABLE (i->data)->name;
+    guint32 len = strlen (name);
+    g_byte_array_append (a, (guint8 *) &len, sizeof (guint32));
+    g_byte_array_append (a, (guint8 *) name, len);
+    i = i->next;
+  }
+  /* the box entries are aligned on 8 bytes from the start of the index */
+  static const guint8 pad[8] = { 0 };
+  g_byte_array_append (a, pad, (8 - a->len % 8) % 8);
+  g_byte_array_append (a, box, size);
+  return a;
+}
+
+/**
+ * gfs_indexed_file_write:
+ * @domain: a #GfsDomain.
+ * @name: the name of the file.
+ *
+ * Writes the cell data of the boxes of @domain (described by
+ * @domain->variables_io, up to @domain->max_depth_write) in the
+ * indexed data file called @name.
+ *
+ * The offset and length of the data of each box are stored in the
+ * @offset and @length fields of the box and its number of leaf cells
+ * in the @size field.
+ *
+ * In parallel, the data of all the PEs is written collectively in
+ * the same file using MPI-IO and this function must be called by all
+ * the PEs.
+ *
+ * Returns: %TRUE if the file was written successfully, %FALSE
+ * otherwise.
+ */
+gboolean gfs_indexed_file_write (GfsDomain * domain, const gchar * name)
+{
+  g_return_val_if_fail (domain != NULL, FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  WriteData w;
+  char * buf;
+  size_t len;
+  w.fp = open_memstream (&buf, &len);
+  if (w.fp == NULL)
+    g_error ("gfs_indexed_file_write(): could not open_memstream:\n%s", strerror (errno));
+  w.domain = domain;
+  w.index = g_array_new (FALSE, FALSE, sizeof (GfsIndexedBox));
+  w.boxes = g_ptr_array_new ();
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) write_box, &w);
+  fclose (w.fp);
+
+  GfsIndexedHeader h;
+  gboolean status = TRUE;
+  if (domain->pid >= 0) {
+#ifdef HAVE_MPI
+    /* offset of the data of this PE */
+    long long size = len, base = 0, total = len;
+    MPI_Exscan (&size, &base, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (domain->pid == 0)
+      base = 0;
+    gfs_all_reduce (domain, total, MPI_LONG_LONG, MPI_SUM);
+    shift_offsets (&w, sizeof (GfsIndexedHeader) + base);
+
+    /* the index entries of all the PEs are gathered on PE 0 */
+    int n = w.index->len*sizeof (GfsIndexedBox), np, * count = NULL, * displ = NULL;
+    gchar * entries = NULL;
+    MPI_Comm_size (MPI_COMM_WORLD, &np);
+    if (domain->pid == 0) {
+      count = g_malloc (np*sizeof (int));
+      displ = g_malloc (np*sizeof (int));
+    }
+    MPI_Gather (&n, 1, MPI_INT, count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (domain->pid == 0) {
+      int i;
+      n = 0;
+      for (i = 0; i < np; i++) {
+	displ[i] = n;
+	n += count[i];
+      }
+      entries = g_malloc (n);
+    }
+    MPI_Gatherv (w.index->data, w.index->len*sizeof (GfsIndexedBox), MPI_BYTE,
+		 entries, count, displ, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    MPI_File fh;
+    int error = MPI_File_open (MPI_COMM_WORLD, (char *) name, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+			       MPI_INFO_NULL, &fh);
+    if (error == MPI_SUCCESS) {
+      MPI_File_set_size (fh, 0);
+      /* the data is written in chunks small enough for the int count of MPI */
+      const long long chunk = 1 << 30;
+      long long nchunk = (size + chunk - 1)/chunk, i;
+      gfs_all_reduce (domain, nchunk, MPI_LONG_LONG, MPI_MAX);
+      for (i = 0; i < nchunk && error == MPI_SUCCESS; i++) {
+	long long start = MIN (i*chunk, size);
+	error = MPI_File_write_at_all (fh, sizeof (GfsIndexedHeader) + base + start, buf + start, 
+				       MIN (chunk, size - start), MPI_BYTE, MPI_STATUS_IGNORE);
+      }
+      if (domain->pid == 0 && error == MPI_SUCCESS) {
+	gint64 index = sizeof (GfsIndexedHeader) + total;
+	header_init (&h, domain, n/sizeof (GfsIndexedBox), index);
+	GByteArray * a = index_new (domain, entries, n);
+	error = MPI_File_write_at (fh, 0, &h, sizeof (GfsIndexedHeader), MPI_BYTE, 
+				   MPI_STATUS_IGNORE);
+	if (error == MPI_SUCCESS)
+	  error = MPI_File_write_at (fh, index, a->data, a->len, MPI_BYTE, MPI_STATUS_IGNORE);
+	g_byte_array_free (a, TRUE);
+      }
+      MPI_File_close (&fh);
+    }
+    g_free (count);
+    g_free (displ);
+    g_free (entries);
+    status = (error == MPI_SUCCESS);
+    gfs_all_reduce (domain, status, MPI_INT, MPI_MIN);
+#endif /* HAVE_MPI */
+  }
+  else {
+    shift_offsets (&w, sizeof (GfsIndexedHeader));
+    header_init (&h, domain, w.index->len, sizeof (GfsIndexedHeader) + len);
+    GByteArray * a = index_new (domain, w.index->data, w.index->len*sizeof (GfsIndexedBox));
+    FILE * fp = fopen (name, "w");
+    if (fp == NULL ||
+	fwrite (&h, sizeof (GfsIndexedHeader), 1, fp) != 1 ||
+	fwrite (buf, 1, len, fp) != len ||
+	fwrite (a->data, 1, a->len, fp) != a->len)
+      status = FALSE;
+    if (fp && fclose (fp))
+      status = FALSE;
+    g_byte_array_free (a, TRUE);
+  }
+  free (buf);
+  g_array_free (w.index, TRUE);
+  g_ptr_array_free (w.boxes, TRUE);
+
+  return status;
+}
+
+static GfsIndexedFile * open_error (GfsIndexedFile * file, gchar ** error, 
+				    const gchar * format, ...)
+{
+  if (error) {
+    va_list args;
+    va_start (args, format);
+    gchar * msg = g_strdup_vprintf (format, args);
+    va_end (args);
+    *error = g_strdup_printf ("%s: %s", file->name, msg);
+    g_free (msg);
+  }
+  gfs_indexed_file_close (file);
+  return NULL;
+}
+
+/**
+ * gfs_indexed_file_open:
+ * @name: the name of an indexed data file.
+ * @error: where to store an error message or %NULL.
+ *
+ * Memory-maps the indexed data file called @name and reads its
+ * header and index. The data of the boxes is only accessed by
+ * gfs_indexed_file_read_box().
+ *
+ * Returns: a new #GfsIndexedFile or %NULL if an error occured, in
+ * which case a newly allocated description of the error is stored in
+ * @error.
+ */
+GfsIndexedFile * gfs_indexed_file_open (const gchar * name, gchar ** error)
+{
+  g_return_val_if_fail (name != NULL, NULL);
+
+  GfsIndexedFile * file = g_malloc0 (sizeof (GfsIndexedFile));
+  file->name = g_strdup (name);
+
+  GError * err = NULL;
+  file->map = g_mapped_file_new (name, FALSE, &err);
+  if (file->map == NULL) {
+    GfsIndexedFile * f = open_error (file, error, "%s", err->message);
+    g_error_free (err);
+    return f;
+  }
+  file->start = g_mapped_file_get_contents (file->map);
+  file->end = file->start + g_mapped_file_get_length (file->map);
+
+  GfsIndexedHeader h;
+  if (file->end - file->start < sizeof (GfsIndexedHeader))
+    return open_error (file, error, "file is too short");
+  memcpy (&h, file->start, sizeof (GfsIndexedHeader));
+  if (strncmp (h.magic, GFS_INDEXED_MAGIC, sizeof (h.magic)))
+    return open_error (file, error, "not an indexed data file");
+  if (h.version > GFS_INDEXED_VERSION)
+    return open_error (file, error, "unknown version %u", h.version);
+  if (h.dimension != FTT_DIMENSION)
+    return open_error (file, error, "file is %uD but Gerris is %dD", 
+		       h.dimension, FTT_DIMENSION);
+  if (h.index < sizeof (GfsIndexedHeader) || h.index > file->end - file->start)
+    return open_error (file, error, "invalid index offset");
+
+  const gchar * p = file->start + h.index;
+  guint i;
+  /* each variable name takes at least its length in the index */
+  if (h.nvar > (file->end - p)/sizeof (guint32))
+    return open_error (file, error, "invalid number of variables");
+  file->nvar = h.nvar;
+  file->variables = g_malloc0 ((h.nvar + 1)*sizeof (gchar *));
+  for (i = 0; i < h.nvar; i++) {
+    guint32 len;
+    if (file->end - p < sizeof (guint32))
+      return open_error (file, error, "truncated index");
+    memcpy (&len, p, sizeof (guint32));
+    p += sizeof (guint32);
+    if (file->end - p < len)
+      return open_error (file, error, "truncated index");
+    file->variables[i] = g_strndup (p, len);
+    p += len;
+  }
+  p += (8 - (p - file->start - h.index) % 8) % 8;
+  if (p > file->end || (file->end - p)/sizeof (GfsIndexedBox) < h.nbox)
+    return open_error (file, error, "truncated index");
+  file->nbox = h.nbox;
+  file->box = g_malloc (h.nbox*sizeof (GfsIndexedBox));
+  memcpy (file->box, p, h.nbox*sizeof (GfsIndexedBox));
+
+  file->id = g_hash_table_new (NULL, NULL);
+  for (i = 0; i < h.nbox; i++) {
+    GfsIndexedBox * b = &file->box[i];
+    if (b->offset < sizeof (GfsIndexedHeader) || b->length < 0 || 
+	b->offset + b->length > h.index)
+      return open_error (file, error, "box %u: invalid offset or length", b->id);
+    g_hash_table_insert (file->id, GUINT_TO_POINTER (b->id), b);
+  }
+
+  return file;
+}
+
+/**
+ * gfs_indexed_file_lookup:
+ * @file: a #GfsIndexedFile.
+ * @id: the id of a box.
+ *
+ * Returns: the index entry of the box of @file with id @id or %NULL
+ * if there is no such box.
+ */
+GfsIndexedBox * gfs_indexed_file_lookup (GfsIndexedFile * file, guint id)
+{
+  g_return_val_if_fail (file != NULL, NULL);
+
+  return g_hash_table_lookup (file->id, GUINT_TO_POINTER (id));
+}
+
+/**
+ * gfs_indexed_file_select_variables:
+ * @file: a #GfsIndexedFile.
+ * @list: a comma-separated list of variable names or %NULL.
+ *
+ * Only the variables in @list are read by subsequent calls to
+ * gfs_indexed_file_read_box() for @file. The values of the other
+ * variables are left uninitialised. If @list is %NULL, all the
+ * variables are read (the default).
+ */
+void gfs_indexed_file_select_variables (GfsIndexedFile * file, const gchar * list)
+{
+  g_return_if_fail (file != NULL);
+
+  g_strfreev (file->selected);
+  file->selected = list ? g_strsplit (list, ",", 0) : NULL;
+}
+
+/**
+ * gfs_indexed_file_variable_is_selected:
+ * @file: a #GfsIndexedFile.
+ * @name: the name of a variable.
+ *
+ * Returns: %TRUE if the variable called @name is read by
+ * gfs_indexed_file_read_box() for @file, %FALSE otherwise.
+ */
+gboolean gfs_indexed_file_variable_is_selected (GfsIndexedFile * file, const gchar * name)
+{
+  g_return_val_if_fail (file != NULL, FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  if (file->selected == NULL)
+    return TRUE;
+  gchar ** s = file->selected;
+  while (*s)
+    if (!strcmp (*(s++), name))
+      return TRUE;
+  return FALSE;
+}
+
+typedef struct {
+  GfsDomain * domain;
+  GfsVariable ** v;
+  guint nvar;
+} ReadData;
+
+static gboolean read_double (const gchar ** p, const gchar * end, gdouble * a, guint n)
+{
+  if (end - *p < n*sizeof (gdouble))
+    return FALSE;
+  memcpy (a, *p, n*sizeof (gdouble));
+  *p += n*sizeof (gdouble);
+  return TRUE;
+}
+
+/* same format as gfs_cell_write_binary() */
+static gboolean cell_read (FttCell * cell, const gchar ** p, const gchar * end, ReadData * r)
+{
+  gdouble s0;
+
+  if (!read_double (p, end, &s0, 1) || (s0 < 0. && s0 != -1.))
+    return FALSE;
+
+  gfs_cell_init (cell, r->domain);
+  if (s0 >= 0.) {
+    GfsSolidVector * solid = GFS_STATE (cell)->solid = g_malloc0 (sizeof (GfsSolidVector));
+    solid->s[0] = s0;
+    if (!read_double (p, end, &solid->s[1], FTT_NEIGHBORS - 1) ||
+	!read_double (p, end, &solid->a, 1) ||
+	!read_double (p, end, &solid->cm.x, FTT_DIMENSION) ||
+	!read_double (p, end, &solid->ca.x, FTT_DIMENSION))
+      return FALSE;
+  }
+
+  if (end - *p < r->nvar*sizeof (gdouble))
+    return FALSE;
+  guint i;
+  for (i = 0; i < r->nvar; i++, *p += sizeof (gdouble))
+    if (r->v[i]) {
+      gdouble a;
+      memcpy (&a, *p, sizeof (gdouble));
+      GFS_VALUE (cell, r->v[i]) = a;
+    }
+  return TRUE;
+}
+
+/**
+ * gfs_indexed_file_read_box:
+ * @file: a #GfsIndexedFile.
+ * @box: a #GfsBox.
+ *
+ * Replaces the cell tree of @box with the tree of the box of @file
+ * with the same id.
+ *
+ * The variables of @file are matched by name with the variables of
+ * the domain containing @box. Only the variables selected with
+ * gfs_indexed_file_select_variables() are read.
+ *
+ * Returns: %TRUE if the data of @box was read successfully, %FALSE
+ * otherwise, in which case @box is unchanged.
+ */
+gboolean gfs_indexed_file_read_box (GfsIndexedFile * file, GfsBox * box)
+{
+  g_return_val_if_fail (file != NULL, FALSE);
+  g_return_val_if_fail (box != NULL, FALSE);
+
+  GfsIndexedBox * b = gfs_indexed_file_lookup (file, box->id);
+  if (b == NULL)
+    return FALSE;
+
+  /* same format as the data of GfsBox, see boundary.c:gfs_box_read() */
+  const gchar * p = file->start + b->offset, * end = p + b->length;
+  if (b->length < 3 || strncmp (p, "{\n", 2) || end[-1] != '}')
+    return FALSE;
+  p += 2; end--;
+
+  GfsDomain * domain = gfs_box_domain (box);
+  ReadData r = { domain, g_malloc (file->nvar*sizeof (GfsVariable *)), file->nvar };
+  guint i;
+  for (i = 0; i < file->nvar; i++)
+    r.v[i] = gfs_indexed_file_variable_is_selected (file, file->variables[i]) ?
+      gfs_variable_from_name (domain->variables, file->variables[i]) : NULL;
+  FttCell * root = ftt_cell_read_memory (&p, end, (FttCellReadMemoryFunc) cell_read, &r);
+  g_free (r.v);
+  if (p != end) {
+    ftt_cell_destroy (root, (FttCellCleanupFunc) gfs_cell_cleanup, domain);
+    return FALSE;
+  }
+
+  /* replaces the root cell */
+  FTT_ROOT_CELL (root)->pos = FTT_ROOT_CELL (box->root)->pos;
+  ftt_cell_set_level (root, ftt_cell_level (box->root));
+  ftt_cell_destroy (box->root, (FttCellCleanupFunc) gfs_cell_cleanup, domain);
+  box->root = root;
+  FTT_ROOT_CELL (root)->parent = box;
+  FttDirection d;
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY (box->neighbor[d])) {
+      GfsBoundary * boundary = GFS_BOUNDARY (box->neighbor[d]);
+      ftt_cell_set_neighbor_match (boundary->root, box->root, boundary->d, 
+				   (FttCellInitFunc) gfs_cell_init, domain);
+    }
+  return TRUE;
+}
+
+/**
+ * gfs_indexed_file_close:
+ * @file: a #GfsIndexedFile.
+ *
+ * Unmaps and frees @file.
+ */
+void gfs_indexed_file_close (GfsIndexedFile * file)
+{
+  g_return_if_fail (file != NULL);
+
+  if (file->map)
+#if GLIB_CHECK_VERSION(2,22,0)
+    g_mapped_file_unref (file->map);
+#else
+    g_mapped_file_free (file->map);
+#endif
+  if (file->id)
+    g_hash_table_destroy (file->id);
+  g_strfreev (file->variables);
+  g_strfreev (file->selected);
+  g_free (file->box);
+  g_free (file->name);
+  g_free (file);
+}
@@ -0,0 +1,87 @@
+/* Gerris - The GNU Flow Solver
+ * Copyright (C) 2001-2009 National Institute of Water and Atmospheric Research
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.  
+ */
+
+#ifndef __INDEXED_H__
+#define __INDEXED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "domain.h"
+
+/* GfsIndexedFile: Header */
+
+#define GFS_INDEXED_MAGIC   "GfsData"
+#define GFS_INDEXED_VERSION 1
+
+typedef struct _GfsIndexedHeader GfsIndexedHeader;
+
+struct _GfsIndexedHeader {
+  gchar magic[8];
+  guint32 version, dimension;
+  guint32 nvar, nbox;
+  gint64 index;                  /* offset of the index table */
+  gint64 reserved[4];
+};
+
+typedef struct _GfsIndexedBox GfsIndexedBox;
+
+struct _GfsIndexedBox {
+  guint32 id;
+  gint32 pid;
+  gint64 offset, length;         /* cell data of the box */
+  guint32 size;                  /* number of leaf cells */
+  guint32 depth;                 /* depth of the cell tree */
+};
+
+typedef struct _GfsIndexedFile GfsIndexedFile;
+
+struct _GfsIndexedFile {
+  gchar * name;
+  guint nvar, nbox;
+  gchar ** variables;
+  GfsIndexedBox * box;
+
+  /*< private >*/
+  GMappedFile * map;
+  const gchar * start, * end;
+  GHashTable * id;
+  gchar ** selected;
+};
+
+gboolean         gfs_indexed_file_write          (GfsDomain * domain,
+						  const gchar * name);
+GfsIndexedFile * gfs_indexed_file_open           (const gchar * name,
+						  gchar ** error);
+GfsIndexedBox *  gfs_indexed_file_lookup         (GfsIndexedFile * file,
+						  guint id);
+gboolean         gfs_indexed_file_read_box       (GfsIndexedFile * file,
+						  GfsBox * box);
+void             gfs_indexed_file_close          (GfsIndexedFile * file);
+void             gfs_indexed_file_select_variables (GfsIndexedFile * file,
+						    const gchar * list);
+gboolean         gfs_indexed_file_variable_is_selected (GfsIndexedFile * file,
+							const gchar * name);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __INDEXED_H__ */
@@ -261,6 +261,7 @@ GtsObjectClass ** gfs_classes (void)
       gfs_output_adapt_stats_class (),
       gfs_output_timing_class (),
       gfs_output_balance_class (),
+      gfs_output_mpi_profile_class (),
       gfs_output_solid_force_class (),
       gfs_output_location_class (),
         gfs_output_particle_class (),
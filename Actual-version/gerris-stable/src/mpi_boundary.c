@@ -86,6 +86,238 @@ static guint tag_shift = 32767/FTT_NEIGHBORS;
 FILE * mpi_debug = NULL;
 #endif
 
+/* Persistent send/receive requests for a given message size. The
+   number of values exchanged through a boundary depends only on the
+   traversal (flags and depth) and on the topology of the boundary,
+   so that a few of these are enough to cover all the exchanges
+   between two reshapes of the mesh (e.g. one per multigrid level). */
+typedef struct {
+  guint count;
+  gpointer sndbuf, rcvbuf;
+  MPI_Request send, receive;
+} MpiPersistent;
+
+/* maximum number of persistent requests cached for each boundary */
+#define PERSISTENT_MAX 32
+
+static void mpi_persistent_destroy (MpiPersistent * p)
+{
+  int finalized;
+  MPI_Finalized (&finalized);
+  if (!finalized) {
+    MPI_Request_free (&p->send);
+    MPI_Request_free (&p->receive);
+  }
+  g_free (p);
+}
+
+static void boundary_mpi_persistent_clear (GfsBoundaryMpi * mpi)
+{
+  g_slist_foreach (mpi->persistent, (GFunc) mpi_persistent_destroy, NULL);
+  g_slist_free (mpi->persistent);
+  mpi->persistent = NULL;
+  mpi->active = NULL;
+}
+
+static MpiPersistent * boundary_mpi_persistent (GfsBoundaryMpi * mpi)
+{
+  GfsBoundaryPeriodic * boundary = GFS_BOUNDARY_PERIODIC (mpi);
+  GSList * i = mpi->persistent, * last = NULL;
+  guint n = 0;
+
+  /* the matching boundary sends as many values (possibly for several
+     variables, see gfs_domain_bc_multi()) */
+  if (boundary->sndcount > boundary->rcvbuf->len)
+    g_array_set_size (boundary->rcvbuf, boundary->sndcount);
+
+  while (i) {
+    MpiPersistent * p = i->data;
+    if (p->count == boundary->sndcount) {
+      if (p->sndbuf == boundary->sndbuf->data && p->rcvbuf == boundary->rcvbuf->data) {
+	if (i != mpi->persistent) {
+	  /* move to front */
+	  last->next = i->next;
+	  i->next = mpi->persistent;
+	  mpi->persistent = i;
+	}
+	return p;
+      }
+      /* buffers have been reallocated */
+      mpi->persistent = g_slist_delete_link (mpi->persistent, i);
+      mpi_persistent_destroy (p);
+      break;
+    }
+    n++;
+    last = i;
+    i = i->next;
+  }
+
+  if (n >= PERSISTENT_MAX) {
+    /* drop the least recently used request */
+    GSList * j = g_slist_last (mpi->persistent);
+    mpi_persistent_destroy (j->data);
+    mpi->persistent = g_slist_delete_link (mpi->persistent, j);
+  }
+
+  MpiPersistent * p = g_malloc (sizeof (MpiPersistent));
+  p->count = boundary->sndcount;
+  p->sndbuf = boundary->sndbuf->data;
+  p->rcvbuf = boundary->rcvbuf->data;
+  MPI_Send_init (p->sndbuf, p->count, MPI_DOUBLE,
+		 mpi->process, TAG (GFS_BOUNDARY (mpi)), mpi->comm, &p->send);
+  MPI_Recv_init (p->rcvbuf, p->count, MPI_DOUBLE,
+		 mpi->process, MATCHING_TAG (GFS_BOUNDARY (mpi)), mpi->comm, &p->receive);
+  mpi->persistent = g_slist_prepend (mpi->persistent, p);
+  gfs_box_domain (GFS_BOUNDARY (mpi)->box)->mpi_requests++;
+  return p;
+}
+
+#if MPI_VERSION >= 3
+
+/* Shared-memory transport between the PEs of the same node. Each PE
+   allocates (in a shared MPI window) one slot for each parallel
+   boundary receiving values from a PE on the same node. The sender
+   copies its send buffer directly into the slot and the receiver
+   copies it into its receive buffer, without going through the MPI
+   stack. The slots are laid out again each time the boundaries are
+   matched (see gfs_boundary_mpi_shared_setup()). */
+
+typedef struct {
+  gint box, d;              /* sending box and direction */
+  guint capacity;           /* maximum number of values */
+  gsize offset;             /* of the values, from the start of the slot */
+  volatile gint count;      /* number of values or -1 if sent using MPI */
+  volatile guint seq, ack;  /* number of messages written and read */
+} SharedSlot;
+
+typedef struct {
+  guint nslot;
+  gdouble align;
+} SharedHeader;
+
+typedef struct {
+  MPI_Comm node;
+  gint * rank;              /* node rank of each PE (or MPI_UNDEFINED) */
+  MPI_Win win;
+  gboolean allocated;
+  MPI_Aint size;            /* size of the local segment */
+} MpiShared;
+
+#define SHARED_SLOTS(h) ((SharedSlot *) ((SharedHeader *) (h) + 1))
+#define SHARED_DATA(s)  ((gdouble *) ((gchar *) (s) + (s)->offset))
+
+static MpiShared * mpi_shared_new (void)
+{
+  MpiShared * shared = g_malloc0 (sizeof (MpiShared));
+  int size, i;
+  MPI_Group world, node;
+
+  MPI_Comm_split_type (MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &shared->node);
+  MPI_Comm_size (MPI_COMM_WORLD, &size);
+  MPI_Comm_group (MPI_COMM_WORLD, &world);
+  MPI_Comm_group (shared->node, &node);
+  gint * ranks = g_malloc (size*sizeof (gint));
+  for (i = 0; i < size; i++)
+    ranks[i] = i;
+  shared->rank = g_malloc (size*sizeof (gint));
+  MPI_Group_translate_ranks (world, size, ranks, node, shared->rank);
+  g_free (ranks);
+  MPI_Group_free (&world);
+  MPI_Group_free (&node);
+  return shared;
+}
+
+static void mpi_shared_free_window (MpiShared * shared)
+{
+  if (shared->allocated) {
+    MPI_Win_unlock_all (shared->win);
+    MPI_Win_free (&shared->win);
+    shared->allocated = FALSE;
+  }
+}
+
+static gboolean is_shared (GfsBoundaryMpi * mpi, MpiShared * shared)
+{
+  int rank;
+  MPI_Comm_rank (MPI_COMM_WORLD, &rank);
+  return (mpi->process != rank && shared->rank[mpi->process] != MPI_UNDEFINED);
+}
+
+static void shared_boundaries (GfsBox * box, GSList ** list)
+{
+  FttDirection d;
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY_MPI (box->neighbor[d]))
+      *list = g_slist_prepend (*list, box->neighbor[d]);
+}
+
+static void shared_reset (GfsBoundaryMpi * mpi)
+{
+  mpi->shared_snd = mpi->shared_rcv = NULL;
+}
+
+static void shared_send (GfsBoundaryMpi * mpi, MpiShared * shared)
+{
+  GfsBoundaryPeriodic * boundary = GFS_BOUNDARY_PERIODIC (mpi);
+  SharedSlot * s = mpi->shared_snd;
+
+  /* wait until the previous message has been read */
+  while (s->ack != s->seq)
+    MPI_Win_sync (shared->win);
+  if (boundary->sndcount <= s->capacity) {
+    memcpy (SHARED_DATA (s), boundary->sndbuf->data, sizeof (gdouble)*boundary->sndcount);
+    s->count = boundary->sndcount;
+  }
+  else {
+    /* too large for the slot, use MPI */
+    s->count = -1;
+    MPI_Isend (boundary->sndbuf->data, boundary->sndcount, MPI_DOUBLE,
+	       mpi->process,
+	       TAG (GFS_BOUNDARY (mpi)),
+	       mpi->comm,
+	       &(mpi->request[mpi->nrequest++]));
+  }
+  MPI_Win_sync (shared->win);
+  s->seq++;
+}
+
+static void shared_receive (GfsBoundaryMpi * mpi, MpiShared * shared, gint * arrived)
+{
+  GfsBoundaryPeriodic * boundary = GFS_BOUNDARY_PERIODIC (mpi);
+  SharedSlot * s = mpi->shared_rcv;
+  guint expected = s->ack + 1;
+
+  MPI_Win_sync (shared->win);
+  *arrived = (s->seq == expected);
+  while (s->seq != expected)
+    MPI_Win_sync (shared->win);
+  /* make sure the count and the values are read after the sequence number */
+  MPI_Win_sync (shared->win);
+  if (s->count < 0) {
+    MPI_Status status;
+    gint count;
+    MPI_Probe (mpi->process, MATCHING_TAG (GFS_BOUNDARY (mpi)), mpi->comm, &status);
+    MPI_Get_count (&status, MPI_DOUBLE, &count);
+    boundary->rcvcount = count;
+    if (boundary->rcvcount > boundary->rcvbuf->len)
+      g_array_set_size (boundary->rcvbuf, boundary->rcvcount);
+    MPI_Recv (boundary->rcvbuf->data, boundary->rcvcount, MPI_DOUBLE,
+	      mpi->process, MATCHING_TAG (GFS_BOUNDARY (mpi)), mpi->comm, &status);
+  }
+  else {
+    boundary->rcvcount = s->count;
+    if (boundary->rcvcount > boundary->rcvbuf->len)
+      g_array_set_size (boundary->rcvbuf, boundary->rcvcount);
+    memcpy (boundary->rcvbuf->data, SHARED_DATA (s), sizeof (gdouble)*boundary->rcvcount);
+  }
+  if (boundary->rcvcount > mpi->largest)
+    mpi->largest = boundary->rcvcount;
+  MPI_Win_sync (shared->win);
+  s->ack = expected;
+}
+
+#endif /* MPI_VERSION >= 3 */
+
 static void send (GfsBoundary * bb)
 {
   GfsBoundaryPeriodic * boundary = GFS_BOUNDARY_PERIODIC (bb);
@@ -96,7 +328,16 @@ static void send (GfsBoundary * bb)
     return;
 
   g_assert (boundary->sndcount <= boundary->sndbuf->len);
+#if MPI_VERSION >= 3
+  if (bb->type != GFS_BOUNDARY_MATCH_VARIABLE && mpi->shared_snd) {
+    shared_send (mpi, domain->mpi_shared);
+    domain->mpi_shared_messages++;
+  }
+  else
+#endif /* MPI_VERSION >= 3 */
   if (bb->type == GFS_BOUNDARY_MATCH_VARIABLE) {
+    /* the topology is changing: the size of the message is only
+       known by the receiver through MPI_Probe() */
 #ifdef DEBUG
 fprintf (DEBUG, "%d send to %d with tag %d match variable size: bid: %d mid: %d d: %d dp: %d\n",
 	 domain->pid, 
@@ -105,13 +346,16 @@ fprintf (DEBUG, "%d send to %d with tag %d match variable size: bid: %d mid: %d
 	 bb->box->id, GFS_BOUNDARY_MPI (bb)->id, bb->d, boundary->d);
 fflush (DEBUG);
 #endif
-    MPI_Isend (&boundary->sndcount, 1, MPI_UNSIGNED,
+    MPI_Isend (boundary->sndbuf->data, boundary->sndcount, MPI_DOUBLE,
 	       mpi->process,
 	       TAG (bb),
 	       mpi->comm,
 	       &(mpi->request[mpi->nrequest++]));
-    gts_range_add_value (&domain->mpi_messages, sizeof (guint));
   }
+  else {
+    /* the receiving boundary expects the same number of values: the
+       matching receive is posted before sending */
+    MpiPersistent * p = boundary_mpi_persistent (mpi);
 #ifdef DEBUG
 fprintf (DEBUG, "    %d send to %d with tag %d, size %d\n",
 	 domain->pid, 
@@ -120,13 +364,22 @@ fprintf (DEBUG, "    %d send to %d with tag %d, size %d\n",
 	 boundary->sndcount);
 fflush (DEBUG);
 #endif
-  MPI_Isend (boundary->sndbuf->data, boundary->sndcount, MPI_DOUBLE,
-	     mpi->process,
-	     TAG (bb),
-	     mpi->comm,
-	     &(mpi->request[mpi->nrequest++]));
+    g_assert (mpi->active == NULL);
+    MPI_Start (&p->receive);
+    MPI_Start (&p->send);
+    mpi->active = p;
+  }
   gts_range_add_value (&domain->mpi_messages, 
                        sizeof (gdouble)*boundary->sndcount);
+  GfsMpiProfile * profile = 
+    gfs_domain_mpi_profile (domain, 
+			    bb->type == GFS_BOUNDARY_MATCH_VARIABLE ? NULL : bb->v, 
+			    mpi->process);
+  if (profile) {
+    profile->bytes += sizeof (gdouble)*boundary->sndcount;
+    profile->messages++;
+  }
+  mpi->profile = profile;
 }
 
 static void receive (GfsBoundary * bb,
@@ -136,8 +389,10 @@ static void receive (GfsBoundary * bb,
   GfsBoundaryPeriodic * boundary = GFS_BOUNDARY_PERIODIC (bb);
   GfsBoundaryMpi * mpi = GFS_BOUNDARY_MPI (bb);
   GfsDomain * domain = gfs_box_domain (bb->box);
+  GfsMpiProfile * profile = mpi->profile;
   MPI_Status status;
-  gint count;
+  gint count, arrived = TRUE;
+  gboolean shared = FALSE;
 
   if (domain->pid < 0)
     return;
@@ -147,7 +402,15 @@ static void receive (GfsBoundary * bb,
 
   start = MPI_Wtime ();
 #endif /* PROFILE_MPI */
+  gdouble pstart = profile ? MPI_Wtime () : 0.;
 
+#if MPI_VERSION >= 3
+  if (bb->type != GFS_BOUNDARY_MATCH_VARIABLE && mpi->shared_rcv) {
+    shared_receive (mpi, domain->mpi_shared, &arrived);
+    shared = TRUE;
+  }
+  else
+#endif /* MPI_VERSION >= 3 */
   if (bb->type == GFS_BOUNDARY_MATCH_VARIABLE) {
 #ifdef DEBUG
 fprintf (DEBUG, "%d wait on %d with tag %d for match variable size: bid: %d mid: %d d: %d dp: %d\n",
@@ -157,21 +420,23 @@ fprintf (DEBUG, "%d wait on %d with tag %d for match variable size: bid: %d mid:
 	 bb->box->id, GFS_BOUNDARY_MPI (bb)->id, bb->d, boundary->d);
 fflush (DEBUG);
 #endif
-    MPI_Recv (&boundary->rcvcount, 1, MPI_UNSIGNED,
+    if (profile)
+      MPI_Iprobe (mpi->process, MATCHING_TAG (bb), mpi->comm, &arrived, &status);
+    MPI_Probe (mpi->process, MATCHING_TAG (bb), mpi->comm, &status);
+    MPI_Get_count (&status, MPI_DOUBLE, &count);
+    boundary->rcvcount = count;
+    if (boundary->rcvcount > boundary->rcvbuf->len)
+      g_array_set_size (boundary->rcvbuf, boundary->rcvcount);
+    MPI_Recv (boundary->rcvbuf->data,
+	      boundary->rcvcount,
+	      MPI_DOUBLE,
 	      mpi->process,
 	      MATCHING_TAG (bb),
 	      mpi->comm,
 	      &status);
-#ifdef PROFILE_MPI
-    end = MPI_Wtime ();
-    gts_range_add_value (&domain->mpi_wait, end - start);
-    start = MPI_Wtime ();
-#endif /* PROFILE_MPI */
-    if (boundary->rcvcount > boundary->rcvbuf->len)
-      g_array_set_size (boundary->rcvbuf, boundary->rcvcount);
   }
-  else
-    boundary->rcvcount = boundary->sndcount;
+  else {
+    MpiPersistent * p = mpi->active;
 #ifdef DEBUG
   fprintf (DEBUG, "    %d wait on %d with tag %d\n",
 	   gfs_box_domain (bb->box)->pid,
@@ -179,15 +444,17 @@ fflush (DEBUG);
 	   MATCHING_TAG (bb));
 fflush (DEBUG);
 #endif
-  g_assert (boundary->rcvcount <= boundary->rcvbuf->len);
-  MPI_Recv (boundary->rcvbuf->data,
-	    boundary->rcvcount,
-	    MPI_DOUBLE,
-	    mpi->process,
-	    MATCHING_TAG (bb),
-	    mpi->comm,
-	    &status);
-  MPI_Get_count (&status, MPI_DOUBLE, &count);
+    g_assert (p != NULL);
+    boundary->rcvcount = p->count;
+    if (profile)
+      MPI_Test (&p->receive, &arrived, &status);
+    if (!profile || !arrived)
+      MPI_Wait (&p->receive, &status);
+  }
+  if (shared)
+    count = boundary->rcvcount;
+  else
+    MPI_Get_count (&status, MPI_DOUBLE, &count);
 #ifdef DEBUG
   fprintf (DEBUG, "    src: %d tag: %d error: %d\n", 
 	   status.MPI_SOURCE, status.MPI_TAG, status.MPI_ERROR);
@@ -212,6 +479,13 @@ fflush (DEBUG);
   end = MPI_Wtime ();
   gts_range_add_value (&domain->mpi_wait, end - start);
 #endif /* PROFILE_MPI */
+  if (profile) {
+    gdouble elapsed = MPI_Wtime () - pstart;
+    profile->wait += elapsed;
+    if (!arrived)
+      /* late sender */
+      profile->late += elapsed;
+  }
 
   (* gfs_boundary_periodic_class ()->receive) (bb, flags, max_depth);
 }
@@ -227,14 +501,24 @@ static void synchronize (GfsBoundary * bb)
 
   start = MPI_Wtime ();
 #endif /* PROFILE_MPI */
+  GfsMpiProfile * profile = boundary->profile;
+  gdouble pstart = profile ? MPI_Wtime () : 0.;
 
   /* wait for completion of non-blocking send(s) */
   for (i = 0; i < boundary->nrequest; i++)
     MPI_Wait (&(boundary->request[i]), &status);
+  if (boundary->active) {
+    MPI_Wait (&((MpiPersistent *) boundary->active)->send, &status);
+    boundary->active = NULL;
+  }
 #ifdef PROFILE_MPI
   end = MPI_Wtime ();
   gts_range_add_value (&domain->mpi_wait, end - start);
 #endif /* PROFILE_MPI */
+  if (profile) {
+    profile->wait += MPI_Wtime () - pstart;
+    boundary->profile = NULL;
+  }
   boundary->nrequest = 0;
 #ifdef DEBUG
   /*  rewind (DEBUG); */
@@ -242,9 +526,19 @@ static void synchronize (GfsBoundary * bb)
 	   gfs_box_domain (bb->box)->pid);
   fflush (DEBUG);
 #endif
+  if (bb->type == GFS_BOUNDARY_MATCH_VARIABLE)
+    /* the topology (and the size of the buffers) may have changed */
+    boundary_mpi_persistent_clear (boundary);
   (* gfs_boundary_periodic_class ()->synchronize) (bb);
 }
 
+static void boundary_mpi_destroy (GtsObject * o)
+{
+  boundary_mpi_persistent_clear (GFS_BOUNDARY_MPI (o));
+
+  (* GTS_OBJECT_CLASS (gfs_boundary_mpi_class ())->parent_class->destroy) (o);
+}
+
 #endif /* HAVE_MPI */
 
 static void gfs_boundary_mpi_class_init (GfsBoundaryClass * klass)
@@ -252,6 +546,7 @@ static void gfs_boundary_mpi_class_init (GfsBoundaryClass * klass)
   GTS_OBJECT_CLASS (klass)->read = boundary_mpi_read;
   GTS_OBJECT_CLASS (klass)->write = boundary_mpi_write;
 #ifdef HAVE_MPI
+  GTS_OBJECT_CLASS (klass)->destroy = boundary_mpi_destroy;
   klass->send        = send;
   klass->receive     = receive;
   klass->synchronize = synchronize;
@@ -264,6 +559,11 @@ static void gfs_boundary_mpi_init (GfsBoundaryMpi * boundary)
   boundary->id = -1;
 #ifdef HAVE_MPI
   boundary->nrequest = 0;
+  boundary->persistent = NULL;
+  boundary->active = NULL;
+  boundary->profile = NULL;
+  boundary->shared_snd = boundary->shared_rcv = NULL;
+  boundary->largest = 0;
   boundary->comm = MPI_COMM_WORLD;
 #ifdef DEBUG
   if (mpi_debug == NULL) {
@@ -332,4 +632,151 @@ GfsBoundaryMpi * gfs_boundary_mpi_new (GfsBoundaryClass * klass,
   return boundary;
 }
 
+/**
+ * gfs_boundary_mpi_shared_setup:
+ * @domain: a #GfsDomain.
+ *
+ * Sets up the shared-memory transport used by the parallel boundaries
+ * of @domain connecting PEs on the same node (if #GfsDomain.shared is
+ * set and MPI-3 is available). The capacity of each slot is the size
+ * of the receive buffer or the largest message received so far,
+ * larger messages are sent using MPI.
+ *
+ * This function must be called by all the PEs, once the boundaries
+ * have been matched.
+ */
+void gfs_boundary_mpi_shared_setup (GfsDomain * domain)
+{
+  g_return_if_fail (domain != NULL);
+
+#if defined (HAVE_MPI) && MPI_VERSION >= 3
+  if (domain->pid < 0 || !domain->shared)
+    return;
+
+  if (domain->mpi_shared == NULL)
+    domain->mpi_shared = mpi_shared_new ();
+  MpiShared * shared = domain->mpi_shared;
+
+  GSList * list = NULL, * i;
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) shared_boundaries, &list);
+  guint nslot = 0;
+  MPI_Aint size = sizeof (SharedHeader);
+  for (i = list; i; i = i->next) {
+    GfsBoundaryMpi * mpi = i->data;
+    shared_reset (mpi);
+    if (is_shared (mpi, shared)) {
+      nslot++;
+      size += sizeof (SharedSlot) + 
+	sizeof (gdouble)*MAX (GFS_BOUNDARY_PERIODIC (mpi)->rcvbuf->len, mpi->largest);
+    }
+  }
+
+  /* all the previous messages have been read */
+  MPI_Barrier (shared->node);
+  int grow = (!shared->allocated || size > shared->size);
+  MPI_Allreduce (MPI_IN_PLACE, &grow, 1, MPI_INT, MPI_MAX, shared->node);
+  if (grow) {
+    gpointer base;
+    mpi_shared_free_window (shared);
+    shared->size = 2*size;
+    MPI_Win_allocate_shared (shared->size, 1, MPI_INFO_NULL, shared->node, &base, &shared->win);
+    MPI_Win_lock_all (MPI_MODE_NOCHECK, shared->win);
+    shared->allocated = TRUE;
+  }
+
+  /* local slots */
+  MPI_Aint wsize;
+  int rank, disp;
+  SharedHeader * h;
+  MPI_Comm_rank (shared->node, &rank);
+  MPI_Win_shared_query (shared->win, rank, &wsize, &disp, &h);
+  h->nslot = nslot;
+  SharedSlot * slot = SHARED_SLOTS (h);
+  gchar * data = (gchar *) (slot + nslot);
+  for (i = list; i; i = i->next) {
+    GfsBoundaryMpi * mpi = i->data;
+    if (is_shared (mpi, shared)) {
+      slot->box = mpi->id;
+      slot->d = FTT_OPPOSITE_DIRECTION (GFS_BOUNDARY_PERIODIC (mpi)->d);
+      slot->capacity = MAX (GFS_BOUNDARY_PERIODIC (mpi)->rcvbuf->len, mpi->largest);
+      slot->offset = data - (gchar *) slot;
+      slot->count = 0;
+      slot->seq = slot->ack = 0;
+      mpi->shared_rcv = slot;
+      data += sizeof (gdouble)*slot->capacity;
+      slot++;
+    }
+  }
+  MPI_Win_sync (shared->win);
+  MPI_Barrier (shared->node);
+
+  /* slots of the neighbours */
+  for (i = list; i; i = i->next) {
+    GfsBoundaryMpi * mpi = i->data;
+    if (is_shared (mpi, shared)) {
+      GfsBoundary * b = GFS_BOUNDARY (mpi);
+      MPI_Win_shared_query (shared->win, shared->rank[mpi->process], &wsize, &disp, &h);
+      SharedSlot * s = SHARED_SLOTS (h);
+      guint j;
+      for (j = 0; j < h->nslot && !mpi->shared_snd; j++, s++)
+	if (s->box == b->box->id && s->d == b->d)
+	  mpi->shared_snd = s;
+      g_assert (mpi->shared_snd);
+    }
+  }
+  g_slist_free (list);
+#endif /* HAVE_MPI && MPI_VERSION >= 3 */
+}
+
+/**
+ * gfs_boundary_mpi_shared_invalidate:
+ * @domain: a #GfsDomain.
+ *
+ * Makes the parallel boundaries of @domain use MPI until the next
+ * call to gfs_boundary_mpi_shared_setup(). This must be called by all
+ * the PEs before the processes of the boundaries are changed
+ * (e.g. when boxes are moved between PEs).
+ */
+void gfs_boundary_mpi_shared_invalidate (GfsDomain * domain)
+{
+  g_return_if_fail (domain != NULL);
+
+#if defined (HAVE_MPI) && MPI_VERSION >= 3
+  if (domain->mpi_shared) {
+    GSList * list = NULL;
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) shared_boundaries, &list);
+    g_slist_foreach (list, (GFunc) shared_reset, NULL);
+    g_slist_free (list);
+  }
+#endif /* HAVE_MPI && MPI_VERSION >= 3 */
+}
+
+/**
+ * gfs_boundary_mpi_shared_free:
+ * @domain: a #GfsDomain.
+ *
+ * Frees the shared-memory transport of @domain. This must be called
+ * by all the PEs.
+ */
+void gfs_boundary_mpi_shared_free (GfsDomain * domain)
+{
+  g_return_if_fail (domain != NULL);
+
+#if defined (HAVE_MPI) && MPI_VERSION >= 3
+  MpiShared * shared = domain->mpi_shared;
+  if (shared) {
+    int finalized;
+    gfs_boundary_mpi_shared_invalidate (domain);
+    MPI_Finalized (&finalized);
+    if (!finalized) {
+      mpi_shared_free_window (shared);
+      MPI_Comm_free (&shared->node);
+    }
+    g_free (shared->rank);
+    g_free (shared);
+    domain->mpi_shared = NULL;
+  }
+#endif /* HAVE_MPI && MPI_VERSION >= 3 */
+}
+
 /** \endobject{GfsBoundaryMpi} */
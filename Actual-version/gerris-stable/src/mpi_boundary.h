@@ -43,6 +43,11 @@ struct _GfsBoundaryMpi {
   MPI_Comm comm;
   MPI_Request request[2];
   guint nrequest;
+  GSList * persistent;
+  gpointer active;
+  gpointer profile; /* GfsMpiProfile of the current exchange */
+  gpointer shared_snd, shared_rcv; /* shared-memory slots (same node only) */
+  guint largest;    /* largest number of values received */
 #endif /* HAVE_MPI */
 };
 
@@ -60,6 +65,9 @@ GfsBoundaryMpi *      gfs_boundary_mpi_new      (GfsBoundaryClass * klass,
 						 FttDirection d,
 						 gint process,
 						 gint id);
+void                  gfs_boundary_mpi_shared_setup      (GfsDomain * domain);
+void                  gfs_boundary_mpi_shared_invalidate (GfsDomain * domain);
+void                  gfs_boundary_mpi_shared_free       (GfsDomain * domain);
 
 #ifdef __cplusplus
 }
@@ -769,6 +769,14 @@ static void print_timing (GHashTable * timers, GfsDomain * domain, FILE * fp)
   g_free (timing);
 }
 
+static void print_overlap (gchar * phase, GfsOverlap * o, FILE * fp)
+{
+  fprintf (fp, "  %s:\n"
+	   "      n: %8lu compute: %9.3f wait: %9.3f efficiency: %5.1f%%\n",
+	   phase, o->n, o->compute, o->wait,
+	   o->compute + o->wait > 0. ? 100.*o->compute/(o->compute + o->wait) : 100.);
+}
+
 static gboolean timing_event (GfsEvent * event, GfsSimulation * sim)
 {
   if ((* GFS_EVENT_CLASS (gfs_output_class())->event) (event, sim)) {
@@ -794,13 +802,76 @@ static gboolean timing_event (GfsEvent * event, GfsSimulation * sim)
 	       domain->size.stddev, 
 	       domain->size.max,
 	       gfs_domain_variables_number (domain));
+      fprintf (fp,
+	       "  state vector pool: %u bytes/cell %u slabs\n"
+	       "      blocks: %9u used: %9u fragmentation: %4.1f%%\n"
+	       "      allocated: %9.0f/timestep freed: %9.0f/timestep resized: %lu\n",
+	       (guint) domain->pool->size,
+	       domain->pool->nslabs,
+	       domain->pool->nblocks,
+	       domain->pool->used,
+	       100.*gfs_state_pool_fragmentation (domain->pool),
+	       domain->pool->allocs/(gdouble) domain->timestep.n,
+	       domain->pool->frees/(gdouble) domain->timestep.n,
+	       domain->pool->resizes);
+      if (domain->temporary->len > 0)
+	fprintf (fp,
+		 "  temporary variables: %u pooled peak: %u in use\n",
+		 domain->temporary->len,
+		 domain->temporary_peak);
+      if (domain->leaves)
+	fprintf (fp,
+		 "  leaf index: %u leaves %4.1f%% regular\n"
+		 "      updates: %lu kept: %9.0f/update added: %9.0f/update\n"
+		 "      neighbor lookups from table: %9.0f/timestep from tree: %9.0f/timestep\n",
+		 domain->leaves->n,
+		 domain->leaves->n > 0 ?
+		 100.*domain->leaves->nregular/(gdouble) domain->leaves->n : 0.,
+		 domain->leaves->updates,
+		 domain->leaves->kept/(gdouble) MAX (domain->leaves->updates, 1),
+		 domain->leaves->added/(gdouble) MAX (domain->leaves->updates, 1),
+		 domain->leaves->lookups/(gdouble) domain->timestep.n,
+		 domain->leaves->misses/(gdouble) domain->timestep.n);
+      if (domain->cells)
+	fprintf (fp,
+		 "  Morton-ordered cell arrays: %u leaves %u levels\n"
+		 "      rebuilds: %lu flat traversals: %9.0f/timestep\n",
+		 domain->cells->leaves->len,
+		 domain->cells->levels->len,
+		 domain->cells->builds,
+		 domain->cells->flat/(gdouble) domain->timestep.n);
+      if (domain->nthreads > 1)
+	fprintf (fp,
+		 "  threads: %u threaded traversals: %9.0f/timestep\n",
+		 domain->nthreads,
+		 domain->threaded/(gdouble) domain->timestep.n);
       print_timing (domain->timers, domain, fp);
       if (domain->mpi_messages.n > 0)
 	fprintf (fp,
 		 "Message passing summary\n"
-		 "  n: %10d size: %10.0f bytes\n",
+		 "  n: %10d size: %10.0f bytes persistent requests: %lu\n",
 		 domain->mpi_messages.n,
-		 domain->mpi_messages.sum);
+		 domain->mpi_messages.sum,
+		 domain->mpi_requests);
+      if (domain->mpi_shared_messages > 0)
+	fprintf (fp, "  shared memory: %lu messages\n", domain->mpi_shared_messages);
+      if (g_hash_table_size (domain->overlaps) > 0) {
+	fputs ("Communication/computation overlap\n", fp);
+	g_hash_table_foreach (domain->overlaps, (GHFunc) print_overlap, fp);
+      }
+      if (domain->reshapes > 0)
+	fprintf (fp,
+		 "Incremental reshape summary\n"
+		 "  reshapes: %10lu dirty cells: %9.0f/reshape\n",
+		 domain->reshapes,
+		 domain->reshaped/domain->reshapes);
+      if (domain->migrated > 0)
+	fprintf (fp,
+		 "Box migration summary\n"
+		 "  cells: %10lu time: %g s (%.0f cells/s)\n",
+		 domain->migrated,
+		 domain->migration,
+		 domain->migration > 0. ? domain->migrated/domain->migration : 0.);
     }
     return TRUE;
   }
@@ -897,6 +968,140 @@ GfsOutputClass * gfs_output_balance_class (void)
 
 /** \endobject{GfsOutputBalance} */
 
+/**
+ * Writing per-phase statistics of parallel communications.
+ * \beginobject{GfsOutputMpiProfile}
+ */
+
+static void gfs_output_mpi_profile_read (GtsObject ** o, GtsFile * fp)
+{
+  (* GTS_OBJECT_CLASS (gfs_output_mpi_profile_class ())->parent_class->read) (o, fp);
+  if (fp->type == GTS_ERROR)
+    return;
+
+  if (fp->type == '{') {
+    gchar * format = NULL;
+    GtsFileVariable var[] = {
+      {GTS_STRING, "format", TRUE, &format},
+      {GTS_NONE}
+    };
+    gts_file_assign_variables (fp, var);
+    if (fp->type == GTS_ERROR) {
+      g_free (format);
+      return;
+    }
+    if (format != NULL) {
+      if (!strcmp (format, "table"))
+	GFS_OUTPUT_MPI_PROFILE (*o)->json = FALSE;
+      else if (!strcmp (format, "JSON"))
+	GFS_OUTPUT_MPI_PROFILE (*o)->json = TRUE;
+      else {
+	gts_file_variable_error (fp, var, "format", "unknown format `%s'", format);
+	g_free (format);
+	return;
+      }
+      g_free (format);
+    }
+  }
+
+  gfs_domain_mpi_profile_init (GFS_DOMAIN (gfs_object_simulation (*o)));
+}
+
+static void gfs_output_mpi_profile_write (GtsObject * o, FILE * fp)
+{
+  (* GTS_OBJECT_CLASS (gfs_output_mpi_profile_class ())->parent_class->write) (o, fp);
+  if (GFS_OUTPUT_MPI_PROFILE (o)->json)
+    fputs (" { format = JSON }", fp);
+}
+
+static void get_mpi_profile (gchar * key, GfsMpiProfile * p, GPtrArray * a)
+{
+  g_ptr_array_add (a, p);
+}
+
+static int compare_mpi_profile (const void * a, const void * b)
+{
+  GfsMpiProfile * p1 = *((GfsMpiProfile **) a);
+  GfsMpiProfile * p2 = *((GfsMpiProfile **) b);
+  int c = strcmp (p1->phase, p2->phase);
+  if (c == 0)
+    c = strcmp (p1->variable, p2->variable);
+  return c ? c : p1->process - p2->process;
+}
+
+static gboolean gfs_output_mpi_profile_event (GfsEvent * event, GfsSimulation * sim)
+{
+  if ((* GFS_EVENT_CLASS (GTS_OBJECT_CLASS (gfs_output_mpi_profile_class ())->parent_class)->event)
+      (event, sim)) {
+    GfsDomain * domain = GFS_DOMAIN (sim);
+    gboolean json = GFS_OUTPUT_MPI_PROFILE (event)->json;
+    FILE * fp = GFS_OUTPUT (event)->file->fp;
+
+    if (domain->pid < 0 || domain->mpi_profile == NULL)
+      return TRUE;
+
+    GPtrArray * a = g_ptr_array_new ();
+    g_hash_table_foreach (domain->mpi_profile, (GHFunc) get_mpi_profile, a);
+    qsort (a->pdata, a->len, sizeof (gpointer), compare_mpi_profile);
+
+    if (GFS_OUTPUT (event)->first_call && !json)
+      fputs ("# 1:t 2:pid 3:phase 4:variable 5:neighbour 6:bytes 7:messages "
+	     "8:wait 9:late\n", fp);
+    GfsUnionFile uf;
+    FILE * fpp = GFS_OUTPUT (event)->parallel ? fp : gfs_union_open (fp, domain->pid, &uf);
+    guint i;
+    for (i = 0; i < a->len; i++) {
+      GfsMpiProfile * p = a->pdata[i];
+      if (json)
+	fprintf (fpp, "{ \"t\": %g, \"pid\": %d, \"phase\": \"%s\", \"variable\": \"%s\", "
+		 "\"neighbour\": %d, \"bytes\": %lu, \"messages\": %lu, "
+		 "\"wait\": %g, \"late\": %g }\n",
+		 sim->time.t, domain->pid, p->phase, p->variable, p->process,
+		 p->bytes, p->messages, p->wait, p->late);
+      else
+	fprintf (fpp, "%g %d %s %s %d %lu %lu %g %g\n",
+		 sim->time.t, domain->pid, p->phase, p->variable, p->process,
+		 p->bytes, p->messages, p->wait, p->late);
+    }
+    g_ptr_array_free (a, TRUE);
+    if (!GFS_OUTPUT (event)->parallel)
+      gfs_union_close (fp, domain->pid, &uf);
+    fflush (fp);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void gfs_output_mpi_profile_class_init (GfsOutputClass * klass)
+{
+  GFS_EVENT_CLASS (klass)->event = gfs_output_mpi_profile_event;
+  GTS_OBJECT_CLASS (klass)->read = gfs_output_mpi_profile_read;
+  GTS_OBJECT_CLASS (klass)->write = gfs_output_mpi_profile_write;
+}
+
+GfsOutputClass * gfs_output_mpi_profile_class (void)
+{
+  static GfsOutputClass * klass = NULL;
+
+  if (klass == NULL) {
+    GtsObjectClassInfo gfs_output_mpi_profile_info = {
+      "GfsOutputMpiProfile",
+      sizeof (GfsOutputMpiProfile),
+      sizeof (GfsOutputClass),
+      (GtsObjectClassInitFunc) gfs_output_mpi_profile_class_init,
+      (GtsObjectInitFunc) NULL,
+      (GtsArgSetFunc) NULL,
+      (GtsArgGetFunc) NULL
+    };
+    klass = gts_object_class_new (GTS_OBJECT_CLASS (gfs_output_class ()),
+				  &gfs_output_mpi_profile_info);
+  }
+
+  return klass;
+}
+
+/** \endobject{GfsOutputMpiProfile} */
+
 /**
  * orces and moments on the embedded solid boundaries.
  * \beginobject{GfsOutputSolidForce}
@@ -1419,6 +1624,19 @@ static gboolean output_simulation_event (GfsEvent * event, GfsSimulation * sim)
       break;
     }
 
+    case GFS_INDEXED: {
+      /* the name of the output file is only known by the master PE */
+      gchar * fname = gfs_format_string (GFS_OUTPUT (event)->formats, domain->pid,
+					 sim->time.i, sim->time.t);
+      gchar * data = g_strconcat (fname, ".data", NULL);
+      g_free (fname);
+      if (!gfs_simulation_indexed_write (sim, output->max_depth, GFS_OUTPUT (event)->file->fp,
+					 data))
+	gfs_error (0, "GfsOutputSimulation: could not write indexed data file `%s'\n", data);
+      g_free (data);
+      break;
+    }
+
     case GFS_VTK: {
       gfs_domain_write_vtk (domain, output->max_depth, domain->variables_io, output->precision,
 			    GFS_OUTPUT (event)->file->fp);
@@ -1475,6 +1693,7 @@ static void output_simulation_write (GtsObject * o, FILE * fp)
   case GFS_TEXT:    fputs (" format = text", fp);    break;
   case GFS_VTK:     fputs (" format = VTK", fp);     break;
   case GFS_TECPLOT: fputs (" format = Tecplot", fp); break;
+  case GFS_INDEXED: fputs (" format = indexed", fp); break;
   default: break;
   }
   if (output->precision != default_precision)
@@ -1541,6 +1760,16 @@ static void output_simulation_read (GtsObject ** o, GtsFile * fp)
 	output->format = GFS_VTK;
       else if (!strcmp (format, "Tecplot"))
 	output->format = GFS_TECPLOT;
+      else if (!strcmp (format, "indexed")) {
+	GfsOutput * o = GFS_OUTPUT (output);
+	if (!strcmp (o->format, "stdout") || !strcmp (o->format, "stderr") || o->parallel) {
+	  gts_file_variable_error (fp, var, "format",
+				   "the indexed format requires a single (non-standard) file");
+	  g_free (format);
+	  return;
+	}
+	output->format = GFS_INDEXED;
+      }
       else {
 	gts_file_variable_error (fp, var, "format",
 				 "unknown format `%s'", format);
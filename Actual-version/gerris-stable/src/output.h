@@ -101,6 +101,24 @@ GfsOutputClass * gfs_output_timing_class (void);
 
 GfsOutputClass * gfs_output_balance_class  (void);
 
+/* GfsOutputMpiProfile: Header */
+
+typedef struct _GfsOutputMpiProfile         GfsOutputMpiProfile;
+
+struct _GfsOutputMpiProfile {
+  /*< private >*/
+  GfsOutput parent;
+
+  /*< public >*/
+  gboolean json;
+};
+
+#define GFS_OUTPUT_MPI_PROFILE(obj)            GTS_OBJECT_CAST (obj,\
+					         GfsOutputMpiProfile,\
+					         gfs_output_mpi_profile_class ())
+
+GfsOutputClass * gfs_output_mpi_profile_class  (void);
+
 /* GfsOutputSolidForce: Header */
 
 typedef struct _GfsOutputSolidForce         GfsOutputSolidForce;
@@ -147,7 +165,8 @@ typedef struct _GfsOutputSimulation         GfsOutputSimulation;
 typedef enum   { GFS, 
 		 GFS_TEXT, 
 		 GFS_VTK, 
-		 GFS_TECPLOT }              GfsOutputSimulationFormat;
+		 GFS_TECPLOT,
+		 GFS_INDEXED }              GfsOutputSimulationFormat;
 
 struct _GfsOutputSimulation {
   GfsOutput parent;
@@ -22,6 +22,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "poisson.h"
 #include "solid.h"
 #include "source.h"
@@ -64,6 +65,20 @@ void gfs_multilevel_params_write (GfsMultilevelParams * par, FILE * fp)
     fprintf (fp, "  omega     = %g\n", par->omega);
   if (par->function)
     fputs ("  function  = 1\n", fp);
+  if (par->smoother == GFS_SMOOTHER_RBGS)
+    fputs ("  smoother  = rbgs\n", fp);
+  if (par->assemble)
+    fputs ("  assemble  = 1\n", fp);
+  if (par->fmg)
+    fprintf (fp, "  fmg       = 1\n  fmgchange = %g\n", par->fmgchange);
+  if (par->adaptive)
+    fputs ("  adaptive  = 1\n", fp);
+  if (par->lag)
+    fputs ("  lag       = 1\n", fp);
+  if (par->krylov == GFS_KRYLOV_CG)
+    fputs ("  krylov    = cg\n", fp);
+  else if (par->krylov == GFS_KRYLOV_BICGSTAB)
+    fputs ("  krylov    = bicgstab\n", fp);
   fputc ('}', fp);
 }
 
@@ -84,8 +99,23 @@ void gfs_multilevel_params_init (GfsMultilevelParams * par)
   par->omega = 1.;
 
   par->function = FALSE;
+  par->smoother = GFS_SMOOTHER_JACOBI;
+  par->assemble = FALSE;
+  par->krylov = GFS_KRYLOV_NONE;
+  par->fmg = FALSE;
+  par->fmgchange = 0.2;
+  par->adaptive = FALSE;
+  par->lag = FALSE;
+  par->matrices = NULL;
 
   par->poisson_solve = gfs_poisson_solve;
+
+  par->time = par->time_total = 0.;
+  par->fmg_start = FALSE;
+  par->nleaves = 0.;
+  par->nhistory = 0;
+  par->nsolve = 0;
+  par->niter_total = 0;
 }
 
 void gfs_multilevel_params_read (GfsMultilevelParams * par, GtsFile * fp)
@@ -93,6 +123,7 @@ void gfs_multilevel_params_read (GfsMultilevelParams * par, GtsFile * fp)
   g_return_if_fail (par != NULL);
   g_return_if_fail (fp != NULL);
 
+  gchar * smoother = NULL, * krylov = NULL;
   GtsFileVariable var[] = {
     {GTS_DOUBLE, "tolerance", TRUE, &par->tolerance},
     {GTS_UINT,   "nrelax",    TRUE, &par->nrelax},
@@ -104,12 +135,53 @@ void gfs_multilevel_params_read (GfsMultilevelParams * par, GtsFile * fp)
     {GTS_DOUBLE, "beta",      TRUE, &par->beta},
     {GTS_DOUBLE, "omega",     TRUE, &par->omega},
     {GTS_INT,    "function",  TRUE, &par->function},
+    {GTS_STRING, "smoother",  TRUE, &smoother},
+    {GTS_INT,    "assemble",  TRUE, &par->assemble},
+    {GTS_STRING, "krylov",    TRUE, &krylov},
+    {GTS_INT,    "fmg",       TRUE, &par->fmg},
+    {GTS_DOUBLE, "fmgchange", TRUE, &par->fmgchange},
+    {GTS_INT,    "adaptive",  TRUE, &par->adaptive},
+    {GTS_INT,    "lag",       TRUE, &par->lag},
     {GTS_NONE}
   };
 
   gts_file_assign_variables (fp, var);
-  if (fp->type == GTS_ERROR)
+  if (fp->type == GTS_ERROR) {
+    g_free (smoother);
+    g_free (krylov);
     return;
+  }
+
+  if (smoother) {
+    if (!strcmp (smoother, "jacobi"))
+      par->smoother = GFS_SMOOTHER_JACOBI;
+    else if (!strcmp (smoother, "rbgs"))
+      par->smoother = GFS_SMOOTHER_RBGS;
+    else {
+      gts_file_variable_error (fp, var, "smoother",
+			       "unknown smoother `%s'", smoother);
+      g_free (smoother);
+      g_free (krylov);
+      return;
+    }
+    g_free (smoother);
+  }
+
+  if (krylov) {
+    if (!strcmp (krylov, "none"))
+      par->krylov = GFS_KRYLOV_NONE;
+    else if (!strcmp (krylov, "cg"))
+      par->krylov = GFS_KRYLOV_CG;
+    else if (!strcmp (krylov, "bicgstab"))
+      par->krylov = GFS_KRYLOV_BICGSTAB;
+    else {
+      gts_file_variable_error (fp, var, "krylov",
+			       "unknown Krylov method `%s'", krylov);
+      g_free (krylov);
+      return;
+    }
+    g_free (krylov);
+  }
 
   if (par->tolerance <= 0.) {
     gts_file_variable_error (fp, var, "tolerance",
@@ -123,6 +195,8 @@ void gfs_multilevel_params_read (GfsMultilevelParams * par, GtsFile * fp)
     gts_file_variable_error (fp, var, "erelax", "erelax must be non zero");
   if (par->beta < 0.5 || par->beta > 1.)
     gts_file_variable_error (fp, var, "beta", "beta must be in [0.5,1]");
+  if (par->fmgchange < 0.)
+    gts_file_variable_error (fp, var, "fmgchange", "fmgchange must be positive");
 }
 
 static gdouble rate (gdouble a, gdouble b, guint n)
@@ -169,6 +243,31 @@ void gfs_multilevel_params_stats_write (GfsMultilevelParams * par,
 	   rate (par->residual.infty,
 		 par->residual_before.infty,
 		 par->niter));
+  if (par->nsolve > 0)
+    fprintf (fp,
+	     "    smoother: %s%s\n"
+	     "    time: %10.3e s\n"
+	     "    average over %u solutions: niter: %6.2f time: %10.3e s\n",
+	     par->smoother == GFS_SMOOTHER_RBGS ? "red-black Gauss-Seidel" : "Jacobi",
+	     par->krylov == GFS_KRYLOV_CG ? ", CG" : 
+	     par->krylov == GFS_KRYLOV_BICGSTAB ? ", BiCGStab" : "",
+	     par->time,
+	     par->nsolve,
+	     par->niter_total/(gdouble) par->nsolve,
+	     par->time_total/par->nsolve);
+  if (par->fmg_start)
+    fputs ("    full multigrid start\n", fp);
+  if (par->nhistory > 0) {
+    /* convergence history: residual and number of relaxations of
+       each iteration */
+    guint i;
+    fputs ("    history:", fp);
+    for (i = 0; i < par->nhistory; i++)
+      fprintf (fp, " %.3e/%u", par->history[i], par->nrelax_history[i]);
+    if (par->niter > par->nhistory)
+      fputs (" ...", fp);
+    fputc ('\n', fp);
+  }
 }
 
 /* GfsLinearProblem: Object */
@@ -494,15 +593,370 @@ GfsLinearProblem * gfs_get_poisson_problem (GfsDomain * domain,
   return lp;
 }
 
+/* GfsSparseMatrix: Object */
+
+static void reset_id (FttCell * cell, GfsLinearProblem * lp)
+{
+  GFS_VALUE (cell, lp->id) = -1;
+  GFS_DOUBLE_TO_POINTER (GFS_VALUE (cell, lp->neighbor)) = NULL;
+}
+
+static void reset_bc_all (FttCellFace * f, GfsLinearProblem * lp)
+{
+  reset_id (f->cell, lp);
+}
+
+static void box_reset_bc_all (GfsBox * box, GfsLinearProblem * lp)
+{ 
+  FttDirection d;
+  
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY (box->neighbor[d]) && !GFS_IS_BOUNDARY_PERIODIC (box->neighbor[d])) {
+      GfsBoundary * b = GFS_BOUNDARY (box->neighbor[d]);
+      ftt_face_traverse_boundary (b->root, b->d,
+				  FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+				  (FttFaceTraverseFunc) reset_bc_all, lp);
+    }
+}
+
+static void matrix_numbering (FttCell * cell, gpointer * data)
+{
+  GfsLinearProblem * lp = data[0];
+  GPtrArray * cells = data[1];
+
+  GFS_VALUE (cell, lp->id) = cells->len;
+  g_ptr_array_add (cells, cell);
+}
+
+static void matrix_stencil (FttCell * cell, RelaxStencilParams * p)
+{
+  FttCellNeighbors neighbor;
+  FttCellFace f;
+  GfsGradient ng;
+  GfsStencil * stencil = gfs_stencil_new (cell, p->lp, 0.);
+  gdouble a = GFS_VALUE (cell, p->dia);
+
+  f.cell = cell;
+  ftt_cell_neighbors (cell, &neighbor);
+  for (f.d = 0; f.d < FTT_NEIGHBORS; f.d++) {
+    f.neighbor = neighbor.c[f.d];
+    if (f.neighbor) {
+      gfs_face_weighted_gradient_stencil (&f, &ng, p->maxlevel, p->lp, stencil);
+      a += ng.a;
+    }
+  }
+  if (a != 0.)
+    gfs_stencil_add_element (stencil, cell, p->lp, -a);
+  else {
+    /* same as relax(): the solution is zero */
+    guint i;
+    for (i = 0; i < stencil->coeff->len; i++)
+      g_array_index (stencil->coeff, double, i) = 0.;
+  }
+  gfs_linear_problem_add_stencil (p->lp, stencil);
+}
+
+/**
+ * gfs_sparse_matrix_new:
+ * @domain: a #GfsDomain.
+ * @dia: the diagonal weight.
+ * @maxlevel: the level of the matrix.
+ * @v: the variable defining the (homogeneous) boundary conditions.
+ *
+ * Assembles the matrix of the Poisson operator defined by the face
+ * coefficients and @dia on the leaf cells of @domain with a level
+ * inferior or equal to @maxlevel and on all the cells at level
+ * @maxlevel (i.e. the operator relaxed by gfs_relax()). The
+ * homogeneous boundary conditions of @v are folded into the
+ * coefficients, so that no boundary conditions need to be applied
+ * when using the matrix.
+ *
+ * The off-diagonal coefficients are stored in ELLPACK format
+ * (i.e. @width coefficients per row, padded with zeros, stored
+ * column by column) so that products with the matrix vectorize
+ * well. The rows are in the order of a pre-order traversal of the
+ * cells.
+ *
+ * The cells of neighboring processes are not taken into account
+ * i.e. @domain must not be distributed.
+ *
+ * Returns: a new #GfsSparseMatrix.
+ */
+GfsSparseMatrix * gfs_sparse_matrix_new (GfsDomain * domain,
+					 GfsVariable * dia,
+					 gint maxlevel,
+					 GfsVariable * v)
+{
+  g_return_val_if_fail (domain != NULL, NULL);
+  g_return_val_if_fail (domain->pid < 0, NULL);
+  g_return_val_if_fail (dia != NULL, NULL);
+  g_return_val_if_fail (v != NULL, NULL);
+
+  gfs_domain_timer_start (domain, "sparse_matrix_new");
+
+  GfsLinearProblem * lp = gfs_linear_problem_new (domain);
+  GPtrArray * cells = g_ptr_array_new ();
+  gpointer data[2];
+
+  /* numbering */
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+			    (FttCellTraverseFunc) reset_id, lp);
+  data[0] = lp;
+  data[1] = cells;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS,
+			    maxlevel, (FttCellTraverseFunc) matrix_numbering, data);
+  gfs_domain_bc (domain, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, maxlevel, lp->id);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_reset_bc_all, lp);
+  gfs_domain_homogeneous_bc_stencil (domain, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS,
+				     maxlevel, v, v, lp);
+
+  /* stencils */
+  RelaxStencilParams p = { lp, dia, maxlevel };
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS,
+			    maxlevel, (FttCellTraverseFunc) matrix_stencil, &p);
+  g_assert (lp->LP->len == cells->len);
+
+  /* ELLPACK storage */
+  GfsSparseMatrix * m = g_malloc (sizeof (GfsSparseMatrix));
+  guint i, j, k, n = cells->len;
+  m->n = n;
+  m->cells = (FttCell **) g_ptr_array_free (cells, FALSE);
+  m->width = 0;
+  for (i = 0; i < n; i++) {
+    GfsStencil * stencil = g_ptr_array_index (lp->LP, i);
+    if (stencil->id->len - 1 > m->width)
+      m->width = stencil->id->len - 1;
+  }
+  m->col = g_malloc (sizeof (gint)*MAX (m->width*n, 1));
+  m->val = g_malloc (sizeof (gdouble)*MAX (m->width*n, 1));
+  m->dia = g_malloc (sizeof (gdouble)*MAX (n, 1));
+  for (i = 0; i < n; i++) {
+    GfsStencil * stencil = g_ptr_array_index (lp->LP, i);
+    m->dia[i] = 0.;
+    for (j = k = 0; j < stencil->id->len; j++) {
+      gint id = g_array_index (stencil->id, int, j);
+      gdouble c = g_array_index (stencil->coeff, double, j);
+      if (id == i)
+	m->dia[i] = - c;
+      else {
+	g_assert (id >= 0 && id < n);
+	m->col[k*n + i] = id;
+	m->val[k*n + i] = c;
+	k++;
+      }
+    }
+    for (; k < m->width; k++) {
+      m->col[k*n + i] = i;
+      m->val[k*n + i] = 0.;
+    }
+  }
+  gfs_linear_problem_destroy (lp);
+
+  /* red-black colours: a row is regular if all its neighbors have
+     the other colour */
+  guchar * colour = g_malloc (sizeof (guchar)*MAX (n, 1));
+  for (i = 0; i < n; i++)
+    colour[i] = gfs_cell_colour (m->cells[i]);
+  m->ncolour[0] = m->ncolour[1] = m->ncolour[2] = 0;
+  for (i = 0; i < n; i++) {
+    for (k = 0; k < m->width; k++)
+      if (m->val[k*n + i] != 0. && colour[m->col[k*n + i]] == colour[i])
+	break;
+    if (k < m->width)
+      colour[i] = 2;
+    m->ncolour[colour[i]]++;
+  }
+  m->order = g_malloc (sizeof (guint)*MAX (n, 1));
+  guint start[3] = { 0, m->ncolour[0], m->ncolour[0] + m->ncolour[1] };
+  for (i = 0; i < n; i++)
+    m->order[start[colour[i]]++] = i;
+  g_free (colour);
+
+  m->x = g_malloc (sizeof (gdouble)*MAX (n, 1));
+  m->rhs = g_malloc (sizeof (gdouble)*MAX (n, 1));
+  m->res = g_malloc (sizeof (gdouble)*MAX (n, 1));
+
+  gfs_domain_timer_stop (domain, "sparse_matrix_new");
+
+  return m;
+}
+
+/**
+ * gfs_sparse_matrix_gather:
+ * @m: a #GfsSparseMatrix.
+ * @v: a #GfsVariable.
+ * @x: a vector of size @m->n.
+ *
+ * Copies the values of @v in the cells of @m into @x.
+ */
+void gfs_sparse_matrix_gather (GfsSparseMatrix * m, GfsVariable * v, gdouble * x)
+{
+  g_return_if_fail (m != NULL);
+  g_return_if_fail (v != NULL);
+  g_return_if_fail (x != NULL);
+
+  guint i;
+  for (i = 0; i < m->n; i++)
+    x[i] = GFS_VALUE (m->cells[i], v);
+}
+
+/**
+ * gfs_sparse_matrix_scatter:
+ * @m: a #GfsSparseMatrix.
+ * @x: a vector of size @m->n.
+ * @v: a #GfsVariable.
+ *
+ * Copies @x into the values of @v in the cells of @m.
+ */
+void gfs_sparse_matrix_scatter (GfsSparseMatrix * m, const gdouble * x, GfsVariable * v)
+{
+  g_return_if_fail (m != NULL);
+  g_return_if_fail (x != NULL);
+  g_return_if_fail (v != NULL);
+
+  guint i;
+  for (i = 0; i < m->n; i++)
+    GFS_VALUE (m->cells[i], v) = x[i];
+}
+
+static inline void relax_row (GfsSparseMatrix * m, gdouble * x, const gdouble * rhs,
+			      gdouble omega, guint i)
+{
+  guint k, n = m->n;
+  const gint * col = &m->col[i];
+  const gdouble * val = &m->val[i];
+  gdouble b = 0.;
+
+  for (k = 0; k < m->width; k++)
+    b += val[k*n]*x[col[k*n]];
+  if (m->dia[i] != 0.)
+    x[i] = (1. - omega)*x[i] + omega*(b - rhs[i])/m->dia[i];
+  else
+    x[i] = 0.;
+}
+
+/**
+ * gfs_sparse_matrix_relax:
+ * @m: a #GfsSparseMatrix.
+ * @x: the solution.
+ * @rhs: the right-hand side.
+ * @omega: the over-relaxation parameter.
+ * @smoother: the #GfsSmoother.
+ * @nthreads: the number of threads to use.
+ *
+ * Applies one relaxation to the system defined by @m and @rhs. The
+ * Jacobi smoother relaxes the rows in order, in place (as
+ * gfs_relax()). The red-black Gauss-Seidel smoother relaxes the rows
+ * of each colour using @nthreads threads, then the irregular rows.
+ */
+void gfs_sparse_matrix_relax (GfsSparseMatrix * m,
+			      gdouble * x, const gdouble * rhs,
+			      gdouble omega,
+			      GfsSmoother smoother,
+			      guint nthreads)
+{
+  g_return_if_fail (m != NULL);
+  g_return_if_fail (x != NULL);
+  g_return_if_fail (rhs != NULL);
+
+  if (smoother == GFS_SMOOTHER_RBGS) {
+    const guint * order = m->order;
+    gint i, n;
+    guint c;
+    for (c = 0; c < 2; order += m->ncolour[c++]) {
+      n = m->ncolour[c];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nthreads) schedule (static)
+#endif
+      for (i = 0; i < n; i++)
+	relax_row (m, x, rhs, omega, order[i]);
+    }
+    for (i = 0; i < m->ncolour[2]; i++)
+      relax_row (m, x, rhs, omega, order[i]);
+  }
+  else {
+    guint i;
+    for (i = 0; i < m->n; i++)
+      relax_row (m, x, rhs, omega, i);
+  }
+}
+
+/**
+ * gfs_sparse_matrix_residual:
+ * @m: a #GfsSparseMatrix.
+ * @x: the solution.
+ * @rhs: the right-hand side.
+ * @res: the residual.
+ * @nthreads: the number of threads to use.
+ *
+ * Sets @res to the residual of the system defined by @m and @rhs
+ * i.e. @rhs minus the product of @m with @x (using the same sign
+ * convention as gfs_residual()).
+ */
+void gfs_sparse_matrix_residual (GfsSparseMatrix * m,
+				 const gdouble * x, const gdouble * rhs,
+				 gdouble * res,
+				 guint nthreads)
+{
+  g_return_if_fail (m != NULL);
+  g_return_if_fail (x != NULL);
+  g_return_if_fail (rhs != NULL);
+  g_return_if_fail (res != NULL);
+
+  gint i, n = m->n;
+  guint k;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nthreads) schedule (static)
+#endif
+  for (i = 0; i < n; i++)
+    res[i] = rhs[i] + m->dia[i]*x[i];
+  for (k = 0; k < m->width; k++) {
+    const gint * col = &m->col[k*n];
+    const gdouble * val = &m->val[k*n];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nthreads) schedule (static)
+#endif
+    for (i = 0; i < n; i++)
+      res[i] -= val[i]*x[col[i]];
+  }
+}
+
+/**
+ * gfs_sparse_matrix_destroy:
+ * @m: a #GfsSparseMatrix.
+ *
+ * Frees all the memory allocated for @m.
+ */
+void gfs_sparse_matrix_destroy (GfsSparseMatrix * m)
+{
+  g_return_if_fail (m != NULL);
+
+  g_free (m->cells);
+  g_free (m->col);
+  g_free (m->val);
+  g_free (m->dia);
+  g_free (m->order);
+  g_free (m->x);
+  g_free (m->rhs);
+  g_free (m->res);
+  g_free (m);
+}
+
 typedef struct {
   guint u, rhs, dia, res;
   gint maxlevel;
   gdouble beta, omega;
   guint metric;
+  GfsLeafIndex * leaves;
 } RelaxParams;
 
 /* relax_stencil() needs to be updated whenever this
  * function is modified
+ *
+ * The relaxation functions only use @p and @cell and its neighbors,
+ * however they are not thread-safe because the neighboring values
+ * they read are updated in place.
  */
 static void relax (FttCell * cell, RelaxParams * p)
 {
@@ -514,7 +968,7 @@ static void relax (FttCell * cell, RelaxParams * p)
   g.a = GFS_VALUEI (cell, p->dia);
   g.b = 0.;
   f.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (f.d = 0; f.d < FTT_NEIGHBORS; f.d++) {
     f.neighbor = neighbor.c[f.d];
     if (f.neighbor) {
@@ -539,7 +993,7 @@ static void relax2D (FttCell * cell, RelaxParams * p)
   g.a = GFS_VALUEI (cell, p->dia);
   g.b = 0.;
   f.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (f.d = 0; f.d < FTT_NEIGHBORS_2D; f.d++) {
     f.neighbor = neighbor.c[f.d];
     if (f.neighbor) {
@@ -572,7 +1026,7 @@ static void relax_dirichlet (FttCell * cell, RelaxParams * p)
     g.b = 0.;
 
   f.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (f.d = 0; f.d < FTT_NEIGHBORS; f.d++) {
     f.neighbor = neighbor.c[f.d];
     gfs_face_cm_weighted_gradient (&f, &ng, p->u, p->maxlevel);
@@ -622,6 +1076,7 @@ void gfs_relax (GfsDomain * domain,
   p.dia = dia->i;
   p.maxlevel = max_depth;
   p.omega = omega;
+  p.leaves = domain->leaves;
   gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, 
 			    FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS,
 			    max_depth,
@@ -631,6 +1086,7 @@ void gfs_relax (GfsDomain * domain,
 			    &p);
 }
 
+/* the residual functions are thread-safe */
 static void residual_set (FttCell * cell, RelaxParams * p)
 {
   GfsGradient g;
@@ -641,7 +1097,7 @@ static void residual_set (FttCell * cell, RelaxParams * p)
   g.a = GFS_VALUEI (cell, p->dia);
   g.b = 0.;
   f.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (f.d = 0; f.d < FTT_NEIGHBORS; f.d++) {
     f.neighbor = neighbor.c[f.d];
     if (f.neighbor) {
@@ -664,7 +1120,7 @@ static void residual_set2D (FttCell * cell, RelaxParams * p)
   g.a = GFS_VALUEI (cell, p->dia);
   g.b = 0.;
   f.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (f.d = 0; f.d < FTT_NEIGHBORS_2D; f.d++) {
     f.neighbor = neighbor.c[f.d];
     if (f.neighbor) {
@@ -691,7 +1147,7 @@ static void residual_set_dirichlet (FttCell * cell, RelaxParams * p)
     g.b = 0.;
 
   f.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (f.d = 0; f.d < FTT_NEIGHBORS; f.d++) {
     f.neighbor = neighbor.c[f.d];
     gfs_face_cm_weighted_gradient (&f, &ng, p->u, p->maxlevel);
@@ -739,7 +1195,8 @@ void gfs_residual (GfsDomain * domain,
   p.dia = dia->i;
   p.res = res->i;
   p.maxlevel = max_depth;
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, flags, max_depth,
+  p.leaves = domain->leaves;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, flags | FTT_TRAVERSE_THREAD_SAFE, max_depth,
 			    (FttCellTraverseFunc) (u->centered ? 
 						   (d == 2 ? residual_set2D : residual_set) :
 						   residual_set_dirichlet),
@@ -1067,16 +1524,193 @@ static void get_from_below_2D (FttCell * cell, const GfsVariable * v)
   GFS_VALUE (cell, v) = val;
 }
 
+typedef struct {
+  GfsLeafIndex * index;
+  gdouble * u, * rhs, * dia;
+  guint dimension;
+  gboolean rbgs;
+} RelaxLeaves;
+
+static void relax_regular_leaf (RelaxLeaves * l, RelaxParams * p, guint i)
+{
+  GfsLeafIndex * index = l->index;
+  guint nd = l->dimension == 2 ? FTT_NEIGHBORS_2D : FTT_NEIGHBORS;
+  const gint * nb = &index->neighbor[FTT_NEIGHBORS*i];
+  const gdouble * w = &index->weight[FTT_NEIGHBORS*i];
+  gdouble * u = l->u;
+  gdouble a = l->dia[i], b = 0.;
+  FttDirection d;
+
+  for (d = 0; d < nd; d++)
+    if (nb[d] >= 0) {
+      a += w[d];
+      b += w[d]*u[nb[d]];
+    }
+  if (a == 0.)
+    u[i] = 0.;
+  else if (l->dimension == 2)
+    u[i] = (1. - p->omega)*u[i] + p->omega*(b - l->rhs[i])/a;
+  else
+    u[i] = (b - l->rhs[i])/a;
+  GFS_VALUEI (index->cells[i], p->u) = u[i];
+}
+
+/* Same as relax() (or relax2D()) applied to all the leaf cells. The
+   regular leaves only use the arrays of the leaf index, the others
+   fall back to @relaxfunc. The new values are written in both.
+
+   With red-black ordering, the regular leaves of each colour only
+   depend on leaves of the other colour and are relaxed in parallel
+   (using the threads of the domain). The irregular leaves are then
+   relaxed serially. */
+static void relax_leaves (RelaxLeaves * l, RelaxParams * p, FttCellTraverseFunc relaxfunc)
+{
+  GfsLeafIndex * index = l->index;
+  gint i, n = index->n;
+
+  if (l->rbgs) {
+    guint c;
+    for (c = 0; c < 2; c++) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (index->domain->nthreads) schedule (static)
+#endif
+      for (i = 0; i < n; i++)
+	if (index->regular[i] && index->colour[i] == c)
+	  relax_regular_leaf (l, p, i);
+    }
+    for (i = 0; i < n; i++)
+      if (!index->regular[i]) {
+	(* relaxfunc) (index->cells[i], p);
+	l->u[i] = GFS_VALUEI (index->cells[i], p->u);
+      }
+    return;
+  }
+
+  for (i = 0; i < n; i++)
+    if (index->regular[i])
+      relax_regular_leaf (l, p, i);
+    else {
+      (* relaxfunc) (index->cells[i], p);
+      l->u[i] = GFS_VALUEI (index->cells[i], p->u);
+    }
+}
+
+/* Same as residual_set() (or residual_set2D()) applied to all the
+   leaf cells (using the threads of the domain) */
+static void residual_leaves (RelaxLeaves * l, RelaxParams * p, FttCellTraverseFunc residualfunc)
+{
+  GfsLeafIndex * index = l->index;
+  guint nd = l->dimension == 2 ? FTT_NEIGHBORS_2D : FTT_NEIGHBORS;
+  const gdouble * u = l->u;
+  gint i, n = index->n;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (index->domain->nthreads) schedule (static)
+#endif
+  for (i = 0; i < n; i++) {
+    FttCell * cell = index->cells[i];
+
+    if (index->regular[i]) {
+      const gint * nb = &index->neighbor[FTT_NEIGHBORS*i];
+      const gdouble * w = &index->weight[FTT_NEIGHBORS*i];
+      gdouble a = l->dia[i], b = 0.;
+      FttDirection d;
+
+      for (d = 0; d < nd; d++)
+	if (nb[d] >= 0) {
+	  a += w[d];
+	  b += w[d]*u[nb[d]];
+	}
+      GFS_VALUEI (cell, p->res) = l->rhs[i] - (b - u[i]*a);
+    }
+    else
+      (* residualfunc) (cell, p);
+  }
+}
+
+typedef struct {
+  RelaxParams * p;
+  FttCellTraverseFunc relax;
+  GfsVariable * colour;
+  gdouble c;
+} RelaxColour;
+
+/* The colour of a cell is its red-black colour if the values it
+   depends on are only those of its direct neighbors (regular cells of
+   the same level), 2 otherwise. */
+static void set_colour (FttCell * cell, RelaxColour * r)
+{
+  guint level = ftt_cell_level (cell);
+  FttCellNeighbors n;
+  FttDirection d;
+
+  GFS_VALUE (cell, r->colour) = 2.;
+  if (GFS_IS_MIXED (cell))
+    return;
+  gfs_leaf_index_neighbors (r->p->leaves, cell, &n);
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (n.c[d] && (ftt_cell_level (n.c[d]) != level ||
+		   (!FTT_CELL_IS_LEAF (n.c[d]) && level < r->p->maxlevel) ||
+		   GFS_IS_MIXED (n.c[d])))
+      return;
+  GFS_VALUE (cell, r->colour) = gfs_cell_colour (cell);
+}
+
+static void relax_colour (FttCell * cell, RelaxColour * r)
+{
+  if (GFS_VALUE (cell, r->colour) == r->c)
+    (* r->relax) (cell, r->p);
+}
+
 static void relax_loop (GfsDomain * domain, 
 			GfsVariable * dp, GfsVariable * u, 
 			RelaxParams * q, guint nrelax,
-			FttCellTraverseFunc relaxfunc)
+			FttCellTraverseFunc relaxfunc,
+			RelaxLeaves * l,
+			GfsVariable * colour)
 {
   guint n;
 
   gfs_domain_homogeneous_bc (domain,
 			     FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, q->maxlevel, 
 			     dp, u);
+  if (l) {
+    /* all the cells relaxed are leaves: use the leaf arrays */
+    l->u = gfs_leaf_index_gather (l->index, dp);
+    for (n = 0; n < nrelax - 1; n++) {
+      relax_leaves (l, q, relaxfunc);
+      gfs_domain_homogeneous_bc (domain,
+				 FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, q->maxlevel, 
+				 dp, u);
+    }
+    relax_leaves (l, q, relaxfunc);
+    return;
+  }
+  if (colour) {
+    /* red-black Gauss-Seidel: the cells of each colour are
+       independent, the irregular cells are relaxed serially */
+    RelaxColour r = { q, relaxfunc, colour, 0. };
+    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, 
+			      FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, q->maxlevel,
+			      (FttCellTraverseFunc) set_colour, &r);
+    for (n = 0; n < nrelax; n++) {
+      for (r.c = 0.; r.c < 2.; r.c += 1.)
+	gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, 
+				  FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS | 
+				  FTT_TRAVERSE_THREAD_SAFE, q->maxlevel,
+				  (FttCellTraverseFunc) relax_colour, &r);
+      if (n < nrelax - 1)
+	/* the irregular cells on parallel boundaries are relaxed first */
+	gfs_traverse_and_homogeneous_bc (domain, FTT_PRE_ORDER, 
+					 FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, q->maxlevel,
+					 (FttCellTraverseFunc) relax_colour, &r, dp, u);
+      else
+	gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, 
+				  FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, q->maxlevel,
+				  (FttCellTraverseFunc) relax_colour, &r);
+    }
+    return;
+  }
   for (n = 0; n < nrelax - 1; n++)
     gfs_traverse_and_homogeneous_bc (domain, FTT_PRE_ORDER, 
 				     FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, q->maxlevel,
@@ -1086,51 +1720,80 @@ static void relax_loop (GfsDomain * domain,
 			    relaxfunc, q);
 }
 
-/**
- * gfs_poisson_cycle:
- * @domain: the domain on which to solve the Poisson equation.
- * @p: the #GfsMultilevelParams.
- * @u: the variable to use as left-hand side.
- * @rhs: the variable to use as right-hand side.
- * @dia: the diagonal weight.
- * @res: the residual.
- *
- * Apply one multigrid iteration to the Poisson equation defined by @u
- * and @rhs.
- *
- * The initial value of @res on the leaves of @root must be set to
- * the residual of the Poisson equation (using gfs_residual()).
- *
- * The face coefficients must be set using gfs_poisson_coefficients().
- *
- * The values of @u on the leaf cells are updated as well as the values
- * of @res (i.e. the cell tree is ready for another iteration).
- */
-void gfs_poisson_cycle (GfsDomain * domain,
-			GfsMultilevelParams * p,
-			GfsVariable * u,
-			GfsVariable * rhs,
-			GfsVariable * dia,
-			GfsVariable * res)
+/* Same as relax_loop() but using the matrix of level @q->maxlevel,
+   assembled the first time it is needed during the solution */
+static GfsSparseMatrix * matrix_relax_loop (GfsDomain * domain,
+					    GfsMultilevelParams * p,
+					    GfsVariable * dp, GfsVariable * u,
+					    GfsVariable * dia, GfsVariable * res,
+					    RelaxParams * q, guint nrelax)
+{
+  guint n, level = q->maxlevel;
+
+  if (p->matrices->len <= level)
+    g_ptr_array_set_size (p->matrices, level + 1);
+  GfsSparseMatrix * m = g_ptr_array_index (p->matrices, level);
+  if (!m)
+    g_ptr_array_index (p->matrices, level) = m = 
+      gfs_sparse_matrix_new (domain, dia, level, u);
+
+  gfs_sparse_matrix_gather (m, dp, m->x);
+  gfs_sparse_matrix_gather (m, res, m->rhs);
+  for (n = 0; n < nrelax; n++)
+    gfs_sparse_matrix_relax (m, m->x, m->rhs, p->dimension == 2 ? p->omega : 1.,
+			     p->smoother, domain->nthreads);
+  gfs_sparse_matrix_scatter (m, m->x, dp);
+  /* for get_from_above() */
+  gfs_domain_homogeneous_bc (domain,
+			     FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, level, 
+			     dp, u);
+  return m;
+}
+
+/* Same as gfs_poisson_cycle() but using the homogeneous boundary
+   conditions of @v if @u is not @v (i.e. @u is a correction). If
+   @maxlevel is positive, the finest cells are the leaves of level
+   inferior or equal to @maxlevel and the cells at level @maxlevel
+   (and @p->depth must be @maxlevel). */
+static void poisson_cycle (GfsDomain * domain,
+			   GfsMultilevelParams * p,
+			   GfsVariable * u,
+			   GfsVariable * v,
+			   GfsVariable * rhs,
+			   GfsVariable * dia,
+			   GfsVariable * res,
+			   gint maxlevel)
 {
+  FttTraverseFlags finest = maxlevel < 0 ? 
+    FTT_TRAVERSE_LEAFS : FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS;
   guint l, nrelax, minlevel;
-  GfsVariable * dp;
+  GfsVariable * dp, * colour = NULL;
+  GfsSparseMatrix * m = NULL;
   gpointer data[2];
+  guint mark = gfs_domain_temporary_mark (domain);
   
-  g_return_if_fail (domain != NULL);
-  g_return_if_fail (p != NULL);
-  g_return_if_fail (p->dimension > 1 && p->dimension <= 3);
-  g_return_if_fail (u != NULL);
-  g_return_if_fail (rhs != NULL);
-  g_return_if_fail (dia != NULL);
-  g_return_if_fail (res != NULL);
-
-  dp = gfs_temporary_variable (domain);
+  /* structure-of-arrays leaf storage */
+  RelaxLeaves leaves;
+  leaves.index = v->centered && !p->matrices && maxlevel < 0 ? 
+    gfs_domain_leaf_index (domain) : NULL;
+
+  dp = gfs_domain_temporary_get (domain);
+  if (p->smoother == GFS_SMOOTHER_RBGS && !p->matrices)
+    colour = gfs_domain_temporary_get (domain);
   minlevel = MAX (domain->rootlevel, p->minlevel);
 
+  if (leaves.index) {
+    leaves.dimension = p->dimension;
+    leaves.rbgs = (colour != NULL);
+    leaves.rhs = gfs_leaf_index_gather (leaves.index, res);
+    leaves.dia = gfs_leaf_index_gather (leaves.index, dia);
+    gfs_leaf_index_gather_weights (leaves.index);
+  }
+
   /* compute residual on non-leafs cells */
   gfs_domain_cell_traverse (domain, 
-			    FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
+			    FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, 
+			    maxlevel > 0 ? maxlevel - 1 : -1,
 			    (FttCellTraverseFunc) (p->dimension == 2 ? 
 						   get_from_below_2D : 
 						   get_from_below_3D),
@@ -1147,13 +1810,18 @@ void gfs_poisson_cycle (GfsDomain * domain,
   q.dia = dia->i;
   q.maxlevel = minlevel;
   q.omega = p->omega;
+  q.leaves = leaves.index;
   
   gfs_domain_cell_traverse (domain,
 			    FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, q.maxlevel,
 			    (FttCellTraverseFunc) gfs_cell_reset, dp);
   FttCellTraverseFunc relaxfunc = (FttCellTraverseFunc)
-    (u->centered ? (p->dimension == 2 ? relax2D : relax) : relax_dirichlet);
-  relax_loop (domain, dp, u, &q, nrelax, relaxfunc);
+    (v->centered ? (p->dimension == 2 ? relax2D : relax) : relax_dirichlet);
+  if (p->matrices)
+    m = matrix_relax_loop (domain, p, dp, v, dia, res, &q, nrelax);
+  else
+    relax_loop (domain, dp, v, &q, nrelax, relaxfunc,
+		leaves.index && q.maxlevel >= p->depth ? &leaves : NULL, colour);
   nrelax /= p->erelax;
 
   /* relax from top to bottom */
@@ -1163,18 +1831,98 @@ void gfs_poisson_cycle (GfsDomain * domain,
 			      FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_NON_LEAFS, 
 			      q.maxlevel - 1,
 			      (FttCellTraverseFunc) get_from_above, dp);
-    relax_loop (domain, dp, u, &q, nrelax, relaxfunc);
+    if (p->matrices)
+      m = matrix_relax_loop (domain, p, dp, v, dia, res, &q, nrelax);
+    else
+      relax_loop (domain, dp, v, &q, nrelax, relaxfunc,
+		  leaves.index && q.maxlevel >= p->depth ? &leaves : NULL, colour);
   }
   /* correct on leaf cells */
   data[0] = u;
   data[1] = dp;
-  gfs_traverse_and_bc (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-		       (FttCellTraverseFunc) correct, data,
-		       u, u);
+  if (u == v)
+    gfs_traverse_and_bc (domain, FTT_PRE_ORDER, finest | FTT_TRAVERSE_THREAD_SAFE, maxlevel,
+			 (FttCellTraverseFunc) correct, data,
+			 u, u);
+  else
+    gfs_traverse_and_homogeneous_bc (domain, FTT_PRE_ORDER, 
+				     finest | FTT_TRAVERSE_THREAD_SAFE, maxlevel,
+				     (FttCellTraverseFunc) correct, data,
+				     u, v);
   /* compute new residual on leaf cells */
-  gfs_residual (domain, p->dimension, FTT_TRAVERSE_LEAFS, -1, u, rhs, dia, res);
+  if (m) {
+    /* the rows of the finest matrix are all the leaf cells */
+    gfs_sparse_matrix_residual (m, m->x, m->rhs, m->res, domain->nthreads);
+    gfs_sparse_matrix_scatter (m, m->res, res);
+  }
+  else if (leaves.index) {
+    q.u = u->i;
+    q.rhs = rhs->i;
+    q.res = res->i;
+    q.maxlevel = -1;
+    leaves.u = gfs_leaf_index_gather (leaves.index, u);
+    leaves.rhs = gfs_leaf_index_gather (leaves.index, rhs);
+    residual_leaves (&leaves, &q, (FttCellTraverseFunc) 
+		     (p->dimension == 2 ? residual_set2D : residual_set));
+  }
+  else
+    gfs_residual (domain, p->dimension, finest, maxlevel, u, rhs, dia, res);
 
-  gts_object_destroy (GTS_OBJECT (dp));
+  gfs_domain_temporary_release (domain, mark);
+}
+
+/**
+ * gfs_poisson_cycle:
+ * @domain: the domain on which to solve the Poisson equation.
+ * @p: the #GfsMultilevelParams.
+ * @u: the variable to use as left-hand side.
+ * @rhs: the variable to use as right-hand side.
+ * @dia: the diagonal weight.
+ * @res: the residual.
+ *
+ * Apply one multigrid iteration to the Poisson equation defined by @u
+ * and @rhs.
+ *
+ * The initial value of @res on the leaves of @root must be set to
+ * the residual of the Poisson equation (using gfs_residual()).
+ *
+ * The face coefficients must be set using gfs_poisson_coefficients().
+ *
+ * The values of @u on the leaf cells are updated as well as the values
+ * of @res (i.e. the cell tree is ready for another iteration).
+ *
+ * If @domain uses structure-of-arrays leaf storage, the relaxations
+ * on the finest level and the final residual use the arrays of its
+ * #GfsLeafIndex.
+ *
+ * During gfs_poisson_solve() with assembled matrices (@p->assemble),
+ * the relaxations use the matrix of each level (see
+ * gfs_sparse_matrix_new()) and the new residual is obtained by
+ * subtracting the product of the matrix of the finest level with the
+ * correction from the initial residual.
+ *
+ * If the smoother of @p is %GFS_SMOOTHER_RBGS, the relaxations use
+ * red-black Gauss-Seidel ordering rather than Jacobi. The cells of
+ * each colour are relaxed in parallel (if the domain uses threads),
+ * the cells next to a change of resolution or to a solid boundary
+ * are relaxed serially after both colours.
+ */
+void gfs_poisson_cycle (GfsDomain * domain,
+			GfsMultilevelParams * p,
+			GfsVariable * u,
+			GfsVariable * rhs,
+			GfsVariable * dia,
+			GfsVariable * res)
+{
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (p != NULL);
+  g_return_if_fail (p->dimension > 1 && p->dimension <= 3);
+  g_return_if_fail (u != NULL);
+  g_return_if_fail (rhs != NULL);
+  g_return_if_fail (dia != NULL);
+  g_return_if_fail (res != NULL);
+
+  poisson_cycle (domain, p, u, u, rhs, dia, res, -1);
 }
 
 /**
@@ -1209,6 +1957,259 @@ gdouble gfs_poisson_compatibility (GfsDomain * domain,
   return fabs (gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, rhs).bias);
 }
 
+static void history_add (GfsMultilevelParams * par)
+{
+  if (par->nhistory < GFS_MULTILEVEL_HISTORY) {
+    par->history[par->nhistory] = par->residual.infty;
+    par->nrelax_history[par->nhistory++] = par->nrelax;
+  }
+}
+
+/* Krylov acceleration */
+
+typedef struct {
+  GfsVariable * x, * y, * z;
+  gdouble a, b;
+} LinearCombination;
+
+static void linear_combination (FttCell * cell, LinearCombination * l)
+{
+  GFS_VALUE (cell, l->x) = l->a*GFS_VALUE (cell, l->y) + 
+    (l->z ? l->b*GFS_VALUE (cell, l->z) : 0.);
+}
+
+/* @x = @a*@y + @b*@z on all the leaf cells (@z can be NULL) */
+static void leaves_combine (GfsDomain * domain, 
+			    GfsVariable * x, 
+			    gdouble a, GfsVariable * y,
+			    gdouble b, GfsVariable * z)
+{
+  LinearCombination l = { x, y, z, a, b };
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, 
+			    FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_THREAD_SAFE, -1,
+			    (FttCellTraverseFunc) linear_combination, &l);
+}
+
+static void dot_product (FttCell * cell, gpointer * data)
+{
+  GfsVariable * x = data[0], * y = data[1];
+  gdouble * sum = data[2];
+  *sum += GFS_VALUE (cell, x)*GFS_VALUE (cell, y);
+}
+
+/* Returns: the dot product of @x and @y over all the leaf cells */
+static gdouble leaves_dot (GfsDomain * domain, GfsVariable * x, GfsVariable * y)
+{
+  gdouble sum = 0.;
+  gpointer data[3];
+  data[0] = x;
+  data[1] = y;
+  data[2] = &sum;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttCellTraverseFunc) dot_product, data);
+  gfs_all_reduce (domain, sum, MPI_DOUBLE, MPI_SUM);
+  return sum;
+}
+
+/* @y = minus the Poisson operator applied to @x (using the
+   homogeneous boundary conditions of @v) */
+static void apply_operator (GfsDomain * domain, GfsMultilevelParams * par,
+			    GfsVariable * x, GfsVariable * v, GfsVariable * dia,
+			    GfsVariable * y)
+{
+  gfs_domain_homogeneous_bc (domain, FTT_TRAVERSE_LEAFS, -1, x, v);
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, 
+			    FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_THREAD_SAFE, -1,
+			    (FttCellTraverseFunc) gfs_cell_reset, y);
+  /* the residual with zero right-hand-side */
+  gfs_residual (domain, par->dimension, FTT_TRAVERSE_LEAFS, -1, x, y, dia, y);
+}
+
+/* @z = one multigrid cycle applied to @r with a zero initial guess
+   (@w is used as workspace) */
+static void precondition (GfsDomain * domain, GfsMultilevelParams * par,
+			  GfsVariable * r, GfsVariable * v, GfsVariable * dia,
+			  GfsVariable * z, GfsVariable * w)
+{
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, 
+			    FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_THREAD_SAFE, -1,
+			    (FttCellTraverseFunc) gfs_cell_reset, z);
+  leaves_combine (domain, w, 1., r, 0., NULL);
+  poisson_cycle (domain, par, z, v, r, dia, w, -1);
+}
+
+static gboolean krylov_iterate (GfsMultilevelParams * par)
+{
+  return (par->niter < par->nitermin ||
+	  (par->residual.infty > par->tolerance && par->niter < par->nitermax));
+}
+
+/* Flexible preconditioned conjugate gradient. The residual @res is
+   updated by recurrence. */
+static void cg_solve (GfsDomain * domain, GfsMultilevelParams * par,
+		      GfsVariable * lhs, GfsVariable * res, GfsVariable * dia,
+		      gdouble dt)
+{
+  GfsVariable * z = gfs_temporary_variable (domain);
+  GfsVariable * p = gfs_temporary_variable (domain);
+  GfsVariable * q = gfs_temporary_variable (domain);
+  GfsVariable * w = gfs_temporary_variable (domain);
+
+  precondition (domain, par, res, lhs, dia, z, w);
+  leaves_combine (domain, p, 1., z, 0., NULL);
+  gdouble rz = leaves_dot (domain, res, z);
+  while (krylov_iterate (par)) {
+    apply_operator (domain, par, p, lhs, dia, q);
+    gdouble pq = leaves_dot (domain, p, q);
+    if (pq == 0.)
+      break;
+    gdouble alpha = - rz/pq;
+    leaves_combine (domain, lhs, 1., lhs, alpha, p);
+    leaves_combine (domain, res, 1., res, alpha, q);
+    par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+    par->niter++;
+    history_add (par);
+    if (!krylov_iterate (par))
+      break;
+
+    precondition (domain, par, res, lhs, dia, z, w);
+    gdouble rznew = leaves_dot (domain, res, z);
+    if (rz == 0.)
+      break;
+    /* Polak-Ribiere: the preconditioner is not exactly symmetric */
+    gdouble beta = alpha*leaves_dot (domain, z, q)/rz;
+    rz = rznew;
+    leaves_combine (domain, p, 1., z, beta, p);
+  }
+
+  gts_object_destroy (GTS_OBJECT (z));
+  gts_object_destroy (GTS_OBJECT (p));
+  gts_object_destroy (GTS_OBJECT (q));
+  gts_object_destroy (GTS_OBJECT (w));
+}
+
+/* Right-preconditioned BiCGStab (two multigrid cycles per
+   iteration). The residual @res is updated by recurrence. */
+static void bicgstab_solve (GfsDomain * domain, GfsMultilevelParams * par,
+			    GfsVariable * lhs, GfsVariable * res, GfsVariable * dia,
+			    gdouble dt)
+{
+  GfsVariable * rhat = gfs_temporary_variable (domain);
+  GfsVariable * p = gfs_temporary_variable (domain);
+  GfsVariable * v = gfs_temporary_variable (domain);
+  GfsVariable * y = gfs_temporary_variable (domain);
+  GfsVariable * t = gfs_temporary_variable (domain);
+  GfsVariable * w = gfs_temporary_variable (domain);
+  gdouble rho = 1., alpha = 1., omega = 1.;
+
+  leaves_combine (domain, rhat, 1., res, 0., NULL);
+  leaves_combine (domain, p, 0., res, 0., NULL);
+  leaves_combine (domain, v, 0., res, 0., NULL);
+  while (krylov_iterate (par)) {
+    gdouble rho1 = leaves_dot (domain, rhat, res);
+    if (rho1 == 0. || omega == 0.)
+      break;
+    gdouble beta = (rho1/rho)*(alpha/omega);
+    rho = rho1;
+    /* @v is minus the operator applied to the previous direction */
+    leaves_combine (domain, p, 1., p, omega, v);
+    leaves_combine (domain, p, 1., res, beta, p);
+
+    precondition (domain, par, p, lhs, dia, y, w);
+    apply_operator (domain, par, y, lhs, dia, v);
+    gdouble rv = leaves_dot (domain, rhat, v);
+    if (rv == 0.)
+      break;
+    alpha = - rho1/rv;
+    leaves_combine (domain, lhs, 1., lhs, alpha, y);
+    leaves_combine (domain, res, 1., res, alpha, v);
+    par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+    if (par->niter + 1 >= par->nitermin && par->residual.infty <= par->tolerance) {
+      par->niter++;
+      history_add (par);
+      break;
+    }
+
+    precondition (domain, par, res, lhs, dia, y, w);
+    apply_operator (domain, par, y, lhs, dia, t);
+    gdouble tt = leaves_dot (domain, t, t);
+    omega = tt > 0. ? - leaves_dot (domain, t, res)/tt : 0.;
+    leaves_combine (domain, lhs, 1., lhs, omega, y);
+    leaves_combine (domain, res, 1., res, omega, t);
+    par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+    par->niter++;
+    history_add (par);
+  }
+
+  gts_object_destroy (GTS_OBJECT (rhat));
+  gts_object_destroy (GTS_OBJECT (p));
+  gts_object_destroy (GTS_OBJECT (v));
+  gts_object_destroy (GTS_OBJECT (y));
+  gts_object_destroy (GTS_OBJECT (t));
+  gts_object_destroy (GTS_OBJECT (w));
+}
+
+/* Full multigrid start: the correction of @lhs is obtained using
+   cycles on the successive levels of the mesh, each starting from
+   the correction interpolated from the coarser level. On entry @res
+   must be the residual. */
+static void fmg_start (GfsDomain * domain, GfsMultilevelParams * par,
+		       GfsVariable * lhs, GfsVariable * res, GfsVariable * dia)
+{
+  GfsVariable * e = gfs_temporary_variable (domain);
+  GfsVariable * r = gfs_temporary_variable (domain);
+  GfsVariable * w = gfs_temporary_variable (domain);
+  guint depth = par->depth, minlevel = MAX (domain->rootlevel, par->minlevel), l;
+
+  /* the residual on all levels */
+  leaves_combine (domain, r, 1., res, 0., NULL);
+  gfs_domain_cell_traverse (domain, 
+			    FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
+			    (FttCellTraverseFunc) (par->dimension == 2 ? 
+						   get_from_below_2D : 
+						   get_from_below_3D),
+			    r);
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+			    (FttCellTraverseFunc) gfs_cell_reset, e);
+
+  for (l = minlevel + 1; l <= depth; l++) {
+    if (l > minlevel + 1) {
+      /* initial guess from the coarser level */
+      gfs_domain_homogeneous_bc (domain, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, l - 1, 
+				 e, lhs);
+      gfs_domain_cell_traverse (domain,
+				FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_NON_LEAFS, l - 1,
+				(FttCellTraverseFunc) get_from_above, e);
+    }
+    if (l < depth) {
+      gfs_domain_homogeneous_bc (domain, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, l, e, lhs);
+      gfs_residual (domain, par->dimension, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_LEAFS, l, 
+		    e, r, dia, w);
+      par->depth = l;
+      poisson_cycle (domain, par, e, lhs, r, dia, w, l);
+    }
+  }
+  par->depth = depth;
+
+  /* the finest level is left to the cycles of gfs_poisson_solve() */
+  leaves_combine (domain, lhs, 1., lhs, 1., e);
+
+  gts_object_destroy (GTS_OBJECT (e));
+  gts_object_destroy (GTS_OBJECT (r));
+  gts_object_destroy (GTS_OBJECT (w));
+}
+
+/* Adaptive cycle control: the number of relaxations is increased
+   (up to ADAPTIVE_NRELAX times its initial value) when the residual
+   is reduced by less than ADAPTIVE_SLOW per cycle, decreased when it
+   is reduced by more than ADAPTIVE_FAST and the iterations stop when
+   it is reduced by less than ADAPTIVE_STALL with the maximum number
+   of relaxations */
+#define ADAPTIVE_FAST   0.05
+#define ADAPTIVE_SLOW   0.3
+#define ADAPTIVE_STALL  0.9
+#define ADAPTIVE_NRELAX 4
+
 /**
  * gfs_poisson_solve:
  * @domain: the domain over which the poisson problem is solved.
@@ -1221,6 +2222,32 @@ gdouble gfs_poisson_compatibility (GfsDomain * domain,
  *
  * Solves the poisson problem over domain using Gerris' native
  * multigrid poisson solver.
+ *
+ * If @par->krylov is not %GFS_KRYLOV_NONE (and @lhs is
+ * cell-centered), the multigrid cycle is used as preconditioner of a
+ * conjugate gradient (%GFS_KRYLOV_CG) or BiCGStab
+ * (%GFS_KRYLOV_BICGSTAB) iteration. The number of iterations is then
+ * the number of Krylov iterations (each BiCGStab iteration uses two
+ * cycles).
+ *
+ * If @par->fmg is set, the first solution and the solutions
+ * following a relative change of the number of leaf cells larger
+ * than @par->fmgchange (i.e. after a restart or a large adaptation
+ * of the mesh) start with a full multigrid cycle.
+ *
+ * If @par->adaptive is set, the number of relaxations of the
+ * multigrid cycles is adjusted according to the convergence factor
+ * of each cycle and the iterations stop when the cycles do not
+ * reduce the residual significantly anymore.
+ *
+ * If @par->lag is set, the global reduction of the residual of each
+ * cycle overlaps with the next cycle and the convergence is checked
+ * on the residual of the previous cycle (i.e. one more cycle than
+ * necessary may be performed).
+ *
+ * The residual and number of relaxations of the first
+ * %GFS_MULTILEVEL_HISTORY iterations are stored in the history of
+ * @par.
  */
 void gfs_poisson_solve (GfsDomain * domain, 
 			GfsMultilevelParams * par,
@@ -1235,36 +2262,113 @@ void gfs_poisson_solve (GfsDomain * domain,
   g_return_if_fail (dia != NULL);
 
   gfs_domain_timer_start (domain, "poisson_solve");
+  GTimer * timer = g_timer_new ();
 
   guint minlevel = par->minlevel;
   par->depth = gfs_domain_depth (domain);
   par->niter = 0;
 
+  /* the matrices of each level are assembled once per solution */
+  if (par->assemble && domain->pid < 0 && lhs->centered && par->dimension == FTT_DIMENSION)
+    par->matrices = g_ptr_array_new ();
+
   /* calculates the initial residual and its norm */
   gfs_residual (domain, par->dimension, FTT_TRAVERSE_LEAFS, -1, lhs, rhs, dia, res);
   par->residual_before = par->residual = 
     gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+  par->nhistory = 0;
+
+  /* full multigrid start */
+  par->fmg_start = FALSE;
+  if (par->fmg && lhs->centered) {
+    gdouble nleaves = gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1);
+    if (par->nleaves == 0. || fabs (nleaves - par->nleaves) > par->fmgchange*par->nleaves) {
+      fmg_start (domain, par, lhs, res, dia);
+      gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, lhs);
+      gfs_residual (domain, par->dimension, FTT_TRAVERSE_LEAFS, -1, lhs, rhs, dia, res);
+      par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+      par->fmg_start = TRUE;
+    }
+    par->nleaves = nleaves;
+  }
 
-  gdouble res_max_before = par->residual.infty;
+  if (par->krylov != GFS_KRYLOV_NONE && lhs->centered) {
+    if (par->krylov == GFS_KRYLOV_CG)
+      cg_solve (domain, par, lhs, res, dia, dt);
+    else
+      bicgstab_solve (domain, par, lhs, res, dia, dt);
+    /* the true residual */
+    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, lhs);
+    gfs_residual (domain, par->dimension, FTT_TRAVERSE_LEAFS, -1, lhs, rhs, dia, res);
+    par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+  }
+  else {
+    gdouble res_max_before = par->residual.infty;
+    guint nrelax = par->nrelax;
+    GfsReduction * lagged = NULL;
 
-  while (par->niter < par->nitermin ||
-	 (par->residual.infty > par->tolerance && par->niter < par->nitermax)) {
+    while (par->niter < par->nitermin ||
+	   (par->residual.infty > par->tolerance && par->niter < par->nitermax)) {
 
-    /* Does one iteration */
-    gfs_poisson_cycle (domain, par, lhs, rhs, dia, res);
+      /* Does one iteration */
+      gfs_poisson_cycle (domain, par, lhs, rhs, dia, res);
     
-    par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
-
-    if (par->residual.infty == res_max_before) /* convergence has stopped!! */
-      break;
-    if (par->residual.infty > res_max_before/1.1 && par->minlevel < par->depth)
-      par->minlevel++;
-    res_max_before = par->residual.infty;
-    par->niter++;
+      if (par->lag) {
+	GfsReduction * r = gfs_domain_norm_residual_begin (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+	if (lagged == NULL) {
+	  /* nothing to check yet */
+	  lagged = r;
+	  par->niter++;
+	  continue;
+	}
+	par->residual = gfs_domain_norm_residual_end (lagged);
+	lagged = r;
+      }
+      else
+	par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
+      history_add (par);
+
+      if (par->residual.infty == res_max_before) /* convergence has stopped!! */
+	break;
+      if (par->adaptive && res_max_before > 0.) {
+	gdouble factor = par->residual.infty/res_max_before;
+	if (factor > ADAPTIVE_SLOW && par->nrelax < ADAPTIVE_NRELAX*nrelax)
+	  par->nrelax++;
+	else if (factor > ADAPTIVE_STALL && par->niter + 1 >= par->nitermin) {
+	  /* cycles do not pay off anymore */
+	  par->niter++;
+	  break;
+	}
+	else if (factor < ADAPTIVE_FAST && par->nrelax > nrelax)
+	  par->nrelax--;
+      }
+      if (par->residual.infty > res_max_before/1.1 && par->minlevel < par->depth)
+	par->minlevel++;
+      res_max_before = par->residual.infty;
+      par->niter++;
+    }
+    if (lagged)
+      par->residual = gfs_domain_norm_residual_end (lagged);
+    par->nrelax = nrelax;
   }
 
   par->minlevel = minlevel;
 
+  if (par->matrices) {
+    guint i;
+    for (i = 0; i < par->matrices->len; i++)
+      if (g_ptr_array_index (par->matrices, i))
+	gfs_sparse_matrix_destroy (g_ptr_array_index (par->matrices, i));
+    g_ptr_array_free (par->matrices, TRUE);
+    par->matrices = NULL;
+  }
+
+  par->time = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+  par->time_total += par->time;
+  par->niter_total += par->niter;
+  par->nsolve++;
+
   gfs_domain_timer_stop (domain, "poisson_solve");
 }
 
@@ -1416,7 +2520,7 @@ static void diffusion_rhs (FttCell * cell, RelaxParams * p)
   h = ftt_cell_size (cell);
   val = GFS_VALUEI (cell, p->u);
   face.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (face.d = 0; face.d < FTT_NEIGHBORS; face.d++) {
     GfsGradient g;
 
@@ -1462,7 +2566,8 @@ void gfs_diffusion_rhs (GfsDomain * domain,
   p.dia = rhoc->i;
   p.beta = (1. - beta)/beta;
   p.metric = metric ? metric->i : FALSE;
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+  p.leaves = domain->leaves;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_THREAD_SAFE, -1,
 			    (FttCellTraverseFunc) diffusion_rhs, &p);
 }
 
@@ -1479,7 +2584,7 @@ static void diffusion_relax (FttCell * cell, RelaxParams * p)
     g.b = gfs_cell_dirichlet_gradient_flux (cell, p->u, p->maxlevel, 0.);
 
   face.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (face.d = 0; face.d < FTT_NEIGHBORS; face.d++) {
     GfsGradient ng;
 
@@ -1531,6 +2636,7 @@ static void diffusion_relax_stencil (FttCell * cell, RelaxStencilParams * p)
   gfs_linear_problem_add_stencil (p->lp, stencil);
 }
 
+/* thread-safe, as is diffusion_rhs() */
 static void diffusion_residual (FttCell * cell, RelaxParams * p)
 {
   gdouble a;
@@ -1550,7 +2656,7 @@ static void diffusion_residual (FttCell * cell, RelaxParams * p)
   }
 
   face.cell = cell;
-  ftt_cell_neighbors (cell, &neighbor);
+  gfs_leaf_index_neighbors (p->leaves, cell, &neighbor);
   for (face.d = 0; face.d < FTT_NEIGHBORS; face.d++) {
     GfsGradient ng;
 
@@ -1604,7 +2710,8 @@ void gfs_diffusion_residual (GfsDomain * domain,
   p.dia = rhoc->i;
   p.res = res->i;
   p.metric = metric ? metric->i : FALSE;
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+  p.leaves = domain->leaves;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_THREAD_SAFE, -1,
 			    (FttCellTraverseFunc) diffusion_residual, &p);
 }
 
@@ -1650,7 +2757,8 @@ void gfs_diffusion_cycle (GfsDomain * domain,
   g_return_if_fail (rhoc != NULL);
   g_return_if_fail (res != NULL);
 
-  dp = gfs_temporary_variable (domain);
+  guint mark = gfs_domain_temporary_mark (domain);
+  dp = gfs_domain_temporary_get (domain);
 
   /* compute residual on non-leafs cells */
   gfs_domain_cell_traverse (domain, 
@@ -1663,11 +2771,12 @@ void gfs_diffusion_cycle (GfsDomain * domain,
   p.res = res->i;
   p.dia = rhoc->i;
   p.metric = metric ? metric->i : FALSE;
+  p.leaves = domain->leaves;
 
   gfs_domain_cell_traverse (domain, 
 			    FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, levelmin,
 			    (FttCellTraverseFunc) gfs_cell_reset, dp);
-  relax_loop (domain, dp, u, &p, 10*nrelax, (FttCellTraverseFunc) diffusion_relax);
+  relax_loop (domain, dp, u, &p, 10*nrelax, (FttCellTraverseFunc) diffusion_relax, NULL, NULL);
   /* relax from top to bottom */
   for (p.maxlevel = levelmin + 1; p.maxlevel <= depth; p.maxlevel++) {
     /* get initial guess from coarser grid */ 
@@ -1675,18 +2784,18 @@ void gfs_diffusion_cycle (GfsDomain * domain,
 			      FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL | FTT_TRAVERSE_NON_LEAFS,
 			      p.maxlevel - 1,
 			      (FttCellTraverseFunc) get_from_above, dp);
-    relax_loop (domain, dp, u, &p, nrelax, (FttCellTraverseFunc) diffusion_relax);
+    relax_loop (domain, dp, u, &p, nrelax, (FttCellTraverseFunc) diffusion_relax, NULL, NULL);
   }
   /* correct on leaf cells */
   data[0] = u;
   data[1] = dp;
-  gfs_traverse_and_bc (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+  gfs_traverse_and_bc (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_THREAD_SAFE, -1,
 		       (FttCellTraverseFunc) correct, data,
 		       u, u);
   /* compute new residual on leaf cells */
   gfs_diffusion_residual (domain, u, rhs, rhoc, metric, res);
 
-  gts_object_destroy (GTS_OBJECT (dp));
+  gfs_domain_temporary_release (domain, mark);
 }
 
 static void scale_rhs (FttCell * cell, RelaxStencilParams * p)
@@ -28,6 +28,19 @@ extern "C" {
 
 #include "domain.h"
 
+typedef enum {
+  GFS_SMOOTHER_JACOBI,
+  GFS_SMOOTHER_RBGS
+} GfsSmoother;
+
+typedef enum {
+  GFS_KRYLOV_NONE,
+  GFS_KRYLOV_CG,
+  GFS_KRYLOV_BICGSTAB
+} GfsKrylov;
+
+#define GFS_MULTILEVEL_HISTORY 32
+
 typedef struct _GfsMultilevelParams GfsMultilevelParams;
 typedef void (* GfsPoissonSolverFunc) (GfsDomain * domain,
 				       GfsMultilevelParams * par,
@@ -47,8 +60,29 @@ struct _GfsMultilevelParams {
   guint depth;
   gboolean weighted, function;
   gdouble beta, omega;
+  GfsSmoother smoother;
+  gboolean assemble;
+  GfsKrylov krylov;
+  gboolean fmg;        /* full multigrid start after large changes of the mesh */
+  gdouble fmgchange;   /* relative change of the number of leaves triggering FMG */
+  gboolean adaptive;   /* adaptive number of relaxations */
+  gboolean lag;        /* convergence checked on the residual of the previous cycle */
   GfsNorm residual_before, residual;
   GfsPoissonSolverFunc poisson_solve;
+
+  /*< private >*/
+  GPtrArray * matrices; /* assembled matrix of each level (during a solution) */
+
+  /* statistics */
+  gdouble time;        /* wall-clock time of the last solution */
+  gboolean fmg_start;  /* whether the last solution started with FMG */
+  gdouble nleaves;     /* number of leaves for the last solution */
+  guint nhistory;      /* number of iterations in the history */
+  gdouble history[GFS_MULTILEVEL_HISTORY]; /* residual (infinity norm) of each iteration */
+  guint nrelax_history[GFS_MULTILEVEL_HISTORY]; /* nrelax of each iteration */
+  guint nsolve;        /* number of solutions */
+  gulong niter_total;  /* total number of iterations */
+  gdouble time_total;  /* total wall-clock time */
 };
 
 void                  gfs_multilevel_params_init     (GfsMultilevelParams * par);
@@ -151,6 +185,45 @@ GfsLinearProblem * gfs_get_diffusion_problem         (GfsDomain * domain,
 						      gint maxlevel,
 						      GfsVariable * v);
 
+/* GfsSparseMatrix: Object */
+
+typedef struct _GfsSparseMatrix GfsSparseMatrix;
+
+struct _GfsSparseMatrix {
+  FttCell ** cells; /* the cell of each row */
+  guint n;          /* number of rows */
+  guint width;      /* maximum number of off-diagonal coefficients per row */
+  gint * col;       /* columns of the off-diagonal coefficients (ELL: width*n) */
+  gdouble * val;    /* off-diagonal coefficients (ELL: width*n) */
+  gdouble * dia;    /* minus the diagonal coefficients */
+  guint * order;    /* rows sorted by red-black colour */
+  guint ncolour[3]; /* number of rows of each colour (2: irregular rows) */
+  gdouble * x, * rhs, * res; /* work vectors */
+};
+
+GfsSparseMatrix *  gfs_sparse_matrix_new             (GfsDomain * domain,
+						      GfsVariable * dia,
+						      gint maxlevel,
+						      GfsVariable * v);
+void               gfs_sparse_matrix_gather          (GfsSparseMatrix * m,
+						      GfsVariable * v,
+						      gdouble * x);
+void               gfs_sparse_matrix_scatter         (GfsSparseMatrix * m,
+						      const gdouble * x,
+						      GfsVariable * v);
+void               gfs_sparse_matrix_relax           (GfsSparseMatrix * m,
+						      gdouble * x,
+						      const gdouble * rhs,
+						      gdouble omega,
+						      GfsSmoother smoother,
+						      guint nthreads);
+void               gfs_sparse_matrix_residual        (GfsSparseMatrix * m,
+						      const gdouble * x,
+						      const gdouble * rhs,
+						      gdouble * res,
+						      guint nthreads);
+void               gfs_sparse_matrix_destroy         (GfsSparseMatrix * m);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
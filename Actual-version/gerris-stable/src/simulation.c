@@ -21,6 +21,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <math.h>
 #include <gmodule.h>
 #include "config.h"
@@ -35,6 +37,7 @@
 #include "map.h"
 #include "river.h"
 #include "version.h"
+#include "indexed.h"
 
 /**
  * The incompressible Euler solver.
@@ -1268,6 +1271,25 @@ void gfs_simulation_refine (GfsSimulation * sim)
  * case the @pos and @error fields of @fp are set.
  */
 GfsSimulation * gfs_simulation_read (GtsFile * fp)
+{
+  g_return_val_if_fail (fp != NULL, NULL);
+
+  return gfs_simulation_read_variables (fp, NULL);
+}
+
+/**
+ * gfs_simulation_read_variables:
+ * @fp: a #GtsFile.
+ * @variables: a comma-separated list of variable names or %NULL.
+ *
+ * As gfs_simulation_read() but only reads the variables in
+ * @variables from the indexed data file (see
+ * gfs_domain_read_variables()).
+ *
+ * Returns: the #GfsSimulation or %NULL if an error occured, in which
+ * case the @pos and @error fields of @fp are set.
+ */
+GfsSimulation * gfs_simulation_read_variables (GtsFile * fp, const gchar * variables)
 {
   GfsDomain * d;
   GSList * ml = NULL; /* list of preloaded modules */
@@ -1286,7 +1308,7 @@ GfsSimulation * gfs_simulation_read (GtsFile * fp)
       gts_file_next_token (fp);
   }
       
-  d = gfs_domain_read (fp);
+  d = gfs_domain_read_variables (fp, variables);
   if (d != NULL && !GFS_IS_SIMULATION (d)) {
     gts_file_error (fp, "parent graph is not a GfsSimulation");
     gts_object_destroy (GTS_OBJECT (d));
@@ -1460,6 +1482,78 @@ void gfs_simulation_union_write (GfsSimulation * sim,
   }
 }
 
+static void save_box_size (GfsBox * box, GArray * sizes)
+{
+  g_array_append_val (sizes, box->size);
+}
+
+static void reset_box_offset (GfsBox * box, gpointer * data)
+{
+  GArray * sizes = data[0];
+  guint * i = data[1];
+  box->offset = -1;
+  box->length = 0;
+  box->size = g_array_index (sizes, gint, (*i)++);
+}
+
+/**
+ * gfs_simulation_indexed_write:
+ * @sim: a #GfsSimulation.
+ * @max_depth: the maximum depth at which to stop writing cell tree
+ * data (-1 means no limit).
+ * @fp: a file pointer.
+ * @data: the name of the indexed data file.
+ *
+ * Writes the cell data of the boxes of @sim in the indexed data file
+ * called @data (see gfs_indexed_file_write()) and the union of the simulations on all processes (without
+ * the cell data) in @fp. The description of each box includes the
+ * offset and length of its data in @data.
+ *
+ * In parallel, the data of all the PEs is written collectively in
+ * the same file using MPI-IO.
+ *
+ * When read back with gfs_simulation_read(), each PE only reads the
+ * data of its own boxes. The number of PEs can be different from the
+ * number of PEs used for writing, in which case the domain needs to
+ * be partitioned again before the data is read (as done by gerris).
+ *
+ * This function must be called by all the PEs.
+ *
+ * Returns: %TRUE if the data file was written successfully, %FALSE
+ * otherwise.
+ */
+gboolean gfs_simulation_indexed_write (GfsSimulation * sim,
+				       gint max_depth,
+				       FILE * fp,
+				       const gchar * data)
+{
+  g_return_val_if_fail (sim != NULL, FALSE);
+  g_return_val_if_fail (fp != NULL, FALSE);
+  g_return_val_if_fail (data != NULL, FALSE);
+
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  GArray * sizes = g_array_new (FALSE, FALSE, sizeof (gint));
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) save_box_size, sizes);
+  gint depth = domain->max_depth_write;
+  domain->max_depth_write = max_depth;
+  gboolean status = gfs_indexed_file_write (domain, data);
+  domain->max_depth_write = depth;
+
+  if (status) {
+    gchar * name = domain->data;
+    domain->data = (gchar *) data;
+    gfs_simulation_union_write (sim, max_depth, fp);
+    domain->data = name;
+  }
+
+  guint i = 0;
+  gpointer datum[2] = { sizes, &i };
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) reset_box_offset, datum);
+  g_array_free (sizes, TRUE);
+
+  return status;
+}
+
 static gdouble min_cfl (GfsSimulation * sim)
 {
   gdouble cfl = (sim->advection_params.scheme == GFS_NONE ?
@@ -1524,7 +1618,9 @@ void gfs_simulation_set_timestep (GfsSimulation * sim)
     i = i->next;
   }
 
-  gfs_all_reduce (GFS_DOMAIN (sim), sim->advection_params.dt, MPI_DOUBLE, MPI_MIN);
+  /* the time of the next event is computed while the timestep is reduced */
+  GfsReduction * r = gfs_domain_reduce_begin (GFS_DOMAIN (sim), &sim->advection_params.dt, 1,
+					      GFS_REDUCE_MIN);
 
   gdouble tnext = G_MAXINT;
   i = sim->events->items;
@@ -1537,6 +1633,8 @@ void gfs_simulation_set_timestep (GfsSimulation * sim)
   if (sim->time.end < tnext)
     tnext = sim->time.end;
 
+  gfs_domain_reduce_end (r, &sim->advection_params.dt);
+
   gdouble n = ceil ((tnext - t)/sim->advection_params.dt);
   if (n > 0. && n < G_MAXINT) {
     sim->advection_params.dt = (tnext - t)/n;
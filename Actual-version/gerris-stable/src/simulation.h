@@ -108,7 +108,13 @@ void                 gfs_simulation_write        (GfsSimulation * sim,
 void                 gfs_simulation_union_write  (GfsSimulation * sim,
 						  gint max_depth,  
 						  FILE * fp);
+gboolean             gfs_simulation_indexed_write (GfsSimulation * sim,
+						   gint max_depth,
+						   FILE * fp,
+						   const gchar * data);
 GfsSimulation *      gfs_simulation_read         (GtsFile * fp);
+GfsSimulation *      gfs_simulation_read_variables (GtsFile * fp,
+						    const gchar * variables);
 GSList *             gfs_simulation_get_solids   (GfsSimulation * sim);
 guint                gfs_check_solid_fractions   (GfsDomain * domain);
 void                 gfs_simulation_refine       (GfsSimulation * sim);
@@ -391,6 +391,8 @@ static void variable_curvature_destroy (GtsObject * o)
 {
   if (GFS_VARIABLE_CURVATURE (o)->kmax)
     gts_object_destroy (GTS_OBJECT (GFS_VARIABLE_CURVATURE (o)->kmax));
+  if (GFS_VARIABLE_CURVATURE (o)->band)
+    g_ptr_array_free (GFS_VARIABLE_CURVATURE (o)->band, TRUE);
 
   (* GTS_OBJECT_CLASS (gfs_variable_curvature_class ())->parent_class->destroy) (o);
 }
@@ -607,13 +609,36 @@ static void variable_curvature_diffuse (GfsVariable * v, GfsVariable * f,
   gts_object_destroy (GTS_OBJECT (p.tmp));  
 }
 
+static void band_traverse (GPtrArray * band, FttCellTraverseFunc func, gpointer data)
+{
+  guint i;
+  for (i = 0; i < band->len; i++)
+    (* func) (g_ptr_array_index (band, i), data);
+}
+
+static void height_curvature_full (FttCell * cell, GfsVariable * v)
+{
+  if (GFS_IS_FULL (GFS_VALUE (cell, GFS_VARIABLE_CURVATURE (v)->f)))
+    height_curvature (cell, v);
+}
+
 static void variable_curvature_from_fraction (GfsEvent * event, GfsSimulation * sim)
 {
   GfsDomain * domain = GFS_DOMAIN (sim);
-  GfsVariable * kmax = GFS_VARIABLE_CURVATURE (event)->kmax;
-
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-			    (FttCellTraverseFunc) height_curvature, event);
+  GfsVariableCurvature * k = GFS_VARIABLE_CURVATURE (event);
+  GfsVariable * kmax = k->kmax;
+  /* the interfacial band of the VOF tracer, if it is up to date */
+  GPtrArray * band = GFS_IS_VARIABLE_TRACER_VOF (k->f) ?
+    gfs_variable_tracer_vof_band (GFS_VARIABLE_TRACER_VOF (k->f)) : NULL;
+
+  if (band && k->band && k->topology == domain->topology) {
+    /* undefine the curvature in the cells which left the band */
+    band_traverse (k->band, (FttCellTraverseFunc) height_curvature_full, event);
+    band_traverse (band, (FttCellTraverseFunc) height_curvature, event);
+  }
+  else
+    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      (FttCellTraverseFunc) height_curvature, event);
   gfs_domain_cell_traverse (domain, FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
 			    (FttCellTraverseFunc) GFS_VARIABLE (event)->fine_coarse, event);
   gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, GFS_VARIABLE (event));
@@ -624,8 +649,11 @@ static void variable_curvature_from_fraction (GfsEvent * event, GfsSimulation *
     variable_curvature_diffuse (kmax, GFS_VARIABLE_CURVATURE (event)->f, sim, 1);
   }
   variable_curvature_diffuse (GFS_VARIABLE (event), NULL, sim, 1);
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-			    (FttCellTraverseFunc) fit_curvature, event);
+  if (band)
+    band_traverse (band, (FttCellTraverseFunc) fit_curvature, event);
+  else
+    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      (FttCellTraverseFunc) fit_curvature, event);
   gfs_domain_cell_traverse (domain, FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
 			    (FttCellTraverseFunc) GFS_VARIABLE (event)->fine_coarse, event);
   gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, GFS_VARIABLE (event));
@@ -636,6 +664,22 @@ static void variable_curvature_from_fraction (GfsEvent * event, GfsSimulation *
     variable_curvature_diffuse (kmax, GFS_VARIABLE_CURVATURE (event)->f, sim, 1);
   }
   variable_curvature_diffuse (GFS_VARIABLE (event), NULL, sim, 1);
+
+  /* the curvature is now only defined close to the cells of the band */
+  if (band) {
+    if (k->band)
+      g_ptr_array_set_size (k->band, 0);
+    else
+      k->band = g_ptr_array_sized_new (band->len);
+    guint i;
+    for (i = 0; i < band->len; i++)
+      g_ptr_array_add (k->band, g_ptr_array_index (band, i));
+    k->topology = domain->topology;
+  }
+  else if (k->band) {
+    g_ptr_array_free (k->band, TRUE);
+    k->band = NULL;
+  }
 }
 
 static void normal (FttCell * cell, gpointer * data)
@@ -864,6 +908,7 @@ static void variable_curvature_init (GfsVariable * v)
   v->coarse_fine = curvature_coarse_fine;
   v->fine_coarse = curvature_fine_coarse;
   v->units = -1.;
+  GFS_VARIABLE_CURVATURE (v)->band = NULL;
 }
 
 GfsVariableClass * gfs_variable_curvature_class (void)
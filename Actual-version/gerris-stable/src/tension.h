@@ -98,6 +98,8 @@ typedef struct _GfsVariableCurvature                GfsVariableCurvature;
 struct _GfsVariableCurvature {
   /*< private >*/
   GfsVariable parent;
+  GPtrArray * band; /* the cells where the curvature was last defined */
+  gulong topology;
 
   /*< public >*/
   GfsVariable * f, * kmax;
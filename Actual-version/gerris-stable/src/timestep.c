@@ -103,11 +103,14 @@ void gfs_scale_gradients (GfsDomain * domain, guint dimension, GfsVariable ** g)
   gpointer data[2];
   data[0] = g;
   data[1] = &dimension;
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-			    (FttCellTraverseFunc) scale_cell_gradients, data);
+  gfs_traverse_and_bc (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+		       (FttCellTraverseFunc) scale_cell_gradients, data, g[0], g[0]);
+  GSList * list = NULL;
   FttComponent c;
-  for (c = 0; c < dimension; c++)
-    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, g[c]);
+  for (c = dimension - 1; c > 0; c--)
+    list = g_slist_prepend (list, g[c]);
+  gfs_domain_bc_multi (domain, FTT_TRAVERSE_LEAFS, -1, list);
+  g_slist_free (list);
 }
 
 typedef struct {
@@ -523,10 +526,13 @@ void gfs_correct_centered_velocities (GfsDomain * domain,
   data[1] = g;
   data[2] = &dt;
   data[3] = &dimension;
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-			    (FttCellTraverseFunc) correct, data);
-  for (c = 0; c < dimension; c++)
-    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, v[c]);
+  gfs_traverse_and_bc (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+		       (FttCellTraverseFunc) correct, data, v[0], v[0]);
+  GSList * list = NULL;
+  for (c = dimension - 1; c > 0; c--)
+    list = g_slist_prepend (list, v[c]);
+  gfs_domain_bc_multi (domain, FTT_TRAVERSE_LEAFS, -1, list);
+  g_slist_free (list);
 }
 
 /**
@@ -859,6 +865,14 @@ void gfs_remove_sinking_velocity (GfsDomain * domain, GfsAdvectionParams * par)
 			      (FttFaceTraverseFunc) remove_sinking, par);
 }
 
+/* the advection fluxes of advection.c can be computed by concurrent threads */
+static FttTraverseFlags flux_flags (GfsAdvectionParams * par)
+{
+  return (par->flux == gfs_face_advection_flux ||
+	  par->flux == gfs_face_velocity_advection_flux ||
+	  par->flux == gfs_face_velocity_convective_flux) ? FTT_TRAVERSE_THREAD_SAFE : 0;
+}
+
 static void variable_sources (GfsDomain * domain,
 			      GfsAdvectionParams * par,
 			      GfsVariable * sv,
@@ -877,7 +891,7 @@ static void variable_sources (GfsDomain * domain,
     gfs_add_sinking_velocity (domain, par);
     face_values_set ((FttCellTraverseFunc) gfs_cell_advected_face_values, par);
     gfs_domain_face_traverse (domain, FTT_XYZ,
-			      FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS | flux_flags (par), -1,
 			      (FttFaceTraverseFunc) par->flux, par);
     gfs_remove_sinking_velocity (domain, par);
     par->v = sv;
@@ -999,8 +1013,11 @@ void gfs_centered_velocity_advection_diffusion (GfsDomain * domain,
     else
       variable_sources (domain, par, par->v, gmac, g);
   }
-  for (c = 0; c < dimension; c++)
-    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, v[c]);
+  GSList * list = NULL;
+  for (c = dimension; c > 0; c--)
+    list = g_slist_prepend (list, v[c - 1]);
+  gfs_domain_bc_multi (domain, FTT_TRAVERSE_LEAFS, -1, list);
+  g_slist_free (list);
   face_values_free (par->v);
 
   gfs_domain_timer_stop (domain, "centered_velocity_advection_diffusion");
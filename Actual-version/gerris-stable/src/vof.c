@@ -794,6 +794,40 @@ gdouble gfs_vof_interpolate (FttCell * cell,
 # define F(x,y,z) f[x][y][z]
 #endif
 
+/* Returns the cell of @domain at @level (or the coarser leaf)
+   containing the center of the neighbor of @cell (of level @level)
+   with offset (@x,@y,@z). The neighbors are followed along each
+   direction in turn, using the table of neighbors of the leaf index
+   when possible, rather than locating the point in the domain. */
+static FttCell * stencil_neighbor (GfsDomain * domain, FttCell * cell, guint level,
+				   FttVector * o, gint x, gint y, gint z)
+{
+  static FttDirection dir[3][3] = {
+    { FTT_LEFT,   -1, FTT_RIGHT },
+    { FTT_BOTTOM, -1, FTT_TOP },
+#if FTT_2D
+    { -1,         -1, -1 }
+#else
+    { FTT_BACK,   -1, FTT_FRONT }
+#endif
+  };
+  gint s[3] = { x, y, z };
+  FttCell * n = cell;
+  FttComponent c;
+
+  for (c = 0; c < FTT_DIMENSION && n; c++)
+    if (s[c] != 0) {
+      if (n != cell && ftt_cell_level (n) != level)
+	/* coarser intermediate neighbor */
+	n = NULL;
+      else if ((n = gfs_leaf_index_neighbor (domain->leaves, n, dir[c][s[c] + 1])) &&
+	       GFS_CELL_IS_BOUNDARY (n))
+	/* ghost cells are located in their own boundary */
+	n = NULL;
+    }
+  return n ? n : gfs_domain_boundary_locate (domain, *o, level, NULL);
+}
+
 static void stencil (FttCell * cell, GfsVariable * v, gdouble F(3,3,3))
 {
   gdouble h = ftt_cell_size (cell);
@@ -811,7 +845,7 @@ static void stencil (FttCell * cell, GfsVariable * v, gdouble F(3,3,3))
 	if (x != 0 || y != 0 || z != 0) {
 	  FttVector o;
 	  o.x = p.x + h*x; o.y = p.y + h*y; o.z = p.z + h*z;
-	  FttCell * neighbor = gfs_domain_boundary_locate (v->domain, o, level, NULL);
+	  FttCell * neighbor = stencil_neighbor (v->domain, cell, level, &o, x, y, z);
 	  if (neighbor)
 	    F(x + 1, y + 1, z + 1) =
 	      gfs_vof_interpolate (neighbor, &o, level, GFS_VARIABLE_TRACER_VOF (v));
@@ -959,6 +993,117 @@ static void allocate_normal_alpha (GfsVariableTracerVOF * t)
   g_free (description);
 }
 
+/* the curvature is defined up to two cells away from the interface
+   (see variable_curvature_from_fraction()) */
+#define BAND_HALO 2
+
+static void band_add (FttCell * cell, GHashTable * band, guint halo)
+{
+  if (GPOINTER_TO_UINT (g_hash_table_lookup (band, cell)) > halo)
+    return; /* already added with a wider halo */
+  g_hash_table_insert (band, cell, GUINT_TO_POINTER (halo + 1));
+  if (halo > 0) {
+    FttCellNeighbors n;
+    FttDirection d;
+
+    ftt_cell_neighbors (cell, &n);
+    for (d = 0; d < FTT_NEIGHBORS; d++)
+      if (n.c[d] && !GFS_CELL_IS_BOUNDARY (n.c[d])) {
+	if (FTT_CELL_IS_LEAF (n.c[d]))
+	  band_add (n.c[d], band, halo - 1);
+	else {
+	  FttCellChildren child;
+	  guint i, nc = ftt_cell_children_direction (n.c[d], FTT_OPPOSITE_DIRECTION (d), &child);
+	  for (i = 0; i < nc; i++)
+	    if (child.c[i] && FTT_CELL_IS_LEAF (child.c[i]))
+	      band_add (child.c[i], band, halo - 1);
+	}
+      }
+  }
+}
+
+static void band_append (FttCell * cell, gpointer halo, GPtrArray * band)
+{
+  g_ptr_array_add (band, cell);
+}
+
+/* replaces the band of @t with the cells of @interfacial and their
+   neighbors */
+static void band_build (GfsVariableTracerVOF * t, GPtrArray * interfacial, GfsDomain * domain)
+{
+  GHashTable * band = g_hash_table_new (NULL, NULL);
+  guint i;
+
+  for (i = 0; i < interfacial->len; i++)
+    band_add (g_ptr_array_index (interfacial, i), band, BAND_HALO);
+  if (t->band)
+    g_ptr_array_set_size (t->band, 0);
+  else
+    t->band = g_ptr_array_new ();
+  g_hash_table_foreach (band, (GHFunc) band_append, t->band);
+  g_hash_table_destroy (band);
+  t->topology = domain->topology;
+}
+
+static void add_interfacial (FttCell * cell, gpointer * data)
+{
+  if (!GFS_IS_FULL (GFS_VALUE (cell, GFS_VARIABLE (data[0]))))
+    g_ptr_array_add (data[1], cell);
+}
+
+/* Updates the normal and alpha of @v. If the interfacial cells have
+   been found during advection and the mesh did not change since the
+   last update on any PE, only the cells of the old and new bands are
+   considered. */
+static void update_normal_alpha (GfsVariable * v, GfsDomain * domain,
+				 FttCellTraverseFunc plane)
+{
+  GfsVariableTracerVOF * t = GFS_VARIABLE_TRACER_VOF (v);
+  GPtrArray * interfacial = t->interfacial;
+  FttComponent c;
+
+  t->interfacial = NULL;
+  /* the choice must be collective as both paths communicate differently */
+  guint usable = domain->band && interfacial && t->band && t->topology == domain->topology;
+  gfs_all_reduce (domain, usable, MPI_UNSIGNED, MPI_MIN);
+  if (usable) {
+    guint i;
+    /* cells which left the interface */
+    for (i = 0; i < t->band->len; i++) {
+      FttCell * cell = g_ptr_array_index (t->band, i);
+      if (GFS_IS_FULL (GFS_VALUE (cell, v)))
+	(* plane) (cell, v);
+    }
+    band_build (t, interfacial, domain);
+    for (i = 0; i < t->band->len; i++)
+      (* plane) (g_ptr_array_index (t->band, i), v);
+    for (c = 0; c < FTT_DIMENSION; c++)
+      gfs_domain_bc (domain, FTT_TRAVERSE_ALL, -1, t->m[c]);
+    gfs_domain_bc (domain, FTT_TRAVERSE_ALL, -1, t->alpha);
+  }
+  else {
+    guint l, depth = gfs_domain_depth (domain);
+    for (l = 0; l <= depth; l++) {
+      gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, l, plane, v);
+      for (c = 0; c < FTT_DIMENSION; c++)
+	gfs_domain_bc (domain, FTT_TRAVERSE_LEVEL, l, t->m[c]);
+      gfs_domain_bc (domain, FTT_TRAVERSE_LEVEL, l, t->alpha);
+    }
+    if (interfacial)
+      band_build (t, interfacial, domain);
+    else {
+      gpointer data[2];
+      data[0] = v;
+      data[1] = g_ptr_array_new ();
+      gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) add_interfacial, data);
+      band_build (t, data[1], domain);
+      g_ptr_array_free (data[1], TRUE);
+    }
+  }
+  if (interfacial)
+    g_ptr_array_free (interfacial, TRUE);
+}
+
 static void variable_tracer_vof_update (GfsVariable * v, GfsDomain * domain)
 {
   GfsVariableTracerVOF * t = GFS_VARIABLE_TRACER_VOF (v);
@@ -973,15 +1118,7 @@ static void variable_tracer_vof_update (GfsVariable * v, GfsDomain * domain)
   }
     
   /* update normals and alpha */
-  guint l, depth = gfs_domain_depth (domain);
-  FttComponent c;
-  for (l = 0; l <= depth; l++) {
-    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, l,
-			      (FttCellTraverseFunc) vof_plane, v);
-    for (c = 0; c < FTT_DIMENSION; c++)
-      gfs_domain_bc (domain, FTT_TRAVERSE_LEVEL, l, t->m[c]);
-    gfs_domain_bc (domain, FTT_TRAVERSE_LEVEL, l, t->alpha);
-  }
+  update_normal_alpha (v, domain, (FttCellTraverseFunc) vof_plane);
 }
 
 static gboolean variable_tracer_vof_event (GfsEvent * event, 
@@ -1007,6 +1144,10 @@ static void variable_tracer_vof_destroy (GtsObject * o)
     gts_object_destroy (GTS_OBJECT (v->alpha));
   }
   gts_object_destroy (GTS_OBJECT (v->concentrations));
+  if (v->band)
+    g_ptr_array_free (v->band, TRUE);
+  if (v->interfacial)
+    g_ptr_array_free (v->interfacial, TRUE);
 
   (* GTS_OBJECT_CLASS (gfs_variable_tracer_vof_class ())->parent_class->destroy) (o);
 }
@@ -1170,6 +1311,8 @@ static void variable_tracer_vof_init (GfsVariable * v)
   GFS_VARIABLE_TRACER (v)->advection.cfl = 0.5;
   GFS_VARIABLE_TRACER_VOF (v)->concentrations = 
     GTS_SLIST_CONTAINER (gts_container_new (GTS_CONTAINER_CLASS (gts_slist_container_class ())));
+  GFS_VARIABLE_TRACER_VOF (v)->band = NULL;
+  GFS_VARIABLE_TRACER_VOF (v)->interfacial = NULL;
 }
 
 GfsVariableTracerVOFClass * gfs_variable_tracer_vof_class (void)
@@ -1192,6 +1335,37 @@ GfsVariableTracerVOFClass * gfs_variable_tracer_vof_class (void)
   return klass;
 }
 
+/**
+ * gfs_variable_tracer_vof_band:
+ * @t: a #GfsVariableTracerVOF.
+ *
+ * The band contains the interfacial leaf cells of @t and the leaf
+ * cells up to two cells away from them, as found by the last update
+ * of the normals and alpha of @t. After advection, the band is
+ * updated from the interfacial cells found while computing the new
+ * volume fractions, so that only the cells of the band need to be
+ * reconstructed.
+ *
+ * Returns: the band of leaf cells of @t or %NULL if the mesh has
+ * changed since the band was built or if the domain does not use
+ * narrow-band reconstruction.
+ */
+GPtrArray * gfs_variable_tracer_vof_band (GfsVariableTracerVOF * t)
+{
+  g_return_val_if_fail (t != NULL, NULL);
+
+  GfsDomain * domain = GFS_VARIABLE (t)->domain;
+  if (domain->band && t->band && t->topology == domain->topology)
+    return t->band;
+  return NULL;
+}
+
+/* a concentration advected together with its VOF tracer */
+typedef struct {
+  GfsVariable * v, * f[2]; /* face values in the positive and negative directions */
+  GfsAdvectionParams * par;
+} VofConcentration;
+
 typedef struct {
   GfsAdvectionParams * par, vpar;
   GfsVariable * u, * du[FTT_DIMENSION - 1], * vof;
@@ -1199,6 +1373,10 @@ typedef struct {
   GfsDomain * domain;
   GfsFunction * sink;
   guint depth, too_coarse;
+  GSList * concentrations;
+  VofConcentration * fused;
+  guint nfused;
+  GPtrArray * interfacial;
 } VofParms;
 
 static gdouble plane_volume_shifted (FttVector m, gdouble alpha, FttVector p[2])
@@ -1478,6 +1656,71 @@ static void concentration_face_values (FttCell * cell, VofParms * p)
   GFS_VALUE (cell, p->par->fv) = 0.;
 }
 
+static void fused_face_values (FttCell * cell, VofParms * p)
+{
+  GfsStateVector * s = GFS_STATE (cell);
+  gdouble size = ftt_cell_size (cell);
+  if (p->domain->scale_metric)
+      size *= (* p->domain->scale_metric) (p->domain, cell, p->c);
+  gdouble unorm = p->par->dt*(s->f[2*p->c].un + s->f[2*p->c + 1].un)/(2.*size);
+  gdouble up = MIN ((1. - unorm)/2., 0.5), um = MAX ((- 1. - unorm)/2., -0.5);
+  guint k;
+  for (k = 0; k < p->nfused; k++) {
+    VofConcentration * t = &p->fused[k];
+    gdouble g = (* t->par->gradient) (cell, p->c, t->v->i);
+    gdouble v = GFS_VALUE (cell, t->v);
+    GFS_VALUE (cell, t->f[0]) = v + up*g;
+    GFS_VALUE (cell, t->f[1]) = v + um*g;
+    GFS_VALUE (cell, t->par->fv) = 0.;
+  }
+}
+
+/* applies the face boundary condition @data[0] to the face values
+   of concentration @data[1] */
+static void fused_face_bc (FttCellFace * face, gpointer * data)
+{
+  GfsBc * bc = data[0];
+  VofConcentration * t = data[1];
+  FttDirection od = FTT_OPPOSITE_DIRECTION (face->d);
+
+  GFS_STATE (face->neighbor)->f[od].v = GFS_VALUE (face->neighbor, t->f[od % 2]);
+  (* bc->face_bc) (face, bc);
+  GFS_VALUE (face->cell, t->f[face->d % 2]) = GFS_STATE (face->cell)->f[face->d].v;
+  GFS_VALUE (face->neighbor, t->f[od % 2]) = GFS_STATE (face->neighbor)->f[od].v;
+}
+
+static void box_fused_face_bc (GfsBox * box, VofParms * p)
+{
+  FttDirection d;
+
+  for (d = 2*p->c; d <= 2*p->c + 1; d++)
+    if (GFS_IS_BOUNDARY (box->neighbor[d]) && !GFS_IS_BOUNDARY_PERIODIC (box->neighbor[d])) {
+      GfsBoundary * b = GFS_BOUNDARY (box->neighbor[d]);
+      guint k;
+
+      for (k = 0; k < p->nfused; k++) {
+	gpointer data[2];
+	data[0] = gfs_boundary_lookup_bc (b, p->fused[k].v);
+	data[1] = &p->fused[k];
+	b->v = p->fused[k].v;
+	ftt_face_traverse_boundary (b->root, b->d,
+				    FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+				    (FttFaceTraverseFunc) fused_face_bc, data);
+      }
+    }
+}
+
+/* face values of all the fused concentrations: the values on
+   parallel and periodic boundaries are exchanged in a single
+   message, the other boundary conditions are applied locally */
+static void fused_face_values_bc (GfsDomain * domain, VofParms * p, GSList * faces)
+{
+  gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) fused_face_values, p);
+  gfs_domain_bc_multi (domain, FTT_TRAVERSE_LEAFS, -1, faces);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_fused_face_bc, p);
+}
+
+/* thread-safe (see gfs_domain_face_traverse()) if @p->sink is NULL */
 static void vof_flux (FttCellFace * face, VofParms * p)
 {
   gdouble size = ftt_cell_size (face->cell);
@@ -1513,6 +1756,7 @@ static void vof_flux (FttCellFace * face, VofParms * p)
   FttVector q[2] = {{0., 0., 0.},{1., 1., 1.}};
   gdouble flux = 0., unj = un;
   FttComponent ci = FTT_ORTHOGONAL_COMPONENT (p->c);
+  guint k;
 
 #if FTT_2D
   gdouble f = gfs_domain_face_fraction (p->vof->domain, face)/n;
@@ -1548,32 +1792,49 @@ static void vof_flux (FttCellFace * face, VofParms * p)
 	  dun[c] = - dun[c];
       }
       flux = fine_fraction (face, p->vof, uni, q)*uni*f;
-      if (p->par->v == p->vof)
-	GFS_VALUE (face->neighbor, p->vpar.fv) += uni*f;
+      if (p->par->v == p->vof) {
+	GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, p->vpar.fv), uni*f);
+	/* fused concentrations use the same fraction flux */
+	for (k = 0; k < p->nfused; k++) {
+	  VofConcentration * t = &p->fused[k];
+	  gdouble ft = flux*GFS_VALUE (face->cell, t->f[face->d % 2]);
+	  GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, t->par->fv), ft);
+	  GFS_ATOMIC_ADD (GFS_VALUE (face->cell, t->par->fv), - ft);
+	}
+      }
       else
 	flux *= GFS_STATE (face->cell)->f[face->d].v;
-      GFS_VALUE (face->neighbor, p->par->fv) += flux;	
+      GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, p->par->fv), flux);
       break;
     }
     case FTT_FINE_COARSE: {
       flux = uni > 0. ? 
 	fine_fraction (face, p->vof, uni, q)*uni*f : 
 	coarse_fraction (face, p->vof, -uni/2., q)*uni*f;
-      if (p->par->v == p->vof)
-	GFS_VALUE (face->neighbor, p->vpar.fv) += uni*f/FTT_CELLS;
+      if (p->par->v == p->vof) {
+	GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, p->vpar.fv), uni*f/FTT_CELLS);
+	for (k = 0; k < p->nfused; k++) {
+	  VofConcentration * t = &p->fused[k];
+	  gdouble ft = flux*(uni > 0. ?
+			     GFS_VALUE (face->cell, t->f[face->d % 2]) :
+			     GFS_VALUE (face->neighbor, t->f[FTT_OPPOSITE_DIRECTION (face->d) % 2]));
+	  GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, t->par->fv), ft/FTT_CELLS);
+	  GFS_ATOMIC_ADD (GFS_VALUE (face->cell, t->par->fv), - ft);
+	}
+      }
       else
 	flux *= uni > 0. ?
 	  GFS_STATE (face->cell)->f[face->d].v :
 	  GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].v;
-      GFS_VALUE (face->neighbor, p->par->fv) += flux/FTT_CELLS;
+      GFS_ATOMIC_ADD (GFS_VALUE (face->neighbor, p->par->fv), flux/FTT_CELLS);
       break;
     }
     default:
       g_assert_not_reached ();
     }
     if (p->par->v == p->vof)
-      GFS_VALUE (face->cell, p->vpar.fv) -= uni*f;
-    GFS_VALUE (face->cell, p->par->fv) -= flux;
+      GFS_ATOMIC_ADD (GFS_VALUE (face->cell, p->vpar.fv), - uni*f);
+    GFS_ATOMIC_ADD (GFS_VALUE (face->cell, p->par->fv), - flux);
   }
 
 #if !FTT_2D
@@ -1615,29 +1876,63 @@ static void f_over_dV (FttCell * cell, VofParms * p)
 {
   g_assert (GFS_VALUE (cell, p->vpar.v) > 0.);
   gdouble f = GFS_VALUE (cell, p->par->v)/GFS_VALUE (cell, p->vpar.v);
-  GFS_VALUE (cell, p->par->v) = f < 1e-10 ? 0. : f > 1. - 1e-10 ? 1. : f;
+  GFS_VALUE (cell, p->par->v) = f = f < 1e-10 ? 0. : f > 1. - 1e-10 ? 1. : f;
+  if (!GFS_IS_FULL (f))
+    g_ptr_array_add (p->interfacial, cell);
+}
+
+static void fused_times_dV (FttCell * cell, VofParms * p)
+{
+  gdouble dV = GFS_VALUE (cell, p->vpar.v)*GFS_VALUE (cell, p->vof);
+  guint k;
+  for (k = 0; k < p->nfused; k++)
+    GFS_VALUE (cell, p->fused[k].v) *= dV;
+}
+
+static void fused_update (GSList * merged, VofParms * p)
+{
+  guint k;
+  for (k = 0; k < p->nfused; k++)
+    (* p->fused[k].par->update) (merged, p->fused[k].par);
 }
 
 static void concentration_over_dV (FttCell * cell, VofParms * p)
 {
   gdouble f = GFS_VALUE (cell, p->vof);
-  if (f > 0.)
-    GFS_VALUE (cell, p->par->v) = GFS_VALUE (cell, p->par->v)/(GFS_VALUE (cell, p->vpar.v)*f);
+  GSList * i = p->concentrations;
+  if (f > 0.) {
+    gdouble dV = GFS_VALUE (cell, p->vpar.v)*f;
+    while (i) {
+      GFS_VALUE (cell, GFS_VARIABLE (i->data)) /= dV;
+      i = i->next;
+    }
+  }
   else
-    GFS_VALUE (cell, p->par->v) = GFS_NODATA;
+    while (i) {
+      GFS_VALUE (cell, GFS_VARIABLE (i->data)) = GFS_NODATA;
+      i = i->next;
+    }
 }
 
-static void per_vof_volume (FttCell * cell, GfsVariable * v)
+static void per_vof_volume (FttCell * cell, VofParms * p)
 {
-  GfsVariable * vof = GFS_VARIABLE (GFS_VARIABLE_VOF_CONCENTRATION (v)->vof);
-  gdouble f = GFS_VALUE (cell, vof);
-  GFS_VALUE (cell, v) = f > 0. ? GFS_VALUE (cell, v)/f : GFS_NODATA;
+  gdouble f = GFS_VALUE (cell, p->vof);
+  GSList * i = p->concentrations;
+  while (i) {
+    GfsVariable * v = i->data;
+    GFS_VALUE (cell, v) = f > 0. ? GFS_VALUE (cell, v)/f : GFS_NODATA;
+    i = i->next;
+  }
 }
 
-static void per_cell_volume (FttCell * cell, GfsVariable * v)
+static void per_cell_volume (FttCell * cell, VofParms * p)
 {
-  GfsVariable * vof = GFS_VARIABLE (GFS_VARIABLE_VOF_CONCENTRATION (v)->vof);
-  GFS_VALUE (cell, v) *= GFS_VALUE (cell, vof);
+  gdouble f = GFS_VALUE (cell, p->vof);
+  GSList * i = p->concentrations;
+  while (i) {
+    GFS_VALUE (cell, GFS_VARIABLE (i->data)) *= f;
+    i = i->next;
+  }
 }
 
 static void add_sink_velocity (FttCell * cell, VofParms * p)
@@ -1657,6 +1952,13 @@ static void remove_sink_velocity (FttCell * cell, VofParms * p)
  *
  * Advects the @v field of @par using the current face-centered (MAC)
  * velocity field.
+ *
+ * The concentrations associated with @v which do not have sink
+ * velocities are advected together with @v: the fraction flux
+ * through each face is computed once and applied to all of them in
+ * the same face traversal and the boundary conditions on their face
+ * values are applied in a single exchange. If #GfsDomain.fused is
+ * %FALSE, all the concentrations are advected one at a time.
  */
 void gfs_tracer_vof_advection (GfsDomain * domain,
 			       GfsAdvectionParams * par)
@@ -1672,24 +1974,41 @@ void gfs_tracer_vof_advection (GfsDomain * domain,
 
   gfs_domain_timer_start (domain, "tracer_vof_advection");
 
+  guint mark = gfs_domain_temporary_mark (domain);
   p.par = par;
   p.vof = par->v;
   p.sink = NULL;
   gfs_advection_params_init (&p.vpar);
   for (d = 0; d < FTT_DIMENSION - 1; d++)
-    p.du[d] = gfs_temporary_variable (domain);
-  p.vpar.v = gfs_temporary_variable (domain);
-  p.vpar.fv = gfs_temporary_variable (domain);
+    p.du[d] = gfs_domain_temporary_get (domain);
+  p.vpar.v = gfs_domain_temporary_get (domain);
+  p.vpar.fv = gfs_domain_temporary_get (domain);
   p.vpar.average = par->average;
   gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) initialize_dV, p.vpar.v);
-  par->fv = gfs_temporary_variable (domain);
+  par->fv = gfs_domain_temporary_get (domain);
   GSList * concentrations = GFS_VARIABLE_TRACER_VOF (p.vof)->concentrations->items, * j;
+  GSList * faces = NULL;
+  p.concentrations = concentrations;
+  p.fused = g_new (VofConcentration, g_slist_length (concentrations));
+  p.nfused = 0;
   j = concentrations;
   while (j) {
-    GFS_VARIABLE_TRACER (j->data)->advection.fv = gfs_temporary_variable (domain);
-    gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) per_vof_volume, j->data);
+    GfsAdvectionParams * cpar = &GFS_VARIABLE_TRACER (j->data)->advection;
+    cpar->fv = gfs_domain_temporary_get (domain);
+    /* face values cannot be exchanged as cell values through "rotated" boundaries */
+    if (domain->fused && !cpar->sink[0] && !domain->has_rotated_bc) {
+      VofConcentration * t = &p.fused[p.nfused++];
+      t->v = j->data;
+      t->par = cpar;
+      t->f[0] = gfs_domain_temporary_get (domain);
+      t->f[1] = gfs_domain_temporary_get (domain);
+      faces = g_slist_prepend (faces, t->f[1]);
+      faces = g_slist_prepend (faces, t->f[0]);
+    }
     j = j->next;
   }
+  if (concentrations)
+    gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) per_vof_volume, &p);
   for (c = 0; c < FTT_DIMENSION; c++) {
     p.c = (cstart + c) % FTT_DIMENSION;
     fix_too_coarse (domain, &p);
@@ -1697,16 +2016,29 @@ void gfs_tracer_vof_advection (GfsDomain * domain,
     gfs_domain_face_traverse (domain, p.c,
 			      FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
 			      (FttFaceTraverseFunc) reset_fluxes, &p);
-    gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) grad_u, &p);
-    for (d = 0; d < FTT_DIMENSION - 1; d++)
+    gfs_traverse_and_bc (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			 (FttCellTraverseFunc) grad_u, &p, p.du[0], p.du[0]);
+    for (d = 1; d < FTT_DIMENSION - 1; d++)
       gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, p.du[d]);
+    if (p.nfused > 0)
+      fused_face_values_bc (domain, &p, faces);
     gfs_domain_face_traverse (domain, p.c,
-			      FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS | FTT_TRAVERSE_THREAD_SAFE, -1,
 			      (FttFaceTraverseFunc) vof_flux, &p);
+    if (p.nfused > 0) {
+      gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) fused_times_dV, &p);
+      gfs_domain_traverse_merged (domain, (GfsMergedTraverseFunc) fused_update, &p);
+    }
+    guint nfused = p.nfused;
+    p.nfused = 0; /* the other concentrations are advected one at a time */
     j = concentrations;
     while (j) {
       GfsAdvectionParams * par = &GFS_VARIABLE_TRACER (j->data)->advection;
       GfsVariable * fv = p.par->fv;
+      if (nfused > 0 && !par->sink[0]) {
+	j = j->next;
+	continue;
+      }
       p.par->v = j->data;
       p.par->fv = par->fv;
       p.par->gradient = par->gradient;
@@ -1719,8 +2051,10 @@ void gfs_tracer_vof_advection (GfsDomain * domain,
       }
       gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) concentration_face_values, &p);
       gfs_domain_face_bc (domain, p.c, p.par->v);
+      /* the sink velocity is a user function which may not be thread-safe */
       gfs_domain_face_traverse (domain, p.c,
-				FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+				FTT_PRE_ORDER,
+				FTT_TRAVERSE_LEAFS | (p.sink ? 0 : FTT_TRAVERSE_THREAD_SAFE), -1,
 				(FttFaceTraverseFunc) vof_flux, &p);
       if (p.sink) {
 	gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) remove_sink_velocity, &p);
@@ -1735,35 +2069,31 @@ void gfs_tracer_vof_advection (GfsDomain * domain,
       p.par->v = p.vof;
       j = j->next;
     }
+    p.nfused = nfused;
     gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) f_times_dV, &p);
     gfs_domain_traverse_merged (domain, (GfsMergedTraverseFunc) par->update, par);
     gfs_domain_traverse_merged (domain, (GfsMergedTraverseFunc) par->update, &p.vpar);
+    p.interfacial = g_ptr_array_new ();
     gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) f_over_dV, &p);
-    j = concentrations;
-    while (j) {
-      p.par->v = j->data;
+    if (concentrations)
       gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) concentration_over_dV, &p);
-      p.par->v = p.vof;
-      j = j->next;
-    }
 
-    /* update VOF data (normals etc...) */
+    /* update VOF data (normals etc...) using the interfacial cells */
+    GFS_VARIABLE_TRACER_VOF (p.vof)->interfacial = p.interfacial;
     (* GFS_VARIABLE_TRACER_VOF_CLASS (GTS_OBJECT (p.par->v)->klass)->update) (p.par->v, domain);
   }
   cstart = (cstart + 1) % FTT_DIMENSION;
-  gts_object_destroy (GTS_OBJECT (par->fv));
   par->fv = NULL;
   j = concentrations;
   while (j) {
-    gts_object_destroy (GTS_OBJECT (GFS_VARIABLE_TRACER (j->data)->advection.fv));
     GFS_VARIABLE_TRACER (j->data)->advection.fv = NULL;
-    gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) per_cell_volume, j->data);
     j = j->next;
   }
-  gts_object_destroy (GTS_OBJECT (p.vpar.v));
-  gts_object_destroy (GTS_OBJECT (p.vpar.fv));
-  for (d = 0; d < FTT_DIMENSION - 1; d++)
-    gts_object_destroy (GTS_OBJECT (p.du[d]));
+  if (concentrations)
+    gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) per_cell_volume, &p);
+  g_free (p.fused);
+  g_slist_free (faces);
+  gfs_domain_temporary_release (domain, mark);
 
   gfs_domain_timer_stop (domain, "tracer_vof_advection");
 }
@@ -2460,7 +2790,7 @@ static void fit_from_fractions (FttCell * cell, GfsVariable * v, ParabolaFit * f
 	if (x != 0 || y != 0 || z != 0) {
 	  FttVector o;
 	  o.x = p.x + h*x; o.y = p.y + h*y; o.z = p.z + h*z;
-	  FttCell * neighbor = gfs_domain_boundary_locate (v->domain, o, level, NULL);
+	  FttCell * neighbor = stencil_neighbor (v->domain, cell, level, &o, x, y, z);
 	  if (neighbor)
 	    add_vof_center (neighbor, &o, level, &p, GFS_VARIABLE_TRACER_VOF (v),
 			    fit, 1.);
@@ -3506,16 +3836,7 @@ static void variable_tracer_vof_height_update (GfsVariable * v, GfsDomain * doma
   }
 
   /* update normals and alpha */
-  GfsVariableTracerVOF * t = GFS_VARIABLE_TRACER_VOF (v);
-  guint l, depth = gfs_domain_depth (domain);
-  FttComponent c;
-  for (l = 0; l <= depth; l++) {
-    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, l,
-			      (FttCellTraverseFunc) vof_height_plane, v);
-    for (c = 0; c < FTT_DIMENSION; c++)
-      gfs_domain_bc (domain, FTT_TRAVERSE_LEVEL, l, t->m[c]);
-    gfs_domain_bc (domain, FTT_TRAVERSE_LEVEL, l, t->alpha);
-  }
+  update_normal_alpha (v, domain, (FttCellTraverseFunc) vof_height_plane);
 }
 
 static void variable_tracer_vof_height_destroy (GtsObject * o)
@@ -72,6 +72,11 @@ struct _GfsVariableTracerVOF {
   GfsVariableTracer parent;
   /* a list of GfsVariableVOFConcentration associated with this VOF tracer */
   GtsSListContainer * concentrations;
+  /* the leaf cells close to the interface (see gfs_variable_tracer_vof_band()) */
+  GPtrArray * band;
+  gulong topology;
+  /* the interfacial cells found during advection or NULL */
+  GPtrArray * interfacial;
 
   /*< public >*/
   GfsVariable * m[FTT_DIMENSION], * alpha;
@@ -95,6 +100,7 @@ struct _GfsVariableTracerVOFClass {
 						   gfs_variable_tracer_vof_class ()))
 
 GfsVariableTracerVOFClass * gfs_variable_tracer_vof_class  (void);
+GPtrArray *                 gfs_variable_tracer_vof_band   (GfsVariableTracerVOF * t);
 
 /* GfsVariableVOFConcentration: header */
 
@@ -220,6 +220,9 @@ static void wave_run (GfsSimulation * sim)
       /* subcycling */
       guint n = rint (dt/sim->advection_params.dt);
       g_assert (fabs (sim->time.t + sim->advection_params.dt*n - tnext) < 1e-12);
+      GSList * list = NULL;
+      for (ith = wave->ntheta; ith > 0; ith--)
+	list = g_slist_prepend (list, GFS_WAVE (sim)->F[ik][ith - 1]);
       while (n--) {
 	for (ith = 0; ith < wave->ntheta; ith++) {
 	  FttVector cg;
@@ -236,7 +239,12 @@ static void wave_run (GfsSimulation * sim)
 	  			      &sim->advection_params);
 	  if (wave->alpha_s > 0.)
 	    gse_alleviation_diffusion (domain, t, &cg, sim->advection_params.dt);
-	  gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, t);
+	}
+	/* the directions are independent: their boundary conditions
+	   are applied together */
+	gfs_domain_bc_multi (domain, FTT_TRAVERSE_LEAFS, -1, list);
+	for (ith = 0; ith < wave->ntheta; ith++) {
+	  GfsVariable * t = GFS_WAVE (sim)->F[ik][ith];
 	  gfs_domain_cell_traverse (domain,
 				    FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
 				    (FttCellTraverseFunc) t->fine_coarse, t);
@@ -244,6 +252,7 @@ static void wave_run (GfsSimulation * sim)
 	gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) redo_some_events, sim);
 	gfs_simulation_adapt (sim);
       }
+      g_slist_free (list);
     }
 
     sim->advection_params.dt = dt;
@@ -0,0 +1,46 @@
+if test x$donotrun != xtrue; then
+    for raw in 0 1; do
+	if mpirun -np 2 gerris2D -DRAW=$raw $1 ; then :
+	else
+	    echo "  FAIL: mpirun -np 2 gerris2D -DRAW=$raw $1"
+	    exit 1
+	fi
+    done
+fi
+
+rm -f migration.tex
+for raw in 0 1; do
+    awk -v raw=$raw '{
+      if (raw == 1) name = "Raw state vectors";
+      else name = "Variable by variable";
+      printf ("%s & %d & %.3g \\\\\n", name, $1, $2 > 0. ? $1/$2 : 0.);
+    }' < migration-$raw >> migration.tex
+done
+
+for v in T U V P; do
+    if gfscompare2D -v end-0.gfs end-1.gfs $v 2> log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+    if awk '{ if ($1 == "total" && $8 > 0.) exit 1; }' < log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+done
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+binary = [float(x) for x in open('migration-0').readline().split()]
+raw = [float(x) for x in open('migration-1').readline().split()]
+if binary[0] == 0 or binary[0] != raw[0]:
+    print binary, raw
+    exit(1)
+EOF
+else
+   exit 1
+fi
@@ -0,0 +1,37 @@
+if test x$donotrun != xtrue; then
+    for global in 0 1; do
+	if mpirun -np 4 gerris2D -DGLOBAL=$global $1 2> log-$global ; then :
+	else
+	    cat log-$global
+	    echo "  FAIL: mpirun -np 4 gerris2D -DGLOBAL=$global $1"
+	    exit 1
+	fi
+    done
+fi
+
+rm -f partition.tex
+for global in 0 1; do
+    awk -v global=$global '/^EventBalance:/{
+      if (global == 1) name = "Hilbert curve";
+      else name = "Diffusion";
+      printf ("%s & %.3f & %.3f & %d & %d \\\\\n", name, $5, $7, $9, $11);
+      exit 0;
+    }' < log-$global >> partition.tex
+done
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+for l in open('log-1'):
+    s = l.split()
+    if s[0] == 'EventBalance:':
+        before, after = float(s[4]), float(s[6])
+        if after >= before:
+            print l
+            exit(1)
+        exit(0)
+exit(1)
+EOF
+else
+   exit 1
+fi
@@ -0,0 +1,34 @@
+if test x$donotrun != xtrue; then
+    for split in 0 1; do
+	if mpirun -np 2 gerris2D -DSPLIT=$split $1 2> log-$split ; then :
+	else
+	    cat log-$split
+	    echo "  FAIL: mpirun -np 2 gerris2D -DSPLIT=$split $1"
+	    exit 1
+	fi
+    done
+fi
+
+rm -f partition.tex
+for split in 0 1; do
+    awk -v split=$split '/^EventBalance:.*imbalance:/{
+      printf ("%d & %.3f & %.3f & %d & %d \\\\\n", split, $5, $7, $9, $11);
+      exit 0;
+    }' < log-$split >> partition.tex
+done
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+def imbalance(log):
+    for l in open(log):
+        s = l.split()
+        if s[0] == 'EventBalance:' and s[3] == 'imbalance:':
+            return float(s[6])
+    exit(1)
+if imbalance('log-1') >= imbalance('log-0'):
+    exit(1)
+EOF
+else
+   exit 1
+fi
@@ -0,0 +1,24 @@
+if test x$donotrun != xtrue; then
+    for band in 0 1; do
+	if mpirun -np 2 gerris2D -DBAND=$band $1 ; then :
+	else
+	    echo "  FAIL: mpirun -np 2 gerris2D -DBAND=$band $1"
+	    exit 1
+	fi
+    done
+fi
+
+for v in T T_x T_y T_alpha K; do
+    if gfscompare2D -v end-0.gfs end-1.gfs $v 2> log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+    if awk '{ if ($1 == "total" && $8 > 0.) exit 1; }' < log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+done
@@ -0,0 +1,19 @@
+if test x$donotrun != xtrue; then
+    if mpirun -np 2 gerris2D $1 ; then :
+    else
+	echo "  FAIL: mpirun -np 2 gerris2D $1"
+	exit 1
+    fi
+fi
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+cells = [float(l) for l in open('cells')]
+if len(cells) == 0 or max(cells) > 1.1*2000 or cells[-1] < 0.5*2000:
+    print cells
+    exit(1)
+EOF
+else
+   exit 1
+fi
@@ -0,0 +1,34 @@
+if test x$donotrun != xtrue; then
+    if mpirun -np 2 gerris2D $1 ; then :
+    else
+	echo "  FAIL: mpirun -np 2 gerris2D $1"
+	exit 1
+    fi
+    if gerris2D -e "OutputSimulation {} end-1.gfs" restart.gfs > /dev/null ; then :
+    else
+	echo "  FAIL: gerris2D restart.gfs"
+	exit 1
+    fi
+    if mpirun -np 4 gerris2D -e "OutputSimulation {} end-4.gfs" restart.gfs > /dev/null ; then :
+    else
+	echo "  FAIL: mpirun -np 4 gerris2D restart.gfs"
+	exit 1
+    fi
+fi
+
+for f in end-1 end-4 restart; do
+    for v in T U V P; do
+	if gfscompare2D -v end.gfs $f.gfs $v 2> log; then :
+	else
+	    cat log
+	    echo "  FAIL: $f $v"
+	    exit 1
+	fi
+	if awk '{ if ($1 == "total" && $8 > 0.) exit 1; }' < log; then :
+	else
+	    cat log
+	    echo "  FAIL: $f $v"
+	    exit 1
+	fi
+    done
+done
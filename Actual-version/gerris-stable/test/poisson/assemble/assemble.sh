@@ -0,0 +1,47 @@
+if test x$donotrun != xtrue; then
+    for extra in 0 2; do
+	for smoother in jacobi rbgs; do
+	    for assemble in 0 1; do
+		rm -f stats-$extra-$smoother-$assemble error-$extra-$smoother-$assemble
+		for level in 6 7 8 9; do
+		    if gerris2D -DLEVEL=$level -DEXTRA=$extra -DSMOOTHER=$smoother \
+			-DASSEMBLE=$assemble $1 ; then :
+		    else
+			exit 1
+		    fi
+		done
+	    done
+	done
+    done
+fi
+
+if cat <<EOF | gnuplot ; then :
+    set term postscript eps color lw 3 solid 20
+    set output 'time.eps'
+    set xlabel 'Level'
+    set ylabel 'Time per projection (s)'
+    set logscale y
+    set key top left
+    plot 'stats-2-jacobi-0' u 1:3 t 'Circle, Jacobi, tree' w lp, \
+         'stats-2-jacobi-1' u 1:3 t 'Circle, Jacobi, assembled' w lp, \
+         'stats-2-rbgs-0' u 1:3 t 'Circle, red-black, tree' w lp, \
+         'stats-2-rbgs-1' u 1:3 t 'Circle, red-black, assembled' w lp
+EOF
+else
+    exit 1
+fi
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+for extra in ['0', '2']:
+    for smoother in ['jacobi', 'rbgs']:
+        tree = 'error-' + extra + '-' + smoother + '-0'
+        assembled = 'error-' + extra + '-' + smoother + '-1'
+        if (Curve(assembled,1,4) - Curve(tree,1,4)).max() > 1e-6:
+            print (Curve(assembled,1,4) - Curve(tree,1,4)).max()
+            exit(1)
+EOF
+else
+   exit 1
+fi
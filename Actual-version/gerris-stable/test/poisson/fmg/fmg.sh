@@ -0,0 +1,45 @@
+if test x$donotrun != xtrue; then
+    for fmg in 0 1; do
+	for adaptive in 0 1; do
+	    if gerris2D -DFMG=$fmg -DADAPTIVE=$adaptive $1 ; then :
+	    else
+		exit 1
+	    fi
+	done
+    done
+fi
+
+if cat <<EOF | gnuplot ; then :
+    set term postscript eps color lw 3 solid 20
+    set output 'history.eps'
+    set xlabel 'Cycle'
+    set ylabel 'Maximum residual'
+    set logscale y
+    plot 'history-0-0' u 1:2 t 'V-cycles' w lp, \
+         'history-1-0' u 1:2 t 'FMG start' w lp, \
+         'history-0-1' u 1:2 t 'Adaptive' w lp, \
+         'history-1-1' u 1:2 t 'FMG start, adaptive' w lp
+EOF
+else
+    exit 1
+fi
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+def first(name):
+    return [float(x) for x in open(name).readline().split()]
+ref = first('error-0-0')
+for case in ['1-0', '0-1', '1-1']:
+    e = first('error-' + case)
+    for i in range(3):
+        if abs (e[i] - ref[i]) > 1e-6:
+            print case, e, ref
+            exit(1)
+if first('niter-1-0')[0] > first('niter-0-0')[0]:
+    print first('niter-1-0'), first('niter-0-0')
+    exit(1)
+EOF
+else
+   exit 1
+fi
@@ -0,0 +1,54 @@
+methods="none cg bicgstab"
+
+if test x$donotrun != xtrue; then
+    for krylov in $methods; do
+	for ratio in 1 1000; do
+	    if gerris2D -DRATIO=$ratio -DKRYLOV=$krylov $1 ; then :
+	    else
+		exit 1
+	    fi
+	done
+	if gerris2D -DKRYLOV=$krylov capwave.gfs ; then :
+	else
+	    exit 1
+	fi
+    done
+fi
+
+# each BiCGStab iteration uses two multigrid cycles
+rm -f cycles.tex
+for problem in 1 1000 capwave; do
+    for krylov in $methods; do
+	awk -v problem=$problem '{
+          cycles = $2;
+          if ($1 == "bicgstab") cycles *= 2;
+          if (problem == "capwave") name = "Capillary wave, " $4;
+          else name = "Poisson, ratio " problem;
+          printf ("%s & %s & %.1f & %.3g \\\\\n", name, $1, cycles, $3);
+        }' < stats-$problem-$krylov >> cycles.tex
+    done
+done
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+def cycles(problem, krylov):
+    n = 0.
+    for l in open('stats-' + problem + '-' + krylov):
+        s = l.split()
+        n = max(n, float(s[1])*(2. if krylov == 'bicgstab' else 1.))
+    return n
+none = [float(x) for x in open('error-1-none').readline().split()]
+for krylov in ['cg', 'bicgstab']:
+    e = [float(x) for x in open('error-1-' + krylov).readline().split()]
+    for i in range(3):
+        if abs (e[i] - none[i]) > 1e-6:
+            print krylov, e, none
+            exit(1)
+    if cycles('1000', krylov) >= cycles('1000', 'none'):
+        print krylov, cycles('1000', krylov), cycles('1000', 'none')
+        exit(1)
+EOF
+else
+   exit 1
+fi
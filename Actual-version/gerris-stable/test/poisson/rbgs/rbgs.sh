@@ -0,0 +1,53 @@
+if test x$donotrun != xtrue; then
+    for extra in 0 2; do
+	for smoother in jacobi rbgs; do
+	    rm -f stats-$extra-$smoother error-$extra-$smoother
+	    for level in 6 7 8 9; do
+		if gerris2D -DLEVEL=$level -DEXTRA=$extra -DSMOOTHER=$smoother $1 ; then :
+		else
+		    exit 1
+		fi
+	    done
+	done
+    done
+fi
+
+if cat <<EOF | gnuplot ; then :
+    set term postscript eps color lw 3 solid 20
+    set output 'niter.eps'
+    set xlabel 'Level'
+    set ylabel 'V-cycles per projection'
+    set key top left
+    plot 'stats-0-jacobi' u 1:2 t 'Uniform, Jacobi' w lp, \
+         'stats-0-rbgs' u 1:2 t 'Uniform, red-black' w lp, \
+         'stats-2-jacobi' u 1:2 t 'Circle, Jacobi' w lp, \
+         'stats-2-rbgs' u 1:2 t 'Circle, red-black' w lp
+    set output 'time.eps'
+    set ylabel 'Time per projection (s)'
+    set logscale y
+    plot 'stats-0-jacobi' u 1:3 t 'Uniform, Jacobi' w lp, \
+         'stats-0-rbgs' u 1:3 t 'Uniform, red-black' w lp, \
+         'stats-2-jacobi' u 1:3 t 'Circle, Jacobi' w lp, \
+         'stats-2-rbgs' u 1:3 t 'Circle, red-black' w lp
+EOF
+else
+    exit 1
+fi
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+for extra in ['0', '2']:
+    if (Curve('error-' + extra + '-rbgs',1,4) - Curve('error-' + extra + '-jacobi',1,4)).max() > 1e-6:
+        print (Curve('error-' + extra + '-rbgs',1,4) - Curve('error-' + extra + '-jacobi',1,4)).max()
+        exit(1)
+    jacobi = [map(float, l.split()) for l in open('stats-' + extra + '-jacobi')]
+    rbgs = [map(float, l.split()) for l in open('stats-' + extra + '-rbgs')]
+    for j, r in zip(jacobi, rbgs):
+        if r[1] > j[1]:
+            print j, r
+            exit(1)
+EOF
+else
+   exit 1
+fi
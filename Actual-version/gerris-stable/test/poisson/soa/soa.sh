@@ -0,0 +1,53 @@
+if test x$donotrun != xtrue; then
+    for extra in 0 2; do
+	for soa in 0 1; do
+	    rm -f time-$extra-$soa error-$extra-$soa lookups-$extra-$soa
+	    for level in 6 7 8 9; do
+		if gerris2D -DLEVEL=$level -DEXTRA=$extra -DSOA=$soa $1 ; then :
+		else
+		    exit 1
+		fi
+	    done
+	done
+    done
+fi
+
+if cat <<EOF | gnuplot ; then :
+    set term postscript eps color lw 3 solid 20
+    set output 'time.eps'
+    set xlabel 'Level'
+    set ylabel 'CPU time (s)'
+    set logscale y
+    set key top left
+    plot 'time-0-0' t 'Uniform' w lp, \
+         'time-0-1' t 'Uniform, SoA' w lp, \
+         'time-2-0' t 'Circle' w lp, \
+         'time-2-1' t 'Circle, SoA' w lp
+    set output 'lookups.eps'
+    set ylabel 'Neighbor lookups per timestep'
+    plot 'lookups-0-1' u 1:2 t 'Uniform, table' w lp, \
+         'lookups-0-1' u 1:3 t 'Uniform, tree' w lp, \
+         'lookups-2-1' u 1:2 t 'Circle, table' w lp, \
+         'lookups-2-1' u 1:3 t 'Circle, tree' w lp
+EOF
+else
+    exit 1
+fi
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+for extra in ['0', '2']:
+    if (Curve('error-' + extra + '-1',1,4) - Curve('error-' + extra + '-0',1,4)).max() > 1e-6:
+        print (Curve('error-' + extra + '-1',1,4) - Curve('error-' + extra + '-0',1,4)).max()
+        exit(1)
+    # almost all the neighbor lookups must be served by the table
+    for l in open('lookups-' + extra + '-1'):
+        level, table, tree = map(float, l.split())
+        if table == 0. or tree > 0.01*table:
+            print l
+            exit(1)
+EOF
+else
+   exit 1
+fi
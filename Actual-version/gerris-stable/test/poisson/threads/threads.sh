@@ -0,0 +1,36 @@
+if test x$donotrun != xtrue; then
+    rm -f time error
+    for nthreads in 1 2 4 8; do
+	if gerris2D -DNTHREADS=$nthreads $1 ; then :
+	else
+	    exit 1
+	fi
+    done
+fi
+
+if cat <<EOF | gnuplot ; then :
+    set term postscript eps color lw 3 solid 20
+    set output 'time.eps'
+    set xlabel 'Number of threads'
+    set ylabel 'Wall-clock time (s)'
+    set logscale
+    set xtics (1,2,4,8)
+    plot 'time' t '' w lp
+EOF
+else
+    exit 1
+fi
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+e = [map(float, l.split()) for l in open('error')]
+for l in e[1:]:
+    for i in range(1,4):
+        if abs (l[i] - e[0][i]) > 1e-6:
+            print l
+            exit(1)
+EOF
+else
+   exit 1
+fi
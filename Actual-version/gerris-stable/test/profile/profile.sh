@@ -0,0 +1,34 @@
+if test x$donotrun != xtrue; then
+    if mpirun -np 2 gerris2D $1 ; then :
+    else
+	echo "  FAIL: mpirun -np 2 gerris2D $1"
+	exit 1
+    fi
+fi
+
+rm -f profile.tex
+awk '{
+  if ($2 == 0) {
+    gsub ("_", "\\_", $3);
+    printf ("%s & %s & %d & %d & %.3f & %.3f \\\\\n", $3, $4, $6, $7, $8, $9);
+  }
+}' < profile >> profile.tex
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+sent = {}
+for l in open('profile'):
+    s = l.split()
+    if s[0] != '#':
+        sent[(s[1],s[2],s[3])] = int(s[5])
+if len(sent) == 0:
+    exit(1)
+for (pid,phase,variable),bytes in sent.items():
+    if sent.get((str(1 - int(pid)),phase,variable)) != bytes:
+        print pid,phase,variable,bytes
+        exit(1)
+EOF
+else
+   exit 1
+fi
@@ -0,0 +1,24 @@
+if test x$donotrun != xtrue; then
+    for dirty in 0 1; do
+	if gerris2D -DDIRTY=$dirty $1 ; then :
+	else
+	    echo "  FAIL: gerris2D -DDIRTY=$dirty $1"
+	    exit 1
+	fi
+    done
+fi
+
+for v in T U V P; do
+    if gfscompare2D -v end-0.gfs end-1.gfs $v 2> log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+    if awk '{ if ($1 == "total" && $8 > 0.) exit 1; }' < log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+done
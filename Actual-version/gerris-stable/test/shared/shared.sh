@@ -0,0 +1,34 @@
+if test x$donotrun != xtrue; then
+    for shared in 0 1; do
+	if mpirun -np 2 gerris2D -DSHARED=$shared $1 ; then :
+	else
+	    echo "  FAIL: mpirun -np 2 gerris2D -DSHARED=$shared $1"
+	    exit 1
+	fi
+    done
+fi
+
+for v in T U V P; do
+    if gfscompare2D -v end-0.gfs end-1.gfs $v 2> log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+    if awk '{ if ($1 == "total" && $8 > 0.) exit 1; }' < log; then :
+    else
+	cat log
+	echo "  FAIL: $v"
+	exit 1
+    fi
+done
+
+if cat <<EOF | python ; then :
+from check import *
+from sys import *
+if int(open('messages-0').readline()) != 0 or int(open('messages-1').readline()) == 0:
+    exit(1)
+EOF
+else
+   exit 1
+fi
@@ -514,7 +514,8 @@ int main (int argc, char * argv[])
     return 1;
   }
   fp = gts_file_new (f);
-  if (!(s1 = gfs_simulation_read (fp))) {
+  /* only VAR is read from indexed data files */
+  if (!(s1 = gfs_simulation_read_variables (fp, name))) {
     fprintf (stderr, 
 	     "gfscompare: file `%s' is not a valid simulation file\n"
 	     "%s:%d:%d: %s\n",
@@ -531,7 +532,7 @@ int main (int argc, char * argv[])
     return 1;
   }
   fp = gts_file_new (f);
-  if (!(s2 = gfs_simulation_read (fp))) {
+  if (!(s2 = gfs_simulation_read_variables (fp, name))) {
     fprintf (stderr, 
 	     "gfscompare: file `%s' is not a valid simulation file\n"
 	     "%s:%d:%d: %s\n",